@@ -0,0 +1,286 @@
+//Copyright 2013 Brody Kenrick.
+//Raw UART capture and deterministic replay
+
+#include "ANTCapture.h"
+
+ANTCapture::ANTCapture( byte * buffer, unsigned int size ) : ring(buffer, size)
+{
+  overflow_count = 0;
+  gap_records = 0;
+  last_us = micros();
+}
+
+void ANTCapture::writeHeader( Print & out, unsigned long baud_rate )
+{
+  out.write((const uint8_t *)ANT_CAPTURE_MAGIC, 4);
+  out.write((uint8_t)ANT_CAPTURE_VERSION);
+  for(byte i = 0; i < 4; i++)
+  {
+    out.write((uint8_t)(baud_rate >> (8 * i)));
+  }
+}
+
+//Called per UART byte (and from the RTS ISR) -- no allocation, no printing
+void ANTCapture::record( byte type, byte value )
+{
+  ANTPLUS_ATOMIC_BLOCK
+  {
+    //A GAP record needs room too
+    if(ring.space() < (2 * ANT_CAPTURE_RECORD_MAX))
+    {
+      overflow_count++;
+      gap_records++;
+    }
+    else
+    {
+      unsigned long now_us = micros();
+      if(gap_records)
+      {
+        ring.put(ANT_CAPTURE_GAP); //Zero delta
+        ring.put((gap_records > 0xFF) ? 0xFF : gap_records);
+        gap_records = 0;
+      }
+
+      unsigned long delta_us = now_us - last_us;
+      if(delta_us > ANT_CAPTURE_DELTA_MAX_US)
+      {
+        delta_us = ANT_CAPTURE_DELTA_MAX_US;
+      }
+      last_us = now_us;
+
+      //LEB128 -- most records are a byte apart and fit in one byte (< 32us) or two (< 4ms)
+      unsigned long header = (delta_us << 2) | type;
+      while(header > 0x7F)
+      {
+        ring.put((byte)(header | 0x80));
+        header >>= 7;
+      }
+      ring.put((byte)header);
+      ring.put(value);
+    }
+  }
+}
+
+unsigned int ANTCapture::available()
+{
+  unsigned int count;
+  ANTPLUS_ATOMIC_BLOCK
+  {
+    count = ring.available();
+  }
+  return count;
+}
+
+int ANTCapture::read()
+{
+  int value;
+  ANTPLUS_ATOMIC_BLOCK
+  {
+    value = ring.get();
+  }
+  return value;
+}
+
+void ANTCapture::drain( Print & out )
+{
+  int value;
+  while((value = read()) >= 0)
+  {
+    out.write((uint8_t)value);
+  }
+}
+
+
+ANTReplayStream::ANTReplayStream( const byte * capture, unsigned long length, boolean realtime )
+{
+  this->capture = capture;
+  this->length = length;
+  this->realtime = realtime;
+  rts_handler = NULL;
+  reset_pin = ANT_REPLAY_NO_PIN;
+  reset_seen_low = false;
+  tx_mismatch_count = 0;
+  tx_extra_count = 0;
+  gap_count = 0;
+  started = false;
+  next_valid = false;
+  read_time_us = 0;
+  tx_time_us = 0;
+  baud_rate = 0;
+  read_pos = 0; //Invalid
+
+  if((length >= ANT_CAPTURE_HEADER_LEN) && (memcmp(capture, ANT_CAPTURE_MAGIC, 4) == 0) && (capture[4] <= ANT_CAPTURE_VERSION))
+  {
+    for(byte i = 0; i < 4; i++)
+    {
+      baud_rate |= ((unsigned long)capture[5 + i]) << (8 * i);
+    }
+    read_pos = ANT_CAPTURE_HEADER_LEN;
+  }
+  tx_pos = read_pos;
+}
+
+//! Decode the record at pos. Moves pos past it and adds its delta to time_us.
+boolean ANTReplayStream::decode( unsigned long * pos, unsigned long * time_us, byte * type, byte * value )
+{
+  unsigned long header = 0;
+  byte shift = 0;
+  unsigned long p = *pos;
+  while(true)
+  {
+    if((p >= length) || (shift > 28))
+    {
+      return false;
+    }
+    byte in = capture[p++];
+    header |= ((unsigned long)(in & 0x7F)) << shift;
+    shift += 7;
+    if(!(in & 0x80))
+    {
+      break;
+    }
+  }
+  if(p >= length)
+  {
+    return false;
+  }
+  *type = header & 0x03;
+  *value = capture[p++];
+  *time_us += header >> 2;
+  *pos = p;
+  return true;
+}
+
+//! Release everything at the read cursor that is due, stopping at the next received byte
+void ANTReplayStream::advance()
+{
+  if(!valid())
+  {
+    return;
+  }
+  if(!started)
+  {
+    started = true;
+    start_us = micros();
+  }
+
+  if(!realtime && (reset_pin != ANT_REPLAY_NO_PIN) && (digitalRead(reset_pin) == LOW))
+  {
+    reset_seen_low = true;
+  }
+
+  while(true)
+  {
+    if(!next_valid)
+    {
+      next_end = read_pos;
+      next_time_us = read_time_us;
+      if(!decode(&next_end, &next_time_us, &next_type, &next_value))
+      {
+        return;
+      }
+      next_valid = true;
+    }
+
+    if(realtime && ((micros() - start_us) < next_time_us))
+    {
+      return;
+    }
+
+    switch(next_type)
+    {
+      case ANT_CAPTURE_RX:
+        //Waits for read()
+        return;
+
+      case ANT_CAPTURE_TX:
+        //Fast mode -- the module only answered after this was sent
+        if(!realtime && (tx_pos < next_end))
+        {
+          return;
+        }
+        break;
+
+      case ANT_CAPTURE_RTS:
+        if(next_value == ANT_CAPTURE_RESET_RELEASED)
+        {
+          //Fast mode -- the module only started up after this
+          if(!realtime && (reset_pin != ANT_REPLAY_NO_PIN))
+          {
+            if(!reset_seen_low || (digitalRead(reset_pin) == LOW))
+            {
+              return;
+            }
+            reset_seen_low = false;
+          }
+        }
+        else
+        if(rts_handler)
+        {
+          rts_handler(next_value != 0);
+        }
+        break;
+
+      case ANT_CAPTURE_GAP:
+        gap_count += next_value;
+        break;
+    }
+    read_pos = next_end;
+    read_time_us = next_time_us;
+    next_valid = false;
+  }
+}
+
+boolean ANTReplayStream::finished()
+{
+  advance();
+  return !next_valid && (read_pos >= length);
+}
+
+int ANTReplayStream::available()
+{
+  advance();
+  return (next_valid && (next_type == ANT_CAPTURE_RX) && (!realtime || ((micros() - start_us) >= next_time_us))) ? 1 : 0;
+}
+
+int ANTReplayStream::peek()
+{
+  return available() ? next_value : -1;
+}
+
+int ANTReplayStream::read()
+{
+  if(!available())
+  {
+    return -1;
+  }
+  byte value = next_value;
+  read_pos = next_end;
+  read_time_us = next_time_us;
+  next_valid = false;
+  return value;
+}
+
+size_t ANTReplayStream::write( uint8_t value )
+{
+  unsigned long pos = tx_pos;
+  unsigned long time_us = tx_time_us;
+  byte type;
+  byte recorded;
+  //The next sent byte in the capture
+  while(decode(&pos, &time_us, &type, &recorded))
+  {
+    if(type == ANT_CAPTURE_TX)
+    {
+      tx_pos = pos;
+      tx_time_us = time_us;
+      if(recorded != value)
+      {
+        tx_mismatch_count++;
+      }
+      return 1;
+    }
+  }
+  tx_extra_count++;
+  return 1;
+}
@@ -0,0 +1,134 @@
+//Copyright 2013 Brody Kenrick.
+//Raw UART capture and deterministic replay (enable ANTPLUS_CAPTURE in ANTPlus.h for the recorder hooks)
+
+//Capture format (little endian)
+// Header : 'A' 'N' 'T' 'C', version, baud rate (4 bytes)
+// Record : LEB128 varint of ((microseconds since the previous record << 2) | type), then one value byte
+//  RX/TX  -- a byte off/onto the wire
+//  RTS    -- value is the RTS level (1 busy, 0 ready for the next message), or ANT_CAPTURE_RESET_RELEASED when
+//            the host let the module out of reset (version 2)
+//  GAP    -- the ring buffer overflowed. value is the number of records lost (saturates at 255).
+//A byte at 9600 baud is a two byte record so a capture is about twice the size of the traffic.
+
+#ifndef ANTCapture_h
+#define ANTCapture_h
+
+#include "ANTPlus.h"
+#include "ANTRingBuffer.h"
+
+#define ANT_CAPTURE_MAGIC        "ANTC"
+#define ANT_CAPTURE_VERSION      (2)
+#define ANT_CAPTURE_HEADER_LEN   (9)
+#define ANT_CAPTURE_RECORD_MAX   (6)          //!< Longest record -- 5 byte varint and the value
+#define ANT_CAPTURE_DELTA_MAX_US (0x3FFFFFFFUL) //!< Longer gaps are clamped (~17 minutes)
+#define ANT_CAPTURE_RESET_RELEASED (2)        //!< RTS record value -- RESET pin taken high
+#define ANT_REPLAY_NO_PIN        (0xFF)
+
+typedef enum
+{
+  ANT_CAPTURE_RX,
+  ANT_CAPTURE_TX,
+  ANT_CAPTURE_RTS,
+  ANT_CAPTURE_GAP
+} ANT_CAPTURE_TYPE;
+
+
+//! Records UART traffic into a ring buffer. Drain it from loop() (e.g. to Serial or an SD card).
+class ANTCapture
+{
+  public:
+    //! size must be a power of two
+    ANTCapture( byte * buffer, unsigned int size );
+
+    void rx( byte value ) {record(ANT_CAPTURE_RX, value);};
+    void tx( byte value ) {record(ANT_CAPTURE_TX, value);};
+    void rts( boolean rts_high ) {record(ANT_CAPTURE_RTS, rts_high ? 1 : 0);};
+    void resetReleased() {record(ANT_CAPTURE_RTS, ANT_CAPTURE_RESET_RELEASED);};
+
+    //! Write the header that starts a capture file
+    static void writeHeader( Print & out, unsigned long baud_rate );
+
+    unsigned int available();
+    int          read();
+    //! Write out everything buffered so far
+    void         drain( Print & out );
+
+  public:
+    unsigned long overflow_count; //!< Records lost to a full buffer
+
+  private:
+    void record( byte type, byte value );
+
+  private:
+    ANTRingBuffer ring;
+    unsigned long last_us;
+    unsigned int  gap_records; //!< Lost since the last GAP record was written
+};
+
+
+typedef void (*ANT_ReplayRts)( boolean rts_high );
+
+//! Plays a capture back to ANTPlus in place of the UART.
+//Realtime -- bytes and RTS edges are released at their original offsets from the first read.
+//Fast     -- no waiting. Received bytes after a sent byte are held back until ANTPlus has written it, so request/response order is kept.
+//            Likewise those after a reset until ANTPlus has taken the RESET pin low and high again (setResetPin()) --
+//            otherwise the startup message is thrown away with the stale bytes.
+//            The timing is not kept, so reads that depend on it (a frame cut short is given up after the mid-frame
+//            timeout) can come out differently -- use realtime for captures with lost bytes.
+//Sent bytes are compared against the TX records as they are written.
+class ANTReplayStream : public Stream
+{
+  public:
+    ANTReplayStream( const byte * capture, unsigned long length, boolean realtime = false );
+
+    //! False if the header is missing or from a newer version
+    boolean       valid() {return (read_pos != 0);};
+    unsigned long getBaudRate() {return baud_rate;};
+    //! Called as RTS records are reached. e.g. { antplus.handleRtsEdge(rts_high); }
+    void          setRtsHandler( ANT_ReplayRts handler ) {rts_handler = handler;};
+    //! Fast mode. The RESET pin ANTPlus drives (read back with digitalRead()).
+    void          setResetPin( byte pin ) {reset_pin = pin;};
+    //! Every record has been played
+    boolean       finished();
+
+    virtual int    available();
+    virtual int    read();
+    virtual int    peek();
+    virtual size_t write( uint8_t value );
+    virtual void   flush() {};
+    using Print::write;
+
+  public:
+    unsigned long tx_mismatch_count; //!< Written bytes that differ from the capture
+    unsigned long tx_extra_count;    //!< Written bytes beyond the end of the capture
+    unsigned long gap_count;         //!< Records lost when the capture was taken
+
+  private:
+    boolean decode( unsigned long * pos, unsigned long * time_us, byte * type, byte * value );
+    void    advance();
+
+  private:
+    const byte *  capture;
+    unsigned long length;
+    boolean       realtime;
+    unsigned long baud_rate;
+    ANT_ReplayRts rts_handler;
+    byte          reset_pin;
+    boolean       reset_seen_low; //!< Since the last reset record
+
+    boolean       started;
+    unsigned long start_us;
+
+    unsigned long read_pos;     //!< Next record for the read cursor
+    unsigned long read_time_us;
+    boolean       next_valid;   //!< Record decoded at the read cursor but not yet released
+    unsigned long next_end;
+    unsigned long next_time_us;
+    byte          next_type;
+    byte          next_value;
+
+    unsigned long tx_pos;       //!< Next record for the write cursor
+    unsigned long tx_time_us;
+};
+
+#endif //ANTCapture_h
@@ -0,0 +1,160 @@
+//Copyright 2013 Brody Kenrick.
+//Device table for a continuous scan mode receiver
+
+#include "ANTDeviceTable.h"
+
+#define ANT_DEVICE_TABLE_MASK (ANT_DEVICE_TABLE_SIZE - 1)
+
+ANTDeviceTable::ANTDeviceTable( unsigned long stale_ms )
+{
+  this->stale_ms = stale_ms;
+  dropped_count = 0;
+  evicted_count = 0;
+  clear();
+}
+
+void ANTDeviceTable::clear()
+{
+  memset(table, 0, sizeof(table));
+  used = 0;
+  sweep_slot = 0;
+}
+
+uint32_t ANTDeviceTable::pack( const ANT_DeviceId * id )
+{
+  return (uint32_t)id->device_number | ((uint32_t)id->device_type << 16) | ((uint32_t)id->transmission_type << 24);
+}
+
+void ANTDeviceTable::get_device_id( const ANT_DeviceEntry * entry, ANT_DeviceId * id )
+{
+  id->device_number     = (unsigned int)(entry->key & 0xFFFF);
+  id->device_type       = (byte)(entry->key >> 16);
+  id->transmission_type = (byte)(entry->key >> 24);
+}
+
+//Fibonacci hashing -- the device numbers of nearby sensors are often close together
+unsigned int ANTDeviceTable::home( uint32_t key )
+{
+  return (unsigned int)(((uint32_t)(key * 2654435761UL)) >> 16) & ANT_DEVICE_TABLE_MASK;
+}
+
+boolean ANTDeviceTable::isStale( unsigned int slot, unsigned long now_ms )
+{
+  return (table[slot].key != 0) && ((now_ms - table[slot].last_seen_ms) > stale_ms);
+}
+
+//Backward-shift deletion. Keeps every probe sequence unbroken without tombstones.
+void ANTDeviceTable::removeAt( unsigned int slot )
+{
+  unsigned int hole = slot;
+  unsigned int next = slot;
+  while(true)
+  {
+    next = (next + 1) & ANT_DEVICE_TABLE_MASK;
+    if(table[next].key == 0)
+    {
+      break;
+    }
+    //Leave entries whose home slot lies cyclically in (hole, next]
+    unsigned int h = home(table[next].key);
+    boolean in_place = (hole <= next) ? ((hole < h) && (h <= next)) : ((hole < h) || (h <= next));
+    if(!in_place)
+    {
+      table[hole] = table[next];
+      hole = next;
+    }
+  }
+  table[hole].key = 0;
+  used--;
+  evicted_count++;
+}
+
+ANT_DeviceEntry * ANTDeviceTable::find( const ANT_DeviceId * id )
+{
+  uint32_t key = pack(id);
+  unsigned int slot = home(key);
+  while(table[slot].key != 0)
+  {
+    if(table[slot].key == key)
+    {
+      return &table[slot];
+    }
+    slot = (slot + 1) & ANT_DEVICE_TABLE_MASK;
+  }
+  return NULL;
+}
+
+ANT_DeviceEntry * ANTDeviceTable::update( const ANT_Packet * packet, unsigned long now_ms )
+{
+  ANT_DeviceId id;
+  const byte * payload;
+  if(!ANTPlus::get_extended_device_id(packet, &id, &payload))
+  {
+    return NULL;
+  }
+  return update(&id, payload, now_ms);
+}
+
+ANT_DeviceEntry * ANTDeviceTable::update( const ANT_DeviceId * id, const byte * payload, unsigned long now_ms )
+{
+  //Age out one slot per update so eviction cost is spread across packets
+  if(isStale(sweep_slot, now_ms))
+  {
+    removeAt(sweep_slot);
+  }
+  sweep_slot = (sweep_slot + 1) & ANT_DEVICE_TABLE_MASK;
+
+  uint32_t key = pack(id);
+  if(key == 0)
+  {
+    return NULL;
+  }
+
+  unsigned int slot = home(key);
+  while(table[slot].key != 0 && table[slot].key != key)
+  {
+    slot = (slot + 1) & ANT_DEVICE_TABLE_MASK;
+  }
+
+  ANT_DeviceEntry * entry = &table[slot];
+  if(entry->key == 0)
+  {
+    //New device -- always leave one empty slot so probes terminate
+    if(used >= (ANT_DEVICE_TABLE_SIZE - 1))
+    {
+      dropped_count++;
+      return NULL;
+    }
+    entry->key = key;
+    entry->rx_count = 0;
+    used++;
+  }
+
+  entry->last_seen_ms = now_ms;
+  if(entry->rx_count != 0xFFFF)
+  {
+    entry->rx_count++;
+  }
+  if(payload)
+  {
+    memcpy(entry->data, payload, ANT_STANDARD_DATA_PAYLOAD_SIZE);
+  }
+  return entry;
+}
+
+void ANTDeviceTable::evictStale( unsigned long now_ms )
+{
+  unsigned int slot = 0;
+  while(slot < ANT_DEVICE_TABLE_SIZE)
+  {
+    if(isStale(slot, now_ms))
+    {
+      //A later entry may have shifted into this slot -- check it again
+      removeAt(slot);
+    }
+    else
+    {
+      slot++;
+    }
+  }
+}
@@ -0,0 +1,71 @@
+//Copyright 2013 Brody Kenrick.
+//Device table for a continuous scan mode receiver (see ANTPLUS_SCAN_MODE and ANT_Channel::scan_mode)
+
+//In scan mode every device in range arrives on channel 0 and is told apart by the
+// extended data device ID. This keeps the latest data page and last-seen time per device
+// in a fixed-size open-addressing hash table (linear probing, backward-shift deletion).
+//Lookup and update are O(1) per packet. Stale devices are evicted incrementally, one slot per update.
+
+#ifndef ANTDeviceTable_h
+#define ANTDeviceTable_h
+
+#include "ANTPlus.h"
+
+#if !defined(ANT_DEVICE_TABLE_SIZE)
+#define ANT_DEVICE_TABLE_SIZE      (16)    //!< Number of slots. Must be a power of two. One slot is always kept empty.
+#endif
+#define ANT_DEVICE_TABLE_STALE_MS  (5000)  //!< Default time without a message before a device is evicted
+
+#if (ANT_DEVICE_TABLE_SIZE & (ANT_DEVICE_TABLE_SIZE - 1)) != 0
+#error "ANT_DEVICE_TABLE_SIZE must be a power of two"
+#endif
+
+//! A device seen in scan mode.
+typedef struct ANT_DeviceEntry_struct
+{
+   uint32_t key;            //!< Packed device ID (0 == empty slot -- device number 0 is the wildcard and never transmitted)
+   unsigned long last_seen_ms;
+   unsigned int rx_count;   //!< Messages received from this device (saturates)
+   byte data[ANT_STANDARD_DATA_PAYLOAD_SIZE]; //!< Latest data page
+} ANT_DeviceEntry;
+
+
+class ANTDeviceTable
+{
+  public:
+    ANTDeviceTable( unsigned long stale_ms = ANT_DEVICE_TABLE_STALE_MS );
+
+    //! Decode the extended data from a packet and update its device. NULL if the packet has no device ID or the table is full.
+    ANT_DeviceEntry * update( const ANT_Packet * packet, unsigned long now_ms );
+    ANT_DeviceEntry * update( const ANT_DeviceId * id, const byte * payload, unsigned long now_ms );
+
+    ANT_DeviceEntry * find( const ANT_DeviceId * id );
+
+    //! Full sweep for stale devices (update() already evicts incrementally)
+    void evictStale( unsigned long now_ms );
+    void clear();
+
+    //! For iterating the table. Returns NULL for empty slots.
+    ANT_DeviceEntry * entry( unsigned int slot ) {return (slot < ANT_DEVICE_TABLE_SIZE && table[slot].key != 0) ? &table[slot] : NULL;};
+    unsigned int count() const {return used;};
+
+    static void get_device_id( const ANT_DeviceEntry * entry, ANT_DeviceId * id );
+
+  public:
+    long dropped_count; //!< Updates refused because the table was full
+    long evicted_count;
+
+  private:
+    static uint32_t     pack( const ANT_DeviceId * id );
+    static unsigned int home( uint32_t key );
+    boolean             isStale( unsigned int slot, unsigned long now_ms );
+    void                removeAt( unsigned int slot );
+
+  private:
+    ANT_DeviceEntry table[ANT_DEVICE_TABLE_SIZE];
+    unsigned int used;
+    unsigned int sweep_slot;
+    unsigned long stale_ms;
+};
+
+#endif //ANTDeviceTable_h
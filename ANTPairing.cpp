@@ -0,0 +1,119 @@
+//Copyright 2013 Brody Kenrick.
+//Persisted pairing stores
+
+#include "ANTPairing.h"
+
+#if defined(ANTPLUS_PAIRING_EEPROM)
+#include <EEPROM.h>
+#endif
+
+#if defined(ANTPLUS_PAIRING_FILE)
+#include <stdio.h>
+#endif
+
+void ANTPairingStore::encode( const ANT_DeviceId * id, byte record[ANT_PAIRING_RECORD_LEN] )
+{
+  record[0] = ANT_PAIRING_RECORD_MARKER;
+  record[1] = id->device_number & 0xFF;
+  record[2] = (id->device_number >> 8) & 0xFF;
+  record[3] = id->device_type;
+  record[4] = id->transmission_type;
+  record[5] = record[0] ^ record[1] ^ record[2] ^ record[3] ^ record[4];
+}
+
+boolean ANTPairingStore::decode( const byte record[ANT_PAIRING_RECORD_LEN], ANT_DeviceId * id )
+{
+  if(record[0] != ANT_PAIRING_RECORD_MARKER)
+  {
+    return false;
+  }
+  if(record[5] != (record[0] ^ record[1] ^ record[2] ^ record[3] ^ record[4]))
+  {
+    return false;
+  }
+  id->device_number     = record[1] | (record[2] << 8);
+  id->device_type       = record[3];
+  id->transmission_type = record[4];
+  //A wildcard is never stored
+  return (id->device_number != 0);
+}
+
+
+#if defined(ANTPLUS_PAIRING_EEPROM)
+boolean ANTPairingEEPROM::load( byte slot, ANT_DeviceId * id )
+{
+  byte record[ANT_PAIRING_RECORD_LEN];
+  int address = base_address + (slot * ANT_PAIRING_RECORD_LEN);
+  for(byte i = 0; i < ANT_PAIRING_RECORD_LEN; i++)
+  {
+    record[i] = EEPROM.read(address + i);
+  }
+  return decode(record, id);
+}
+
+boolean ANTPairingEEPROM::save( byte slot, const ANT_DeviceId * id )
+{
+  byte record[ANT_PAIRING_RECORD_LEN];
+  encode(id, record);
+  int address = base_address + (slot * ANT_PAIRING_RECORD_LEN);
+  for(byte i = 0; i < ANT_PAIRING_RECORD_LEN; i++)
+  {
+    //Saves a write cycle when re-pairing with the same device
+    EEPROM.update(address + i, record[i]);
+  }
+  return true;
+}
+
+void ANTPairingEEPROM::clear( byte slot )
+{
+  EEPROM.update(base_address + (slot * ANT_PAIRING_RECORD_LEN), 0xFF);
+}
+#endif //defined(ANTPLUS_PAIRING_EEPROM)
+
+
+#if defined(ANTPLUS_PAIRING_FILE)
+boolean ANTPairingFile::load( byte slot, ANT_DeviceId * id )
+{
+  byte record[ANT_PAIRING_RECORD_LEN];
+  FILE * file = fopen(path, "rb");
+  if(file == NULL)
+  {
+    return false;
+  }
+  boolean read_ok = (fseek(file, slot * ANT_PAIRING_RECORD_LEN, SEEK_SET) == 0)
+                    && (fread(record, 1, ANT_PAIRING_RECORD_LEN, file) == ANT_PAIRING_RECORD_LEN);
+  fclose(file);
+  return read_ok && decode(record, id);
+}
+
+boolean ANTPairingFile::write( byte slot, const byte record[ANT_PAIRING_RECORD_LEN] )
+{
+  FILE * file = fopen(path, "r+b");
+  if(file == NULL)
+  {
+    file = fopen(path, "w+b");
+    if(file == NULL)
+    {
+      return false;
+    }
+  }
+  //Seeking past the end leaves zeros (no marker) in the slots between
+  boolean write_ok = (fseek(file, slot * ANT_PAIRING_RECORD_LEN, SEEK_SET) == 0)
+                     && (fwrite(record, 1, ANT_PAIRING_RECORD_LEN, file) == ANT_PAIRING_RECORD_LEN);
+  write_ok = (fclose(file) == 0) && write_ok;
+  return write_ok;
+}
+
+boolean ANTPairingFile::save( byte slot, const ANT_DeviceId * id )
+{
+  byte record[ANT_PAIRING_RECORD_LEN];
+  encode(id, record);
+  return write(slot, record);
+}
+
+void ANTPairingFile::clear( byte slot )
+{
+  byte record[ANT_PAIRING_RECORD_LEN] = {0};
+  write(slot, record);
+}
+#endif //defined(ANTPLUS_PAIRING_FILE)
@@ -0,0 +1,75 @@
+//Copyright 2013 Brody Kenrick.
+//Persisted pairing -- the device ID found by a wildcard search is saved so the next start opens the channel with that exact ID
+
+//Record (6 bytes per slot)
+// marker, device number LSB, device number MSB, device type, transmission type, XOR of the previous five
+
+#ifndef ANTPairing_h
+#define ANTPairing_h
+
+#include "ANTPlus.h"
+
+#define ANT_PAIRING_RECORD_LEN    (6)
+#define ANT_PAIRING_RECORD_MARKER (0xA5)
+
+//EEPROM on AVR, a file on Linux. Define either before including to force it.
+#if defined(__AVR__) && !defined(ANTPLUS_PAIRING_EEPROM)
+#define ANTPLUS_PAIRING_EEPROM
+#endif
+#if defined(__linux__) && !defined(ANTPLUS_PAIRING_FILE)
+#define ANTPLUS_PAIRING_FILE
+#endif
+
+
+//! Non-volatile store of paired device IDs. One slot per channel (see ANT_Channel::pairing_slot).
+class ANTPairingStore
+{
+  public:
+    //! False if nothing valid is stored in the slot
+    virtual boolean load( byte slot, ANT_DeviceId * id ) = 0;
+    virtual boolean save( byte slot, const ANT_DeviceId * id ) = 0;
+    virtual void    clear( byte slot ) = 0;
+
+  protected:
+    static void    encode( const ANT_DeviceId * id, byte record[ANT_PAIRING_RECORD_LEN] );
+    static boolean decode( const byte record[ANT_PAIRING_RECORD_LEN], ANT_DeviceId * id );
+};
+
+
+#if defined(ANTPLUS_PAIRING_EEPROM)
+//! Slots are stored from base_address up (ANT_PAIRING_RECORD_LEN bytes each). Unchanged bytes are not rewritten.
+class ANTPairingEEPROM : public ANTPairingStore
+{
+  public:
+    ANTPairingEEPROM( int base_address ) : base_address(base_address) {};
+
+    boolean load( byte slot, ANT_DeviceId * id );
+    boolean save( byte slot, const ANT_DeviceId * id );
+    void    clear( byte slot );
+
+  private:
+    int base_address;
+};
+#endif //defined(ANTPLUS_PAIRING_EEPROM)
+
+
+#if defined(ANTPLUS_PAIRING_FILE)
+//! Slots are records at slot * ANT_PAIRING_RECORD_LEN in the file. It is created on the first save.
+class ANTPairingFile : public ANTPairingStore
+{
+  public:
+    ANTPairingFile( const char * path ) : path(path) {};
+
+    boolean load( byte slot, ANT_DeviceId * id );
+    boolean save( byte slot, const ANT_DeviceId * id );
+    void    clear( byte slot );
+
+  private:
+    boolean write( byte slot, const byte record[ANT_PAIRING_RECORD_LEN] );
+
+  private:
+    const char * path;
+};
+#endif //defined(ANTPLUS_PAIRING_FILE)
+
+#endif //ANTPairing_h
@@ -5,11 +5,17 @@
 #include <assert.h>
 
 #include "ANTPlus.h"
+#include "ANTProfile.h"
+#include "ANTPairing.h"
+#if defined(ANTPLUS_CAPTURE)
+#include "ANTCapture.h"
+#endif
 
 
 #if defined(ANTPLUS_DEBUG)
-#define ANTPLUS_DEBUG_PRINT(x)  	        (Serial.print(x))
-#define ANTPLUS_DEBUG_PRINTLN(x)	        (Serial.println(x))
+//Only for string literals -- the pointer is kept and printed later by flushDebug()
+#define ANTPLUS_DEBUG_PRINT(x)  	        (logDebugText(ANT_DEBUG_RECORD_TEXT, x))
+#define ANTPLUS_DEBUG_PRINTLN(x)	        (logDebugText(ANT_DEBUG_RECORD_TEXT_LN, x))
 #else
 #define ANTPLUS_DEBUG_PRINT(x)  	        
 #define ANTPLUS_DEBUG_PRINTLN(x)	        
@@ -22,19 +28,53 @@ ANTPlus::ANTPlus(
         byte SLEEP_PIN,
         byte RESET_PIN
 )
+#if defined(ANTPLUS_DEBUG)
+  : debug_log(debug_buffer, ANTPLUS_DEBUG_BUFFER_SIZE)
+#endif
 {
     this->RTS_PIN = RTS_PIN;
     this->SUSPEND_PIN = SUSPEND_PIN;
     this->SLEEP_PIN = SLEEP_PIN;
     this->RESET_PIN = RESET_PIN;
     
-    hw_reset_count = 0;
+    resetStats();
+    response_timed = false;
+#if defined(ANTPLUS_DEBUG)
+    debug_tx_logging = false;
+#endif
+    rxIdle = true;
+    reset_state = ANT_RESET_DONE;
+    reset_reason = ANT_RESET_REASON_UNKNOWN;
+    reset_ms = begin_ms = 0;
+    memset(&boot_timing, 0, sizeof(boot_timing));
+    power_state = ANT_POWER_AWAKE;
+    power_state_ms = 0;
+    setBaudRate(ANT_BAUD_RATE_DEFAULT);
+    capabilities_valid = false;
+    memset(channels, 0, sizeof(channels));
+    rts_isr_slot = ANTPLUS_MAX_INSTANCES;
+    rts_high_seen = false;
+    last_rx_ms = last_rts_ms = last_response_ms = stall_ref_ms = 0;
+    recovery_stage = ANT_RECOVERY_NONE;
+    msgSent = MESG_INVALID_ID;
+    response_channel = NULL;
+    tx_keep = false;
+    last_tx_len = 0;
+    rxBufCnt = 0;
+    rxChksum = 0;
+    read_budget = 0;
+    read_bytes = 0;
+#if defined(ANTPLUS_CAPTURE)
+    capture = NULL;
+#endif
 }
 
 
 void ANTPlus::begin(Stream &serial)
 {
   mySerial = &serial;
+  begin_ms = millis();
+  memset(&boot_timing, 0, sizeof(boot_timing));
 
   pinMode(SUSPEND_PIN, OUTPUT);
   pinMode(SLEEP_PIN,   OUTPUT);
@@ -46,32 +86,244 @@ void ANTPlus::begin(Stream &serial)
   digitalWrite(SUSPEND_PIN, HIGH);
   digitalWrite(SLEEP_PIN,   LOW);
   
-  //Interrupts are set in the main program currently
-  //TODO: Look to see if they should be brought 'in lib'
-  
+  attachRtsInterrupt();
   
   //This should not be strictly necessary - the device should always come up by itself....
   //But let's make sure we didn't miss the first RTS in a power-up race
+  //No waiting here -- channel setup starts once the startup message is in
   hardwareReset();
 }
 
+#if ANTPLUS_MAX_INSTANCES > 4
+#error "Only 4 RTS trampolines are provided"
+#endif
+
+ANTPLUS_THREAD_LOCAL ANTPlus * ANTPlus::rts_isr_instances[ANTPLUS_MAX_INSTANCES];
+
+#if defined(ANTPLUS_INTERRUPTS_DEPTH)
+volatile byte antplus_interrupts_depth = 0;
+#endif
+
+void ANTPlus::rts_isr( byte slot )
+{
+#if defined(ANTPLUS_INTERRUPTS_DEPTH)
+  antplus_interrupts_depth++;
+#endif
+  ANTPlus * antplus = rts_isr_instances[slot];
+  if(antplus)
+  {
+    antplus->handleRtsEdge(digitalRead(antplus->RTS_PIN) == HIGH);
+  }
+#if defined(ANTPLUS_INTERRUPTS_DEPTH)
+  antplus_interrupts_depth--;
+#endif
+}
+
+void ANTPlus::rts_isr_0() {rts_isr(0);}
+#if ANTPLUS_MAX_INSTANCES > 1
+void ANTPlus::rts_isr_1() {rts_isr(1);}
+#endif
+#if ANTPLUS_MAX_INSTANCES > 2
+void ANTPlus::rts_isr_2() {rts_isr(2);}
+#endif
+#if ANTPLUS_MAX_INSTANCES > 3
+void ANTPlus::rts_isr_3() {rts_isr(3);}
+#endif
+
+void ANTPlus::attachRtsInterrupt()
+{
+  if(rtsInterruptAttached())
+  {
+    return;
+  }
+  int interrupt = digitalPinToInterrupt(RTS_PIN);
+  if(interrupt == NOT_AN_INTERRUPT)
+  {
+    ANTPLUS_DEBUG_PRINTLN("RTS pin has no interrupt -- call rTSHighAssertion()");
+    return;
+  }
+
+  void (*trampoline)() = NULL;
+  for(byte slot = 0; (slot < ANTPLUS_MAX_INSTANCES) && !trampoline; slot++)
+  {
+    if(rts_isr_instances[slot] == NULL)
+    {
+      rts_isr_instances[slot] = this;
+      rts_isr_slot = slot;
+      switch(slot)
+      {
+        case 0: trampoline = rts_isr_0; break;
+#if ANTPLUS_MAX_INSTANCES > 1
+        case 1: trampoline = rts_isr_1; break;
+#endif
+#if ANTPLUS_MAX_INSTANCES > 2
+        case 2: trampoline = rts_isr_2; break;
+#endif
+#if ANTPLUS_MAX_INSTANCES > 3
+        case 3: trampoline = rts_isr_3; break;
+#endif
+      }
+    }
+  }
+  if(!trampoline)
+  {
+    ANTPLUS_DEBUG_PRINTLN("No free RTS interrupt slot (ANTPLUS_MAX_INSTANCES)");
+    return;
+  }
+  //Both edges -- busy on the rise, ready on the fall
+  attachInterrupt(interrupt, trampoline, CHANGE);
+}
+
+void ANTPlus::end()
+{
+  if(!rtsInterruptAttached())
+  {
+    return;
+  }
+  //Off before the slot is freed -- another instance could claim it while this pin still calls its trampoline
+  detachInterrupt(digitalPinToInterrupt(RTS_PIN));
+  rts_isr_instances[rts_isr_slot] = NULL;
+  rts_isr_slot = ANTPLUS_MAX_INSTANCES;
+}
+
+//Interrupt context -- no waiting
+void ANTPlus::handleRtsEdge( boolean rts_high )
+{
+  unsigned long now_us = micros();
+  if(rts_high)
+  {
+    rts_rise_us = now_us;
+    rts_high_seen = true;
+  }
+  else
+  {
+    //A pulse shorter than the interrupt latency reads low on the rising interrupt -- still ready
+    if(rts_high_seen)
+    {
+      unsigned long high_us = now_us - rts_rise_us;
+      if((stats.rts_high_count == 0) || (high_us < stats.rts_high_us_min))
+      {
+        stats.rts_high_us_min = high_us;
+      }
+      if(high_us > stats.rts_high_us_max)
+      {
+        stats.rts_high_us_max = high_us;
+      }
+      stats.rts_high_us_total += high_us;
+      stats.rts_high_count++;
+      rts_high_seen = false;
+    }
+    stats.rts_pulses++;
+    last_rts_ms = millis();
+    clear_to_send = true;
+  }
+#if defined(ANTPLUS_CAPTURE)
+  if(capture)
+  {
+    capture->rts(rts_high);
+  }
+#endif
+}
+
+void ANTPlus::begin(Stream &serial, unsigned long baud_rate)
+{
+  setBaudRate(baud_rate);
+  begin(serial);
+}
+
+void ANTPlus::setBaudRate(unsigned long baud_rate)
+{
+  this->baud_rate = baud_rate;
+  //10 bits per byte on the wire. Never below 2ms as millis() can tick over straight away.
+  unsigned long timeout = ((ANT_PACKET_READ_NEXT_BYTE_TIMEOUT_BYTES * 10UL * 1000UL) + baud_rate - 1) / baud_rate;
+  next_byte_timeout_ms = (timeout < 2) ? 2 : timeout;
+}
+
+//The rates selectable on the nRF24AP2 baud rate pins. Most likely first.
+static const unsigned long ant_baud_rates[] = {57600, 38400, 19200, ANT_BAUD_RATE_DEFAULT, 4800, 50000};
+
+unsigned long ANTPlus::beginAutoBaud(Stream &serial, ANT_SetBaudRate set_baud_rate)
+{
+  set_baud_rate(ANT_BAUD_RATE_DEFAULT);
+  begin(serial, ANT_BAUD_RATE_DEFAULT);
+  while(reset_state == ANT_RESET_ASSERTED)
+  {
+    //Probing blocks anyway -- the module has to be out of reset to answer
+    poll();
+  }
+
+  byte packet_buffer[ANT_MAX_PACKET_LEN];
+  ANT_Packet * packet = (ANT_Packet *) packet_buffer;
+
+  //The module ignores the UART until it has booted -- a probe sent before then is lost.
+  //Wait for the startup message (only readable at the default rate) or as long as a probe would.
+  unsigned long boot_ms = millis();
+  while((reset_state != ANT_RESET_DONE) && ((millis() - boot_ms) < ANT_BAUD_PROBE_TIMEOUT_MS))
+  {
+    readPacket(packet, ANT_MAX_PACKET_LEN, 0);
+  }
+
+  for(byte i = 0; i < (sizeof(ant_baud_rates) / sizeof(ant_baud_rates[0])); i++)
+  {
+    set_baud_rate(ant_baud_rates[i]);
+    setBaudRate(ant_baud_rates[i]);
+    while(mySerial->available() > 0)
+    {
+      mySerial->read();
+    }
+    rxBufCnt = 0;
+
+    //The module does not need an RTS before the first message -- force the request out
+    clear_to_send = true;
+    msgResponseExpected = MESG_INVALID_ID;
+    send(MESG_REQUEST_ID, MESG_CAPABILITIES_ID/*Expected response*/, 2, 0/*Channel number always 0*/, MESG_CAPABILITIES_ID);
+
+    unsigned long start_ms = millis();
+    while((millis() - start_ms) < ANT_BAUD_PROBE_TIMEOUT_MS)
+    {
+      //Garbage at the wrong rate shows up as sync/checksum errors -- keep reading
+      if(readPacket(packet, ANT_MAX_PACKET_LEN, 0) == MESSAGE_READ_EXPECTED)
+      {
+        //The module RTSes after each message -- that may have been missed while probing
+        clear_to_send = true;
+        //The startup message is only readable at the default rate -- an answer shows the module is up
+        reset_state = ANT_RESET_DONE;
+        return ant_baud_rates[i];
+      }
+    }
+  }
+
+  ANTPLUS_DEBUG_PRINTLN("No response at any baud rate");
+  set_baud_rate(ANT_BAUD_RATE_DEFAULT);
+  setBaudRate(ANT_BAUD_RATE_DEFAULT);
+  msgResponseExpected = MESG_INVALID_ID;
+  return 0;
+}
+
 
 void ANTPlus::hardwareReset()
 {
   ANTPLUS_DEBUG_PRINTLN("H/w Reset");
   
-  sleep(false);
+  digitalWrite(SUSPEND_PIN, HIGH);
+  digitalWrite(SLEEP_PIN,   LOW);
+  setPowerState(ANT_POWER_AWAKE);
   digitalWrite(RESET_PIN,   LOW);
-  delay(5);
-  //Reset all variables before we release the ANT
+  //Reset all variables before we release the ANT (poll() does that after ANT_RESET_PULSE_MS)
+  while(mySerial->available() > 0)
+  {
+    //Anything from before the reset is stale
+    mySerial->read();
+  }
   clear_to_send = false;
   msgResponseExpected = MESG_START_UP;
   rxBufCnt = 0;
-  rx_packet_count = 0;
-  tx_packet_count = 0;
-  hw_reset_count++;
-  delay(5);
-  digitalWrite(RESET_PIN,   HIGH);
+  response_timed = false;
+  last_tx_len = 0;
+  reset_ms = millis();
+  stall_ref_ms = reset_ms;
+  reset_state = ANT_RESET_ASSERTED;
+  stats.hw_resets++;
 }
 
 // Data <sync> <len> <msg id> <channel> <msg id being responded to> <msg code> <chksum>
@@ -82,22 +334,52 @@ void ANTPlus::hardwareReset()
 //readTimeoutMs -- is amount of time to wait for first byte to appeaer (can be 0)
 MESSAGE_READ ANTPlus::readPacketInternal( ANT_Packet * packet, int packetSize, unsigned int readTimeoutMs)
 {
+  ANTPLUS_PROFILE_SCOPE(ANT_PROFILE_READ_PACKET);
   unsigned char byteIn;
-  unsigned char chksum = 0;
   unsigned long timeoutExit = millis() + readTimeoutMs;
   
-  while (timeoutExit >= millis()) //First loop will go through always
+  //The time is only checked when the UART is empty -- buffered events from the module
+  // then come out back to back without a millis() per byte
+  while (true)
   {
+    if (read_budget && (read_bytes >= read_budget))
+    {
+      //Turn used up -- a frame cut short is finished on the next call (rxBuf and rxChksum are kept)
+      return MESSAGE_READ_NONE;
+    }
     //This is a busy read
-    if (mySerial->available() > 0)
+    if (mySerial->available() <= 0)
+    {
+      if (read_budget && (rxBufCnt != 0) && ((millis() - last_rx_ms) <= next_byte_timeout_ms))
+      {
+        //With a budget the rest of a frame is not waited for -- come back for it
+        return MESSAGE_READ_NONE;
+      }
+      //Not "<" -- a timeout of 0 would spin until the next millisecond
+      if ((long)(millis() - timeoutExit) >= 0)
+      {
+        break;
+      }
+    }
+    else
     {
+      ANTPLUS_PROFILE_SCOPE(ANT_PROFILE_FRAME_BYTE);
       byteIn = mySerial->read();
+      stats.rx_bytes++;
+      read_bytes++;
+      last_rx_ms = millis();
+#if defined(ANTPLUS_CAPTURE)
+      if(capture)
+      {
+        capture->rx(byteIn);
+      }
+#endif
       //We have a byte -- so we want to finish off this message (increase timeout)
-      timeoutExit += ANT_PACKET_READ_NEXT_BYTE_TIMEOUT_MS;
+      timeoutExit += next_byte_timeout_ms;
       if ((byteIn == MESG_TX_SYNC) && (rxBufCnt == 0))
       {
         rxBuf[rxBufCnt++] = byteIn;
-        chksum = byteIn;
+        rxChksum = byteIn;
       }
       else if ((rxBufCnt == 0) && (byteIn != MESG_TX_SYNC))
       {
@@ -105,39 +387,38 @@ MESSAGE_READ ANTPlus::readPacketInternal( ANT_Packet * packet, int packetSize, u
       }
       else if (rxBufCnt == 1)
       {
-        rxBuf[rxBufCnt++] = byteIn;       // second byte will be size
-        chksum ^= byteIn;
+        // second byte will be size -- checked before anything more is stored as a wrong baud rate
+        //  or a lost byte can give any value. The frame is sync, size, msg id, data and checksum.
+        if (((byteIn + 4) > packetSize) || ((byteIn + 4) > (int)sizeof(rxBuf)))
+        {
+          //Likely we are missing something....
+          //we reset our buffer count
+          rxBufCnt = 0;
+          return MESSAGE_READ_ERROR_PACKET_SIZE_EXCEEDED;
+        }
+        rxBuf[rxBufCnt++] = byteIn;
+        rxChksum ^= byteIn;
       }
       else if (rxBufCnt < rxBuf[1]+3)
       { // read rest of data taking into account sync, size, and checksum that are each 1 byte
         rxBuf[rxBufCnt++] = byteIn;
-        chksum ^= byteIn;
+        rxChksum ^= byteIn;
       }
       else
       {
         rxBuf[rxBufCnt++] = byteIn;
-        if (rxBufCnt > packetSize)
+        memcpy(packet, &rxBuf, rxBufCnt); // Should be a complete packet. copy data to packet variable, check checksum and return
+        stats.rx_packets++;
+        if (rxChksum != ANT_PACKET_CHECKSUM(packet))
         {
-          //Likely we are missing something....
-          //we reset our buffer count
           rxBufCnt = 0;
-          return MESSAGE_READ_ERROR_PACKET_SIZE_EXCEEDED;
+          return MESSAGE_READ_ERROR_BAD_CHECKSUM;
         }
         else
         {
-          memcpy(packet, &rxBuf, rxBufCnt); // Should be a complete packet. copy data to packet variable, check checksum and return
-          rx_packet_count++;
-          if (chksum != ANT_PACKET_CHECKSUM(packet))
-          {
-            rxBufCnt = 0;
-            return MESSAGE_READ_ERROR_BAD_CHECKSUM;
-          }
-          else
-          {
-            //Good packet
-            rxBufCnt = 0;
-            return MESSAGE_READ_INTERNAL;
-          }
+          //Good packet
+          rxBufCnt = 0;
+          return MESSAGE_READ_INTERNAL;
         }
       }
     }
@@ -158,10 +439,23 @@ MESSAGE_READ ANTPlus::readPacketInternal( ANT_Packet * packet, int packetSize, u
 unsigned char ANTPlus::writeByte(unsigned char out, unsigned char chksum)
 {
 #ifdef ANTPLUS_DEBUG
-  serial_print_byte_padded_hex(out);
-  Serial.print(" ");
+  if(debug_tx_logging)
+  {
+    debug_log.put(out);
+  }
 #endif
   mySerial->write(out);
+  stats.tx_bytes++;
+  if(tx_keep && (last_tx_len < ANT_HEALTH_LAST_TX_MAX))
+  {
+    last_tx[last_tx_len++] = out;
+  }
+#if defined(ANTPLUS_CAPTURE)
+  if(capture)
+  {
+    capture->tx(out);
+  }
+#endif
   chksum ^= out;
   return chksum;
 }
@@ -172,6 +466,7 @@ unsigned char ANTPlus::writeByte(unsigned char out, unsigned char chksum)
 // NOTE: This request/response check still has the potentioal for holes in it but it is sufficient for now
 boolean ANTPlus::send(unsigned msgId, unsigned msgId_ResponseExpected, unsigned char argCnt, ...)
 {
+  ANTPLUS_PROFILE_SCOPE(ANT_PROFILE_SEND);
   va_list arg;
   va_start (arg, argCnt);
   unsigned char byteOut;
@@ -180,26 +475,35 @@ boolean ANTPlus::send(unsigned msgId, unsigned msgId_ResponseExpected, unsigned
   
   boolean ret_val = false;
 
-  if(clear_to_send && (msgResponseExpected == MESG_INVALID_ID))
+  if(clear_to_send && (msgResponseExpected == MESG_INVALID_ID) && (power_state != ANT_POWER_SUSPEND))
   {
+      if(power_state == ANT_POWER_SLEEP)
+      {
+        sleep(false);
+      }
     #ifdef ANTPLUS_DEBUG
-      Serial.print("TX[");
-      serial_print_int_padded_dec( tx_packet_count, 6 );
-      Serial.print("] @ ");
-      serial_print_int_padded_dec( millis(), 8 );
-      Serial.print(" ms > ");
-    #if defined(ANTPLUS_MSG_STR_DECODE)
-      Serial.print( get_msg_id_str(msgId) );
-      Serial.print("[0x");
-      serial_print_byte_padded_hex(msgId);
-      Serial.print("]");
-    #else
-      Serial.print("0x");
-      serial_print_byte_padded_hex(msgId);
-    #endif //defined(ANTPLUS_MSG_STR_DECODE)
-      Serial.print(" - 0x");
+      //Header now, the frame bytes as they are written. Printed later by flushDebug().
+      debug_tx_logging = (debug_log.space() >= (unsigned int)(ANT_DEBUG_TX_HEADER_LEN + argCnt + 4));
+      if(debug_tx_logging)
+      {
+        debug_log.put(ANT_DEBUG_RECORD_TX);
+        putDebugLong(millis());
+        putDebugLong(stats.tx_packets);
+      }
+      else
+      {
+        stats.debug_dropped++;
+      }
     #endif
-      tx_packet_count++;
+      stats.tx_packets++;
+#if defined(ANTPLUS_STATS_MSG_ID)
+      countMsgId(stats.tx_msg_id, msgId);
+#endif
+      msgSent = msgId;
+      response_channel = NULL;
+      //Keep requests for ANT_RECOVERY_RESEND
+      last_tx_len = 0;
+      tx_keep = (msgId_ResponseExpected != MESG_INVALID_ID) && ((argCnt + 4) <= ANT_HEALTH_LAST_TX_MAX);
      
       chksum = writeByte(MESG_TX_SYNC, chksum); // send sync
       chksum = writeByte(argCnt, chksum);       // send length
@@ -214,21 +518,36 @@ boolean ANTPlus::send(unsigned msgId, unsigned msgId_ResponseExpected, unsigned
       va_end(arg);
        
       writeByte(chksum,chksum);                 // send checksum 
+      tx_keep = false;
       
       clear_to_send = false;
+      stall_ref_ms = millis();
       ret_val = true;
       
       //We are now waiting for this message (if it was not set as INVALID)
       //There are other functions that take care of the checks
       //and eventually will have timeouts... and possibly callbacks...
       msgResponseExpected = msgId_ResponseExpected;
+      response_timed = (msgId_ResponseExpected != MESG_INVALID_ID);
+      if(response_timed)
+      {
+        response_sent_us = micros();
+      }
 #ifdef ANTPLUS_DEBUG
-      Serial.println();
+      debug_tx_logging = false;
 #endif
     }
     else
     {
       //ANTPLUS_DEBUG_PRINTLN("Can't send -- not clear to send or awaiting a response");
+      if(msgResponseExpected != MESG_INVALID_ID)
+      {
+        stats.tx_refused_awaiting++;
+      }
+      else
+      {
+        stats.tx_refused_not_clear++;
+      }
       ret_val = false;
     }
 
@@ -242,15 +561,105 @@ boolean ANTPlus::send(unsigned msgId, unsigned msgId_ResponseExpected, unsigned
 MESSAGE_READ ANTPlus::readPacket( ANT_Packet * packet, int packetSize, int wait_timeout = 0 )
 {
     MESSAGE_READ ret_val = MESSAGE_READ_NONE;
+    boolean filtered;
+    read_bytes = 0;
+    do
     {
+        filtered = false;
         ret_val = readPacketInternal(packet, packetSize, wait_timeout);
         if (ret_val == MESSAGE_READ_INTERNAL)
         {
-            if( packet->msg_id == msgResponseExpected )
+            ANTPLUS_PROFILE_SCOPE(ANT_PROFILE_DISPATCH);
+#if defined(ANTPLUS_STATS_MSG_ID)
+            countMsgId(stats.rx_msg_id, packet->msg_id);
+#endif
+            if( packet->msg_id == MESG_CAPABILITIES_ID )
+            {
+                //Keep these for hasCapability() -- older modules send fewer bytes
+                byte len = (packet->length < ANT_CAPABILITIES_LEN) ? packet->length : ANT_CAPABILITIES_LEN;
+                memset(capabilities, 0, sizeof(capabilities));
+                memcpy(capabilities, packet->data, len);
+                capabilities_valid = true;
+            }
+            else
+            if( packet->msg_id == MESG_STARTUP_MESG_ID )
+            {
+                //After any reset (pin, command, suspend) -- not only the one being waited for
+                reset_reason = packet->data[0];
+                reset_state = ANT_RESET_DONE;
+                if(boot_timing.startup_ms == 0)
+                {
+                    boot_timing.startup_ms = millis() - begin_ms;
+                }
+            }
+            else
+            if( packet->msg_id == MESG_CHANNEL_ID_ID )
+            {
+                //<channel> <device number LSB> <device number MSB> <device type> <transmission type>
+                byte channel_number = packet->data[0] & CHANNEL_NUMBER_MASK;
+                ANT_Channel * channel = (channel_number < ANT_DEVICE_NUMBER_CHANNELS) ? channels[channel_number] : NULL;
+                if(channel && (channel->pairing_state == ANT_PAIRING_REQUESTED))
+                {
+                    ANT_DeviceId id;
+                    id.device_number     = packet->data[1] | (packet->data[2] << 8);
+                    id.device_type       = packet->data[3];
+                    id.transmission_type = packet->data[4];
+                    learnPairing(channel, &id);
+                }
+            }
+
+            //<channel> <msg id being responded to (1 for a channel event)> <msg code>
+            boolean is_response_event = (packet->msg_id == MESG_RESPONSE_EVENT_ID);
+            if( (packet->msg_id == msgResponseExpected) && (!is_response_event || (packet->data[1] == msgSent)) )
             {
                 //ANTPLUS_DEBUG_PRINTLN("Received expected message!");
                 msgResponseExpected = MESG_INVALID_ID; //Not waiting on anything anymore
                 ret_val = MESSAGE_READ_EXPECTED;
+                last_response_ms = millis();
+                if(is_response_event && response_channel)
+                {
+                    //Checked by the next progress_setup_channel() call
+                    response_channel->response_code = packet->data[2];
+                    if(packet->data[2] == RESPONSE_NO_ERROR)
+                    {
+                        response_channel->setup_retries = 0;
+                    }
+                    if((packet->data[2] == RESPONSE_NO_ERROR) && response_channel->id_list
+                       && ((msgSent == MESG_ID_LIST_ADD_ID) || (msgSent == MESG_ID_LIST_CONFIG_ID)))
+                    {
+                        //Only an accepted list message moves the list on -- a refused one is sent again
+                        ANT_IdList * list = response_channel->id_list;
+                        list->sync_step = (msgSent == MESG_ID_LIST_CONFIG_ID) ? ANT_ID_LIST_IN_SYNC : (list->sync_step + 1);
+                    }
+                    if((packet->data[2] == RESPONSE_NO_ERROR) && ((msgSent == MESG_OPEN_CHANNEL_ID) || (msgSent == MESG_OPEN_RX_SCAN_ID)))
+                    {
+                        response_channel->channel_state = ANT_CHANNEL_STATE_SEARCHING;
+                        if(boot_timing.first_open_ms == 0)
+                        {
+                            boot_timing.first_open_ms = millis() - begin_ms;
+                        }
+                    }
+                    response_channel = NULL;
+                }
+                if(response_timed)
+                {
+                    recordResponseLatency(micros() - response_sent_us);
+                    response_timed = false;
+                }
+            }
+            else
+            if( is_response_event && (packet->data[1] == MESG_EVENT_ID) )
+            {
+                handleChannelEvent(packet);
+                ret_val = MESSAGE_READ_OTHER;
+            }
+            else
+            if( !acceptDataPacket(packet) )
+            {
+                //Dropped before it reaches the caller -- read on
+                filtered = true;
+                wait_timeout = 0;
+                stats.rx_filtered++;
             }
             else
             {
@@ -258,80 +667,498 @@ MESSAGE_READ ANTPlus::readPacket( ANT_Packet * packet, int packetSize, int wait_
                 ret_val = MESSAGE_READ_OTHER;
             }
         }
+    } while(filtered);
+
+    switch(ret_val)
+    {
+      case MESSAGE_READ_ERROR_BAD_CHECKSUM:
+        stats.rx_bad_checksum++;
+        break;
+      case MESSAGE_READ_ERROR_MISSING_SYNC:
+        stats.rx_missing_sync++;
+        break;
+      case MESSAGE_READ_ERROR_PACKET_SIZE_EXCEEDED:
+        stats.rx_size_exceeded++;
+        break;
+      case MESSAGE_READ_INFO_TIMEOUT_MIDMESSAGE:
+        stats.rx_timeout_midmessage++;
+        break;
+      default:
+        break;
+    }
+
+    if((ret_val == MESSAGE_READ_NONE) && (mySerial->available() <= 0))
+    {
+      //Not when the read budget ran out with bytes still waiting -- the module is busy
+      rxIdle = true;
+      poll();
+#if defined(ANTPLUS_DEBUG_FLUSH_ON_IDLE)
+      //Nothing arriving -- the cheapest time to print
+      flushDebug(Serial);
+#endif
+    }
+    else
+    if(rxIdle && ((ret_val == MESSAGE_READ_EXPECTED) || (ret_val == MESSAGE_READ_OTHER)))
+    {
+      rxIdle = false;
+      stats.rx_wakeups++;
     }
     return ret_val; 
 }
 
+//! Channel events (EVENT_*) for registered channels. The packet is still passed on to the caller.
+void ANTPlus::handleChannelEvent( const ANT_Packet * packet )
+{
+    byte channel_number = packet->data[0] & CHANNEL_NUMBER_MASK;
+    if(channel_number >= ANT_DEVICE_NUMBER_CHANNELS)
+    {
+      return;
+    }
+    ANT_Channel * channel = channels[channel_number];
+    if(channel == NULL)
+    {
+      return;
+    }
 
+    switch(packet->data[2])
+    {
+      case EVENT_RX_FAIL:
+        channel->rx_fail_count++;
+        break;
 
+      case EVENT_RX_FAIL_GO_TO_SEARCH:
+        channel->drop_count++;
+        channel->channel_state = ANT_CHANNEL_STATE_DROPPED;
+        break;
 
+      case EVENT_RX_SEARCH_TIMEOUT:
+        //EVENT_CHANNEL_CLOSED follows
+        if(channel->paired_open)
+        {
+          //Paired device not around (new sensor?) -- go back to a wildcard search. The store is kept until one is found.
+          channel->pairing_state = ANT_PAIRING_EXPIRED;
+        }
+        else
+        if(channel->search_bin && (channel->search_bin < channel->proximity_widen_to) && (channel->search_bin < ANT_PROXIMITY_BIN_MAX))
+        {
+          //Nothing close enough -- look a little further out
+          channel->search_bin++;
+          channel->search_widened = true;
+        }
+        break;
 
-//TODO: Move these to progmem
-#ifdef ANTPLUS_MSG_STR_DECODE
-//! returns msg_id converted into a human readable string.
-const char * ANTPlus::get_msg_id_str(byte msg_id)
+      case EVENT_CHANNEL_CLOSED:
+        channel->channel_state = ANT_CHANNEL_STATE_CLOSED;
+        if(!channel->stay_closed && (channel->channel_establish == ANT_CHANNEL_ESTABLISH_COMPLETE))
+        {
+          //The configuration is kept by the module -- only the open is needed
+          channel->reopen_count++;
+          channel->state_counter = ANT_SETUP_STEP_OPEN;
+          if(channel->pairing_state == ANT_PAIRING_EXPIRED)
+          {
+            channel->state_counter = ANT_SETUP_STEP_CHANNEL_ID;
+          }
+          else
+          if(channel->search_widened)
+          {
+            channel->state_counter = ANT_SETUP_STEP_PROXIMITY;
+          }
+          channel->channel_establish = ANT_CHANNEL_ESTABLISH_PROGRESSING;
+        }
+        break;
+
+      default:
+        break;
+    }
+}
+
+//! Host side filtering of data messages for registered channels. Returns false to drop the packet.
+boolean ANTPlus::acceptDataPacket( const ANT_Packet * packet )
 {
-  switch (msg_id)
-  {
-      case MESG_RESPONSE_EVENT_ID:
-        return "RESPONSE_EVENT";
-      case MESG_CAPABILITIES_ID:
-        return "CAPABILITIES";
+    switch(packet->msg_id)
+    {
       case MESG_BROADCAST_DATA_ID:
-        return "BROADCAST_DATA";
-      case MESG_ASSIGN_CHANNEL_ID:
-        return "ASSIGN_CHANNEL";
-      case MESG_CHANNEL_MESG_PERIOD_ID:
-        return "CHANNEL_MESG_PERIOD";
-      case MESG_CHANNEL_SEARCH_TIMEOUT_ID:
-        return "CHANNEL_SEARCH_TIMEOUT";
-      case MESG_CHANNEL_RADIO_FREQ_ID:
-        return "CHANNEL_RADIO_FREQ";
-
-      case MESG_REQUEST_ID:
-        return "REQUEST";
-
-      case MESG_START_UP:
-        return "START_UP";
-
-      case MESG_NETWORK_KEY_ID:
-        return "NETWORK_KEY";
-      case MESG_SYSTEM_RESET_ID:
-        return "SYSTEM_RESET";
-      case MESG_OPEN_CHANNEL_ID:
-        return "OPEN_CHANNEL";
-      case MESG_CHANNEL_ID_ID:
-        return "CHANNEL_ID";
-
-	  case MESG_ACKNOWLEDGED_DATA_ID:
-        return "ACK_DATA";
-
+      case MESG_ACKNOWLEDGED_DATA_ID:
+      case MESG_BURST_DATA_ID:
+      case MESG_EXT_BROADCAST_DATA_ID:
+      case MESG_EXT_ACKNOWLEDGED_DATA_ID:
+      case MESG_EXT_BURST_DATA_ID:
+        break;
       default:
-        return "...";
+        return true;
+    }
+
+    byte channel_number = packet->data[0] & CHANNEL_NUMBER_MASK;
+    if(channel_number >= ANT_DEVICE_NUMBER_CHANNELS)
+    {
+      return true;
+    }
+    stats.rx_channel_data[channel_number]++;
+    ANT_Channel * channel = channels[channel_number];
+    if(channel == NULL)
+    {
+      return true;
+    }
+    unsigned long now_ms = millis();
+    channel->data_ms = now_ms;
+    if(channel->channel_state == ANT_CHANNEL_STATE_SEARCHING)
+    {
+      channel->acquire_ms = now_ms - channel->open_ms;
+      channel->acquired_bin = channel->search_bin;
+      channel->acquire_pending = false;
+    }
+    channel->channel_state = ANT_CHANNEL_STATE_TRACKING;
+    channel->data_rx = true;
+
+    ANT_DeviceId id;
+    if(channel->id_list && get_extended_device_id(packet, &id) && !id_list_accepts(channel->id_list, &id))
+    {
+      //Got past the radio (list not yet synced or not supported by the module)
+      channel->id_list->filtered_count++;
+      return false;
+    }
+
+    if(channel->pairing_state == ANT_PAIRING_STORED)
+    {
+      //Only the paired device can be received
+      channel->pairing_state = ANT_PAIRING_LEARNT;
+    }
+    else
+    if((channel->pairing_state == ANT_PAIRING_SEARCH) || (channel->pairing_state == ANT_PAIRING_EXPIRED))
+    {
+      if(get_extended_device_id(packet, &id))
+      {
+        learnPairing(channel, &id);
+      }
+      else
+      {
+        channel->pairing_state = ANT_PAIRING_REQUEST;
+      }
+    }
+
+#if defined(ANTPLUS_DUPLICATE_FILTER)
+    if(channel->duplicate_filter && (packet->msg_id != MESG_BURST_DATA_ID) && (packet->msg_id != MESG_EXT_BURST_DATA_ID))
+    {
+      //Legacy extended messages carry the device ID ahead of the payload
+      const byte * payload = &packet->data[MESG_CHANNEL_NUM_SIZE];
+      if((packet->msg_id == MESG_EXT_BROADCAST_DATA_ID) || (packet->msg_id == MESG_EXT_ACKNOWLEDGED_DATA_ID))
+      {
+        payload += ANT_EXT_MESG_DEVICE_ID_FIELD_SIZE;
+      }
+
+      //8 byte compare -- becomes a single word compare on 64 bit hosts
+      if(channel->last_payload_valid && (memcmp(channel->last_payload, payload, ANT_STANDARD_DATA_PAYLOAD_SIZE) == 0))
+      {
+        channel->duplicate_run++;
+        if((channel->duplicate_force_every == 0) || (channel->duplicate_run < channel->duplicate_force_every))
+        {
+          channel->duplicate_count++;
+          return false;
+        }
+        //Let every Nth repeat through so liveness tracking still sees the channel
+      }
+      memcpy(channel->last_payload, payload, ANT_STANDARD_DATA_PAYLOAD_SIZE);
+      channel->last_payload_valid = true;
+      channel->duplicate_run = 0;
+    }
+#endif //defined(ANTPLUS_DUPLICATE_FILTER)
 
-    } 
+    if(channel->id_list)
+    {
+      channel->id_list->delivered_count++;
+    }
+    return true;
 }
-#endif
 
 
-//NOTE: This function calls Serial.println directly
-void ANTPlus::serial_print_byte_padded_hex(byte value)
+
+void ANTPlus::recordResponseLatency( unsigned long latency_us )
 {
-    if(value <= 0x0F)
-  {
-      Serial.print(0, HEX);
-  }
-  Serial.print(value, HEX);
+    if((stats.response_count == 0) || (latency_us < stats.response_us_min))
+    {
+      stats.response_us_min = latency_us;
+    }
+    if(latency_us > stats.response_us_max)
+    {
+      stats.response_us_max = latency_us;
+    }
+    stats.response_us_total += latency_us;
+    stats.response_count++;
 }
 
-//NOTE: This function calls Serial.println directly
-void ANTPlus::serial_print_int_padded_dec(long int value, unsigned int width, boolean final_carriage_return)
+#if defined(ANTPLUS_STATS_MSG_ID)
+void ANTPlus::countMsgId( unsigned int * counts, byte msg_id )
 {
-  int div_num = value;
-  int div_cnt = 0;
-  while( div_num /= 10 )
-  {
-    div_cnt++;
+    byte index = msg_id - ANT_STATS_MSG_ID_FIRST;
+    if(index >= ANT_STATS_MSG_ID_COUNT)
+    {
+      index = ANT_STATS_MSG_ID_OTHER;
+    }
+    if(counts[index] != 0xFFFF)
+    {
+      counts[index]++;
+    }
+}
+#endif
+
+void ANTPlus::getStats( ANT_Stats * snapshot, boolean reset )
+{
+    unsigned long now_ms = millis();
+    setPowerState(power_state); //Brings the module sleep/suspend time up to now
+    ANTPLUS_ATOMIC_BLOCK
+    {
+      memcpy(snapshot, &stats, sizeof(stats));
+      if(reset)
+      {
+        memset(&stats, 0, sizeof(stats));
+        stats.since_ms = now_ms;
+      }
+    }
+    snapshot->snapshot_ms = now_ms;
+}
+
+void ANTPlus::resetStats()
+{
+    ANTPLUS_ATOMIC_BLOCK
+    {
+      memset(&stats, 0, sizeof(stats));
+      stats.since_ms = millis();
+    }
+}
+
+float ANTPlus::awake_fraction( const ANT_Stats * stats )
+{
+    unsigned long elapsed_ms = stats->snapshot_ms - stats->since_ms;
+    if((elapsed_ms == 0) || (stats->host_idle_ms >= elapsed_ms))
+    {
+      return (elapsed_ms == 0) ? 1.0 : 0.0;
+    }
+    return 1.0 - ((float)stats->host_idle_ms / elapsed_ms);
+}
+
+unsigned long ANTPlus::stats_per_minute( const ANT_Stats * stats, unsigned long count )
+{
+    unsigned long elapsed_ms = stats->snapshot_ms - stats->since_ms;
+    if(elapsed_ms == 0)
+    {
+      return 0;
+    }
+    //Float -- count * 60000 overflows 32 bits within a day of broadcasts
+    return (unsigned long)(((float)count * 60000.0) / elapsed_ms);
+}
+
+
+#ifdef ANTPLUS_MSG_STR_DECODE
+#include "antnames.h"
+
+//! Binary search of a sorted flash table of codes. Returns the index or -1.
+static int ant_name_find( const byte * codes, byte count, byte code )
+{
+  byte low = 0;
+  byte high = count;
+  while(low < high)
+  {
+    byte mid = (low + high) / 2;
+    byte value = pgm_read_byte(&codes[mid]);
+    if(value == code)
+    {
+      return mid;
+    }
+    if(value < code)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  return -1;
+}
+
+//! returns msg_id converted into a human readable string (in flash).
+const __FlashStringHelper * ANTPlus::get_msg_id_str(byte msg_id)
+{
+  int index = ant_name_find(ant_msg_name_codes, ANT_MSG_NAME_COUNT, msg_id);
+  if(index < 0)
+  {
+    return F("...");
+  }
+  return (const __FlashStringHelper *) &ant_msg_name_text[pgm_read_word(&ant_msg_name_offsets[index])];
+}
+
+//! returns a response or event code (MESG_RESPONSE_EVENT_ID) converted into a human readable string (in flash).
+const __FlashStringHelper * ANTPlus::get_response_code_str(byte code)
+{
+  int index = ant_name_find(ant_response_name_codes, ANT_RESPONSE_NAME_COUNT, code);
+  if(index < 0)
+  {
+    return F("...");
+  }
+  return (const __FlashStringHelper *) &ant_response_name_text[pgm_read_word(&ant_response_name_offsets[index])];
+}
+#endif
+
+
+#if defined(ANTPLUS_DEBUG)
+void ANTPlus::putDebugLong( unsigned long value )
+{
+  for(byte i = 0; i < 4; i++)
+  {
+    debug_log.put((byte)(value >> (8 * i)));
+  }
+}
+
+unsigned long ANTPlus::getDebugLong()
+{
+  unsigned long value = 0;
+  for(byte i = 0; i < 4; i++)
+  {
+    value |= ((unsigned long)(byte)debug_log.get()) << (8 * i);
+  }
+  return value;
+}
+
+void ANTPlus::logDebugText( byte type, const char * text )
+{
+  if(debug_log.space() < (1 + sizeof(text)))
+  {
+    stats.debug_dropped++;
+    return;
+  }
+  debug_log.put(type);
+  for(byte i = 0; i < sizeof(text); i++)
+  {
+    debug_log.put(((const byte *)&text)[i]);
+  }
+}
+
+void ANTPlus::flushDebug( Print & out, boolean raw )
+{
+  int type;
+  while((type = debug_log.get()) >= 0)
+  {
+    if((type == ANT_DEBUG_RECORD_TEXT) || (type == ANT_DEBUG_RECORD_TEXT_LN))
+    {
+      const char * text;
+      for(byte i = 0; i < sizeof(text); i++)
+      {
+        ((byte *)&text)[i] = debug_log.get();
+      }
+      if(raw)
+      {
+        //The host has no use for the pointer -- send the characters
+        byte len = strlen(text);
+        out.write((uint8_t)type);
+        out.write((uint8_t)len);
+        out.write((const uint8_t *)text, len);
+      }
+      else
+      if(type == ANT_DEBUG_RECORD_TEXT_LN)
+      {
+        out.println(text);
+      }
+      else
+      {
+        out.print(text);
+      }
+    }
+    else
+    if(type == ANT_DEBUG_RECORD_TX)
+    {
+      unsigned long time_ms = getDebugLong();
+      unsigned long tx_index = getDebugLong();
+      byte sync = debug_log.get();
+      byte len = debug_log.get();
+      byte msg_id = debug_log.peek();
+      if(raw)
+      {
+        out.write((uint8_t)type);
+        for(byte i = 0; i < 4; i++)
+        {
+          out.write((uint8_t)(time_ms >> (8 * i)));
+        }
+        for(byte i = 0; i < 4; i++)
+        {
+          out.write((uint8_t)(tx_index >> (8 * i)));
+        }
+        out.write(sync);
+        out.write(len);
+      }
+      else
+      {
+        out.print("TX[");
+        print_int_padded_dec( out, tx_index, 6 );
+        out.print("] @ ");
+        print_int_padded_dec( out, time_ms, 8 );
+        out.print(" ms > ");
+      #if defined(ANTPLUS_MSG_STR_DECODE)
+        out.print( get_msg_id_str(msg_id) );
+        out.print("[0x");
+        print_byte_padded_hex(out, msg_id);
+        out.print("]");
+      #else
+        out.print("0x");
+        print_byte_padded_hex(out, msg_id);
+      #endif //defined(ANTPLUS_MSG_STR_DECODE)
+        out.print(" - 0x");
+        print_byte_padded_hex(out, sync);
+        out.print(" ");
+        print_byte_padded_hex(out, len);
+        out.print(" ");
+      }
+      //msg id, data and checksum
+      for(int i = 0; i < (len + 2); i++)
+      {
+        byte value = debug_log.get();
+        if(raw)
+        {
+          out.write(value);
+        }
+        else
+        {
+          print_byte_padded_hex(out, value);
+          out.print(" ");
+        }
+      }
+      if(!raw)
+      {
+        out.println();
+      }
+    }
+  }
+}
+#endif //defined(ANTPLUS_DEBUG)
+
+
+//NOTE: This function calls Serial.println directly
+void ANTPlus::serial_print_byte_padded_hex(byte value)
+{
+  print_byte_padded_hex(Serial, value);
+}
+
+//NOTE: This function calls Serial.println directly
+void ANTPlus::serial_print_int_padded_dec(long int value, unsigned int width, boolean final_carriage_return)
+{
+  print_int_padded_dec(Serial, value, width, final_carriage_return);
+}
+
+void ANTPlus::print_byte_padded_hex(Print & out, byte value)
+{
+    if(value <= 0x0F)
+  {
+      out.print(0, HEX);
+  }
+  out.print(value, HEX);
+}
+
+void ANTPlus::print_int_padded_dec(Print & out, long int value, unsigned int width, boolean final_carriage_return)
+{
+  int div_num = value;
+  int div_cnt = 0;
+  while( div_num /= 10 )
+  {
+    div_cnt++;
   }
   if(div_cnt < width)
   {
@@ -343,15 +1170,15 @@ void ANTPlus::serial_print_int_padded_dec(long int value, unsigned int width, bo
   }
   while( div_cnt-- )
   {
-    Serial.print("0");
+    out.print("0");
   }
   if(final_carriage_return)
   {
-    Serial.println(value);
+    out.println(value);
   }
   else
   {
-    Serial.print(value);
+    out.print(value);
   }
 }
 
@@ -361,7 +1188,7 @@ void ANTPlus::serial_print_int_padded_dec(long int value, unsigned int width, bo
 void ANTPlus::printPacket(const ANT_Packet * packet, boolean final_carriage_return = true)
 {
   Serial.print("RX[");
-  serial_print_int_padded_dec( rx_packet_count, 6, false );
+  serial_print_int_padded_dec( stats.rx_packets, 6, false );
   Serial.print("] @ ");
   serial_print_int_padded_dec( millis(), 8, false );
   Serial.print(" ms > ");
@@ -389,6 +1216,20 @@ void ANTPlus::printPacket(const ANT_Packet * packet, boolean final_carriage_retu
     Serial.print  (" ");
     cnt++;
   }
+#if defined(ANTPLUS_MSG_STR_DECODE)
+  //<channel> <msg id being responded to (1 for an event)> <msg code>
+  if((packet->msg_id == MESG_RESPONSE_EVENT_ID) && (packet->length >= 3))
+  {
+    Serial.print("(");
+    if(packet->data[1] != MESG_EVENT_ID)
+    {
+      Serial.print( get_msg_id_str(packet->data[1]) );
+      Serial.print(" ");
+    }
+    Serial.print( get_response_code_str(packet->data[2]) );
+    Serial.print(")");
+  }
+#endif //defined(ANTPLUS_MSG_STR_DECODE)
   if(final_carriage_return)
   {
     Serial.println("");
@@ -404,22 +1245,80 @@ void ANTPlus::printPacket(const ANT_Packet * packet, boolean final_carriage_retu
 //Must not be called with the same channel after it returns ESTABLISHED as that will attempt to reopen....
 ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channel( ANT_Channel * channel )
 {
+  ANTPLUS_PROFILE_SCOPE(ANT_PROFILE_SETUP_CHANNEL);
   boolean sent_ok = true; //Defaults as true as we want to progress the state counter
+  boolean hold_step = false; //Set for steps that take more than one message
+  unsigned long tx_packets_before = stats.tx_packets;
   
   ANT_CHANNEL_ESTABLISH ret_val = ANT_CHANNEL_ESTABLISH_PROGRESSING;
 
-  if(channel->state_counter == 0)
+  if(!awaitingResponseLastSent() && (channel->response_code != RESPONSE_NO_ERROR)
+     && (channel->sent_step >= ANT_SETUP_STEP_LP_SEARCH_TIMEOUT) && (channel->sent_step <= ANT_SETUP_STEP_RSSI_THRESHOLD))
+  {
+    //Search tuning only -- the channel still works with the module's defaults
+    ANTPLUS_DEBUG_PRINTLN("Search setting refused.");
+    channel->response_code = RESPONSE_NO_ERROR;
+  }
+
+  if(!awaitingResponseLastSent() && (channel->response_code != RESPONSE_NO_ERROR))
+  {
+    //The last step was refused by the module -- send it again
+    channel->response_code = RESPONSE_NO_ERROR;
+    if(channel->setup_retries >= ANT_SETUP_STEP_RETRIES)
+    {
+      ANTPLUS_DEBUG_PRINTLN("Setup step failed.");
+      channel->setup_retries = 0;
+      channel->channel_establish = ANT_CHANNEL_ESTABLISH_ERROR;
+      return ANT_CHANNEL_ESTABLISH_ERROR;
+    }
+    channel->setup_retries++;
+    channel->state_counter = channel->sent_step;
+  }
+
+  if(channel->state_counter == ANT_SETUP_STEP_BEGIN)
   {
     //ANTPLUS_DEBUG_PRINTLN("progress_setup_channel() - Begin");  
+    if(channel->channel_number < ANT_DEVICE_NUMBER_CHANNELS)
+    {
+      channels[channel->channel_number] = channel;
+    }
+    channel->channel_state = ANT_CHANNEL_STATE_CLOSED;
+    channel->response_code = RESPONSE_NO_ERROR;
+    channel->setup_retries = 0;
+    channel->search_bin = channel->proximity_bin;
+    channel->search_widened = false;
+    channel->acquire_pending = false;
+#if defined(ANTPLUS_DUPLICATE_FILTER)
+    channel->last_payload_valid = false;
+#endif
+    if(channel->pairing && (channel->device_number_MSB == 0) && (channel->device_number_LSB == 0))
+    {
+      if(channel->pairing_state == ANT_PAIRING_NONE)
+      {
+        channel->pairing_state = channel->pairing->load(channel->pairing_slot, &channel->paired_id) ? ANT_PAIRING_STORED : ANT_PAIRING_SEARCH;
+      }
+      else
+      if((channel->pairing_state == ANT_PAIRING_REQUEST) || (channel->pairing_state == ANT_PAIRING_REQUESTED))
+      {
+        //Set up again after a reset -- learn from the next data
+        channel->pairing_state = ANT_PAIRING_SEARCH;
+      }
+    }
+    if(channel->scan_mode && (channel->channel_number != 0))
+    {
+      //Scan mode takes over the whole radio and is always configured on channel 0
+      channel->channel_establish = ANT_CHANNEL_ESTABLISH_ERROR;
+      return ANT_CHANNEL_ESTABLISH_ERROR;
+    }
   }
   else
-  if(channel->state_counter == 1)
+  if(channel->state_counter == ANT_SETUP_STEP_REQUEST_CAPABILITIES)
   {
     //Request CAPs
     sent_ok = send(MESG_REQUEST_ID, MESG_CAPABILITIES_ID/*Expected response*/, 2, 0/*Channel number always 0*/, MESG_CAPABILITIES_ID);
   }
   else
-  if(channel->state_counter == 2)
+  if(channel->state_counter == ANT_SETUP_STEP_ASSIGN_CHANNEL)
   {
    // Assign Channel
     //   Channel: 0
@@ -428,7 +1327,7 @@ ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channel( ANT_Channel * channel )
     sent_ok = send(MESG_ASSIGN_CHANNEL_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 3, channel->channel_number, channel->channel_type, channel->network_number); 
   }
   else
-  if(channel->state_counter == 3)
+  if(channel->state_counter == ANT_SETUP_STEP_CHANNEL_ID)
   {
  
     // Set Channel ID
@@ -437,10 +1336,19 @@ ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channel( ANT_Channel * channel )
     //   Device Number MSB: 0 for a slave to match any device
     //   Device Type: bit 7 0 for pairing request bit 6..0 for device type
     //   Transmission Type: 0 to match any transmission type
-    sent_ok = send(MESG_CHANNEL_ID_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 5, channel->channel_number, channel->device_number_MSB, channel->device_number_LSB, channel->device_type, 0);
+    channel->paired_open = (channel->pairing_state == ANT_PAIRING_STORED) || (channel->pairing_state == ANT_PAIRING_LEARNT);
+    if(channel->paired_open)
+    {
+      const ANT_DeviceId * id = &channel->paired_id;
+      sent_ok = send(MESG_CHANNEL_ID_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 5, channel->channel_number, (id->device_number & 0x00FF), ((id->device_number & 0xFF00) >> 8), id->device_type, id->transmission_type);
+    }
+    else
+    {
+      sent_ok = send(MESG_CHANNEL_ID_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 5, channel->channel_number, channel->device_number_LSB, channel->device_number_MSB, channel->device_type, 0);
+    }
   }
   else
-  if(channel->state_counter == 4)
+  if(channel->state_counter == ANT_SETUP_STEP_NETWORK_KEY)
   {
     // Set Network Key
     //   Network Number
@@ -448,7 +1356,7 @@ ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channel( ANT_Channel * channel )
     sent_ok = send(MESG_NETWORK_KEY_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 9, channel->network_number, channel->ant_net_key[0], channel->ant_net_key[1], channel->ant_net_key[2], channel->ant_net_key[3], channel->ant_net_key[4], channel->ant_net_key[5], channel->ant_net_key[6], channel->ant_net_key[7]);
   }
   else
-  if(channel->state_counter == 5)
+  if(channel->state_counter == ANT_SETUP_STEP_SEARCH_TIMEOUT)
   {
     // Set Channel Search Timeout
     //   Channel
@@ -456,7 +1364,102 @@ ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channel( ANT_Channel * channel )
     sent_ok = send(MESG_CHANNEL_SEARCH_TIMEOUT_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, channel->channel_number, channel->timeout);
   }
   else
-  if(channel->state_counter == 6)
+  if(channel->state_counter == ANT_SETUP_STEP_LP_SEARCH_TIMEOUT)
+  {
+    if(channel->lp_search_timeout != 0)
+    {
+      if(hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS, CAPABILITIES_LOW_PRIORITY_SEARCH_ENABLED))
+      {
+        // Set Low Priority Search Timeout
+        //   Channel
+        //   Timeout: 2.5 sec increments. 0 for no low priority search, 255 for no timeout
+        byte lp_timeout = (channel->lp_search_timeout == ANT_LP_SEARCH_OFF) ? 0 : channel->lp_search_timeout;
+        sent_ok = send(MESG_SET_LP_SEARCH_TIMEOUT_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, channel->channel_number, lp_timeout);
+      }
+      else
+      {
+        //Tuning only -- the channel still works with the module's search
+        ANTPLUS_DEBUG_PRINTLN("No low priority search on this module.");
+      }
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_HIGH_DUTY_SEARCH)
+  {
+    if(channel->high_duty_search)
+    {
+      if(hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS_3, CAPABILITIES_HIGH_DUTY_SEARCH_MODE_ENABLED))
+      {
+        //Module wide -- the suppression cycle is left at the module default
+        sent_ok = send(MESG_HIGH_DUTY_SEARCH_MODE_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, 0/*Filler*/, 1/*Enable*/);
+      }
+      else
+      {
+        ANTPLUS_DEBUG_PRINTLN("No high duty search on this module.");
+      }
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_PROXIMITY)
+  {
+    if((channel->search_bin != 0) && !channel->paired_open)
+    {
+      if(hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS_2, CAPABILITIES_PROX_SEARCH_ENABLED))
+      {
+        // Set Proximity Search
+        //   Channel
+        //   Search threshold bin: 1 (nearest) .. 10
+        byte bin = (channel->search_bin > ANT_PROXIMITY_BIN_MAX) ? ANT_PROXIMITY_BIN_MAX : channel->search_bin;
+        sent_ok = send(MESG_PROX_SEARCH_CONFIG_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, channel->channel_number, bin);
+      }
+      else
+      {
+        ANTPLUS_DEBUG_PRINTLN("No proximity search on this module.");
+      }
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_SEARCH_PRIORITY)
+  {
+    if(channel->search_priority != 0)
+    {
+      // Set Search Channel Priority
+      //   Channel
+      //   Priority: higher is searched first
+      sent_ok = send(MESG_SET_SEARCH_CH_PRIORITY_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, channel->channel_number, channel->search_priority);
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_SEARCH_SHARING)
+  {
+    if(channel->search_sharing_cycles != 0)
+    {
+      if(hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS_3, CAPABILITIES_ACTIVE_SEARCH_SHARING_MODE_ENABLED))
+      {
+        // Set Active Search Sharing
+        //   Channel
+        //   Cycles: search periods before passing the search on. 0 to disable
+        sent_ok = send(MESG_ACTIVE_SEARCH_SHARING_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, channel->channel_number, channel->search_sharing_cycles);
+      }
+      else
+      {
+        ANTPLUS_DEBUG_PRINTLN("No search sharing on this module.");
+      }
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_RSSI_THRESHOLD)
+  {
+    if(channel->rssi_threshold != 0)
+    {
+      // Set RSSI Search Threshold
+      //   Channel
+      //   Threshold: dBm (-128..-1). 0 to disable
+      sent_ok = send(MESG_RSSI_SEARCH_THRESHOLD_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, channel->channel_number, (byte)channel->rssi_threshold);
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_RADIO_FREQ)
   {
     //ANT_send(1+2, MESG_CHANNEL_RADIO_FREQ_ID, CHAN0, FREQ);
     // Set Channel RF Frequency
@@ -465,19 +1468,63 @@ ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channel( ANT_Channel * channel )
     sent_ok = send(MESG_CHANNEL_RADIO_FREQ_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, channel->channel_number, channel->freq);
   }
   else
-  if(channel->state_counter == 7)
+  if(channel->state_counter == ANT_SETUP_STEP_PERIOD)
   {
     // Set Channel Period
     sent_ok = send(MESG_CHANNEL_MESG_PERIOD_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 3, channel->channel_number, (channel->period & 0x00FF), ((channel->period & 0xFF00) >> 8));
   }
   else
-  if(channel->state_counter == 8)
+  if(channel->state_counter == ANT_SETUP_STEP_LIB_CONFIG)
+  {
+    if(channel->scan_mode)
+    {
+      //The capabilities have been received by now (they were an expected response)
+      if(!hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS_2, CAPABILITIES_SCAN_MODE_ENABLED))
+      {
+        ANTPLUS_DEBUG_PRINTLN("Scan mode not supported by this module.");
+        channel->channel_establish = ANT_CHANNEL_ESTABLISH_ERROR;
+        return ANT_CHANNEL_ESTABLISH_ERROR;
+      }
+      //Flag every received data message with the device ID of the sender
+      sent_ok = send(MESG_ANTLIB_CONFIG_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 2, 0/*Filler*/, ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID);
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_ID_LIST)
+  {
+    if(channel->id_list && (channel->id_list->sync_step != ANT_ID_LIST_IN_SYNC))
+    {
+      //Stays on this step until every list message has been sent
+      sent_ok = sendNextIdListMessage(channel);
+      hold_step = true;
+    }
+  }
+  else
+  if(channel->state_counter == ANT_SETUP_STEP_OPEN)
   {
-    //Open Channel
-    sent_ok = send(MESG_OPEN_CHANNEL_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 1, channel->channel_number);
+    if(channel->scan_mode)
+    {
+      //Open Rx Scan Mode
+      sent_ok = send(MESG_OPEN_RX_SCAN_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 1, 0/*Filler*/);
+    }
+    else
+    {
+      //Open Channel
+      sent_ok = send(MESG_OPEN_CHANNEL_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 1, channel->channel_number);
+    }
+    if(sent_ok)
+    {
+      if(!channel->acquire_pending)
+      {
+        channel->open_ms = millis();
+        channel->acquire_pending = true;
+      }
+      channel->search_widened = false;
+      channel->acquire_ms = 0;
+    }
   }
   else
-  if(channel->state_counter == 9)
+  if(channel->state_counter == ANT_SETUP_STEP_AWAIT_OPEN)
   {
     //Check if the last message has been responded to
     if(!awaitingResponseLastSent())
@@ -494,68 +1541,610 @@ ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channel( ANT_Channel * channel )
   
   if(sent_ok)
   {
-    channel->state_counter++;
-  }
-  else
-  {
-    //Not always an error - as sometimes there are messages in the queue that are awaiting a response
-    //ANTPLUS_DEBUG_PRINTLN("Issue sending....");
+    if((stats.tx_packets != tx_packets_before) && (msgResponseExpected == MESG_RESPONSE_EVENT_ID))
     {
-        if( digitalRead(RTS_PIN) == LOW)
-        {
-          static unsigned int sending_issue_counter = 0;
-          sending_issue_counter++;
-          
-          //This should clear on the next loop ( this should be after ANT asserts -- but could conceivably be before it has even responded)
-          // The ISR sets a loop flag and the ISR should be triggered within 50 usecs
-          if(sending_issue_counter >= 50)
-          {
-            //Seems like we missed an RTS assertion.....
-            ANTPLUS_DEBUG_PRINTLN( "Missed an RTS or none was executed by ANT. Restarting...." );
-            sending_issue_counter = 0;
-            hardwareReset();
-            
-            ret_val = ANT_CHANNEL_ESTABLISH_ERROR;
-          }
-        }
+      //This step sent a message -- its response code comes back to this channel
+      response_channel = channel;
+      channel->sent_step = channel->state_counter;
+    }
+    if(!hold_step)
+    {
+      channel->state_counter++;
     }
   }
+  //Not sending is not always an error - as sometimes there are messages in the queue that are awaiting a response
+  //A missed RTS or a lost response is recovered by poll() (it restarts the channel setup if it has to reset)
   
   channel->channel_establish = ret_val;
   
   return ret_val;
 }
 
+ANT_CHANNEL_ESTABLISH ANTPlus::progress_setup_channels( ANT_Channel ** channel_list, byte count )
+{
+  ANT_CHANNEL_ESTABLISH ret_val = ANT_CHANNEL_ESTABLISH_COMPLETE;
+  boolean hold_open = false;
+  unsigned int visited = 0;
+  unsigned long now_ms = millis();
+
+  if(count > ANT_DEVICE_NUMBER_CHANNELS)
+  {
+    count = ANT_DEVICE_NUMBER_CHANNELS;
+  }
+
+  for(byte n = 0; n < count; n++)
+  {
+    //Highest priority not yet visited (list order for a tie) -- only a handful of channels so no sort
+    byte next = 0;
+    boolean found = false;
+    for(byte i = 0; i < count; i++)
+    {
+      if(!(visited & (1 << i)) && (!found || (channel_list[i]->search_priority > channel_list[next]->search_priority)))
+      {
+        next = i;
+        found = true;
+      }
+    }
+    visited |= (1 << next);
+    ANT_Channel * channel = channel_list[next];
+
+    if(channel->channel_establish == ANT_CHANNEL_ESTABLISH_ERROR)
+    {
+      ret_val = ANT_CHANNEL_ESTABLISH_ERROR;
+      continue;
+    }
+    if(channel->channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+    {
+      //Searches compete for the radio -- give the earlier one a head start
+      if(!(hold_open && (channel->state_counter == ANT_SETUP_STEP_OPEN)))
+      {
+        progress_setup_channel(channel);
+      }
+      if(channel->channel_establish == ANT_CHANNEL_ESTABLISH_ERROR)
+      {
+        ret_val = ANT_CHANNEL_ESTABLISH_ERROR;
+      }
+      else
+      if((channel->channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE) && (ret_val == ANT_CHANNEL_ESTABLISH_COMPLETE))
+      {
+        ret_val = ANT_CHANNEL_ESTABLISH_PROGRESSING;
+      }
+    }
+    if((channel->channel_state == ANT_CHANNEL_STATE_SEARCHING) && ((now_ms - channel->open_ms) < ANT_OPEN_STAGGER_MS))
+    {
+      hold_open = true;
+    }
+  }
+  return ret_val;
+}
+
+//! Add a device to the host copy of a list. False if it is full. Re-sent to the module by progress_sync_id_list().
+boolean ANTPlus::id_list_add( ANT_IdList * list, const ANT_DeviceId * id )
+{
+  if(list->size >= ANT_ID_LIST_MAX_SIZE)
+  {
+    return false;
+  }
+  list->ids[list->size++] = *id;
+  list->sync_step = 0;
+  return true;
+}
+
+boolean ANTPlus::id_list_remove( ANT_IdList * list, const ANT_DeviceId * id )
+{
+  for(byte i = 0; i < list->size; i++)
+  {
+    if((list->ids[i].device_number == id->device_number)
+        && (list->ids[i].device_type == id->device_type)
+        && (list->ids[i].transmission_type == id->transmission_type))
+    {
+      list->size--;
+      memmove(&list->ids[i], &list->ids[i+1], (list->size - i) * sizeof(ANT_DeviceId));
+      list->sync_step = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ANTPlus::id_list_clear( ANT_IdList * list )
+{
+  list->size = 0;
+  list->sync_step = 0;
+}
+
+void ANTPlus::id_list_set_exclude( ANT_IdList * list, boolean exclude )
+{
+  list->exclude = exclude;
+  list->sync_step = 0;
+}
+
+//! Host copy of the radio filter. An empty list accepts everything.
+boolean ANTPlus::id_list_accepts( const ANT_IdList * list, const ANT_DeviceId * id )
+{
+  if(list->size == 0)
+  {
+    return true;
+  }
+  boolean listed = false;
+  for(byte i = 0; (i < list->size) && !listed; i++)
+  {
+    const ANT_DeviceId * entry = &list->ids[i];
+    //The pairing bit is not part of the device type match
+    listed = ((entry->device_number == 0) || (entry->device_number == id->device_number))
+          && ((entry->device_type == 0) || ((entry->device_type & ~ANT_ID_DEVICE_TYPE_PAIRING_FLAG) == (id->device_type & ~ANT_ID_DEVICE_TYPE_PAIRING_FLAG)))
+          && ((entry->transmission_type == 0) || (entry->transmission_type == id->transmission_type));
+  }
+  return (listed != list->exclude);
+}
+
+//! Send the next message needed to bring the module list in line with the host list.
+//The entries are added first and then the list is configured (size and include/exclude).
+//sync_step moves on when the module accepts the message (see readPacketInternal()).
+boolean ANTPlus::sendNextIdListMessage( ANT_Channel * channel )
+{
+  ANT_IdList * list = channel->id_list;
+  boolean sent_ok = true;
+
+  if(capabilities_valid && !hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS, CAPABILITIES_SEARCH_LIST_ENABLED))
+  {
+    //Nothing to send -- the host copy still filters when extended data is available
+    list->sync_step = ANT_ID_LIST_IN_SYNC;
+  }
+  else
+  if(list->sync_step < list->size)
+  {
+    const ANT_DeviceId * id = &list->ids[list->sync_step];
+    sent_ok = send(MESG_ID_LIST_ADD_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 6, channel->channel_number,
+                   (id->device_number & 0x00FF), ((id->device_number & 0xFF00) >> 8), id->device_type, id->transmission_type, list->sync_step);
+  }
+  else
+  {
+    sent_ok = send(MESG_ID_LIST_CONFIG_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 3, channel->channel_number, list->size, list->exclude ? 1 : 0);
+  }
+  return sent_ok;
+}
+
+//! Re-send a changed list for an established channel. Call until it returns COMPLETE (ERROR if the module keeps refusing it).
+ANT_CHANNEL_ESTABLISH ANTPlus::progress_sync_id_list( ANT_Channel * channel )
+{
+  if(channel->id_list == NULL)
+  {
+    return ANT_CHANNEL_ESTABLISH_COMPLETE;
+  }
+  if(awaitingResponseLastSent())
+  {
+    return ANT_CHANNEL_ESTABLISH_PROGRESSING;
+  }
+  if(channel->response_code != RESPONSE_NO_ERROR)
+  {
+    //Refused -- the same message goes again
+    channel->response_code = RESPONSE_NO_ERROR;
+    if(channel->setup_retries >= ANT_SETUP_STEP_RETRIES)
+    {
+      ANTPLUS_DEBUG_PRINTLN("ID list refused.");
+      channel->setup_retries = 0;
+      return ANT_CHANNEL_ESTABLISH_ERROR;
+    }
+    channel->setup_retries++;
+  }
+  if(channel->id_list->sync_step == ANT_ID_LIST_IN_SYNC)
+  {
+    return ANT_CHANNEL_ESTABLISH_COMPLETE;
+  }
+  unsigned long tx_packets_before = stats.tx_packets;
+  sendNextIdListMessage(channel);
+  if(stats.tx_packets != tx_packets_before)
+  {
+    //Its response code comes back to this channel
+    response_channel = channel;
+  }
+  return ANT_CHANNEL_ESTABLISH_PROGRESSING;
+}
+
+//! Configure event buffering on the module (all channels)
+boolean ANTPlus::setEventBuffering( byte buffer_config, unsigned int size_threshold, unsigned int time_threshold_10ms )
+{
+  return send(MESG_EVENT_BUFFERING_CONFIG_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 6, 0/*Filler*/, buffer_config,
+              (size_threshold & 0x00FF), ((size_threshold & 0xFF00) >> 8),
+              (time_threshold_10ms & 0x00FF), ((time_threshold_10ms & 0xFF00) >> 8));
+}
+
+//! Configure the events the module filters out (all channels)
+boolean ANTPlus::setEventFilter( unsigned int filter_mask )
+{
+  return send(MESG_EVENT_FILTER_CONFIG_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 3, 0/*Filler*/,
+              (filter_mask & 0x00FF), ((filter_mask & 0xFF00) >> 8));
+}
+
+//! Store an SDU mask on the module
+boolean ANTPlus::setSduMask( byte mask_number, const byte mask[ANT_STANDARD_DATA_PAYLOAD_SIZE] )
+{
+  return send(MESG_SDU_SET_MASK_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 9, mask_number,
+              mask[0], mask[1], mask[2], mask[3], mask[4], mask[5], mask[6], mask[7]);
+}
+
+//! Apply a stored SDU mask (or ANT_SDU_MASK_DISABLED) to one data page of a channel
+boolean ANTPlus::configSdu( byte channel_number, byte data_page_number, byte mask_number )
+{
+  return send(MESG_SDU_CONFIG_ID, MESG_RESPONSE_EVENT_ID/*Expected response*/, 3, channel_number, data_page_number, mask_number);
+}
+
+//! Time since RTS last fell (the module was last ready)
+unsigned long ANTPlus::msSinceLastRts()
+{
+  unsigned long rts_ms;
+  ANTPLUS_ATOMIC_BLOCK
+  {
+    rts_ms = last_rts_ms;
+  }
+  return millis() - rts_ms;
+}
+
+void ANTPlus::poll()
+{
+  unsigned long now_ms = millis();
+  if(power_state == ANT_POWER_SUSPEND)
+  {
+    //Nothing is expected from the module
+    return;
+  }
+  if(reset_state == ANT_RESET_ASSERTED)
+  {
+    if((now_ms - reset_ms) >= ANT_RESET_PULSE_MS)
+    {
+      digitalWrite(RESET_PIN, HIGH);
+      reset_state = ANT_RESET_AWAIT_STARTUP;
+#if defined(ANTPLUS_CAPTURE)
+      if(capture)
+      {
+        capture->resetReleased();
+      }
+#endif
+      //The startup deadline (ANT_HEALTH_RESET_TIMEOUT_MS) runs from here
+      stall_ref_ms = now_ms;
+      if(boot_timing.reset_release_ms == 0)
+      {
+        boot_timing.reset_release_ms = now_ms - begin_ms;
+      }
+    }
+    return;
+  }
+  boolean awaiting_response = awaitingResponseLastSent();
+
+  if(!awaiting_response && clear_to_send)
+  {
+    if(recovery_stage != ANT_RECOVERY_NONE)
+    {
+      unsigned long recovery_ms = now_ms - recovery_start_ms;
+      stats.recovery_count[recovery_stage]++;
+      stats.recovery_ms_total[recovery_stage] += recovery_ms;
+      if(recovery_ms > stats.recovery_ms_max[recovery_stage])
+      {
+        stats.recovery_ms_max[recovery_stage] = recovery_ms;
+      }
+      recovery_stage = ANT_RECOVERY_NONE;
+    }
+    progress_pairing();
+    return;
+  }
+
+  unsigned long timeout_ms = ANT_HEALTH_RTS_TIMEOUT_MS;
+  if(awaiting_response)
+  {
+    timeout_ms = (msgResponseExpected == MESG_STARTUP_MESG_ID) ? ANT_HEALTH_RESET_TIMEOUT_MS : ANT_HEALTH_RESPONSE_TIMEOUT_MS;
+  }
+  if((now_ms - stall_ref_ms) < timeout_ms)
+  {
+    return;
+  }
+  stall_ref_ms = now_ms;
+
+  if(!awaiting_response && (digitalRead(RTS_PIN) == LOW))
+  {
+    //The module is ready -- only the edge was missed
+    stats.rts_missed++;
+    clear_to_send = true;
+    return;
+  }
+
+  if(recovery_stage == ANT_RECOVERY_NONE)
+  {
+    recovery_start_ms = now_ms;
+    recovery_resends = 0;
+  }
+
+  if((recovery_stage <= ANT_RECOVERY_RESEND) && awaiting_response && (last_tx_len != 0) && (recovery_resends < ANT_HEALTH_RESEND_TRIES))
+  {
+    ANTPLUS_DEBUG_PRINTLN("No response. Resending....");
+    recovery_stage = ANT_RECOVERY_RESEND;
+    recovery_resends++;
+    resendLast();
+  }
+  else
+  if(recovery_stage <= ANT_RECOVERY_RESEND)
+  {
+    ANTPLUS_DEBUG_PRINTLN("Link stalled. Soft reset....");
+    recovery_stage = ANT_RECOVERY_SOFT_RESET;
+    softReset();
+  }
+  else
+  {
+    ANTPLUS_DEBUG_PRINTLN("Missed an RTS or none was executed by ANT. Restarting....");
+    recovery_stage = ANT_RECOVERY_HARD_RESET;
+    hardwareReset();
+    restoreChannels();
+  }
+}
+
+//! Save a learnt device ID to the channel's store
+void ANTPlus::learnPairing( ANT_Channel * channel, const ANT_DeviceId * id )
+{
+  if(id->device_number == 0)
+  {
+    //Not locked on to a device yet
+    channel->pairing_state = ANT_PAIRING_SEARCH;
+    return;
+  }
+  channel->paired_id = *id;
+  channel->pairing_state = ANT_PAIRING_LEARNT;
+  if(!channel->pairing->save(channel->pairing_slot, id))
+  {
+    ANTPLUS_DEBUG_PRINTLN("Pairing not saved.");
+  }
+}
+
+//! Request the channel ID of a device found without extended data. Called by poll() while the link is idle.
+void ANTPlus::progress_pairing()
+{
+  for(byte i = 0; i < ANT_DEVICE_NUMBER_CHANNELS; i++)
+  {
+    ANT_Channel * channel = channels[i];
+    if(channel && (channel->pairing_state == ANT_PAIRING_REQUEST))
+    {
+      if(send(MESG_REQUEST_ID, MESG_CHANNEL_ID_ID/*Expected response*/, 2, channel->channel_number, MESG_CHANNEL_ID_ID))
+      {
+        channel->pairing_state = ANT_PAIRING_REQUESTED;
+      }
+      return;
+    }
+  }
+}
+
+//! Write the kept request out again -- regardless of RTS (it may be the RTS that was lost)
+void ANTPlus::resendLast()
+{
+  byte len = last_tx_len;
+  for(byte i = 0; i < len; i++)
+  {
+    writeByte(last_tx[i], 0);
+  }
+  clear_to_send = false;
+  response_timed = false;
+}
+
+void ANTPlus::softReset()
+{
+  //Forced out -- nothing else is getting through anyway
+  clear_to_send = true;
+  msgResponseExpected = MESG_INVALID_ID;
+  send(MESG_SYSTEM_RESET_ID, MESG_STARTUP_MESG_ID/*Expected response*/, 1, 0/*Filler*/);
+  rxBufCnt = 0;
+  restoreChannels();
+}
+
+//! The module has forgotten its configuration -- have progress_setup_channel() run again for every registered channel
+void ANTPlus::restoreChannels()
+{
+  capabilities_valid = false;
+  for(byte i = 0; i < ANT_DEVICE_NUMBER_CHANNELS; i++)
+  {
+    ANT_Channel * channel = channels[i];
+    if(channel)
+    {
+      channel->state_counter = ANT_SETUP_STEP_BEGIN;
+      channel->channel_establish = ANT_CHANNEL_ESTABLISH_PROGRESSING;
+      channel->channel_state = ANT_CHANNEL_STATE_CLOSED;
+      if(channel->id_list)
+      {
+        channel->id_list->sync_step = 0;
+      }
+    }
+  }
+}
+
 //! A function that is called when an RTS interrupt is received in the main program
 void   ANTPlus::rTSHighAssertion()
 {
+      if(rtsInterruptAttached())
+      {
+        //Already handled on the falling edge
+        return;
+      }
       //"Waiting for ANT to RTS (let us send again)."
-      //Need to make sure it is low again
+      //Need to make sure it is low again. Only from loop() -- not an ISR.
       while( digitalRead(RTS_PIN) != LOW )
       {
-        //TODO: Is this a bad idea in an ISR?
         delayMicroseconds(50);
       }
-      clear_to_send = true;
+      handleRtsEdge(false);
 }
 
 
-//!Put ANT module into sleep mode. NOTE: This seems to have some issues.
-void ANTPlus::sleep(boolean activate_sleep)
+//!Put ANT module into sleep mode.
+//The UART sleeps between messages -- only once the module has taken the last one (RTS) and answered it.
+boolean ANTPlus::sleep(boolean activate_sleep)
 {
-    int logic_level = HIGH; //Sleep
+    if(power_state == ANT_POWER_SUSPEND)
+    {
+      return false;
+    }
     if(!activate_sleep)
     {
-        logic_level = LOW; //Wake
+      digitalWrite(SLEEP_PIN, LOW); //Wake
+      setPowerState(ANT_POWER_AWAKE);
+      return true;
+    }
+    if(!clear_to_send || awaitingResponseLastSent())
+    {
+      return false;
     }
-    digitalWrite(SLEEP_PIN, logic_level);
+    digitalWrite(SLEEP_PIN, HIGH); //Sleep
+    setPowerState(ANT_POWER_SLEEP);
+    return true;
 }
 
-//!Put ANT module into suspend mode. NOTE: Not implemented
+//!Put ANT module into suspend mode.
 void ANTPlus::suspend(boolean activate_suspend)
 {
-    //TODO:
-    assert(false);
+    if(activate_suspend == (power_state == ANT_POWER_SUSPEND))
+    {
+      return;
+    }
+    if(activate_suspend)
+    {
+      //Per datasheet -- SUSPEND low while SLEEP is high
+      digitalWrite(SLEEP_PIN,   HIGH);
+      digitalWrite(SUSPEND_PIN, LOW);
+      setPowerState(ANT_POWER_SUSPEND);
+      msgResponseExpected = MESG_INVALID_ID;
+      response_timed = false;
+      clear_to_send = false;
+      return;
+    }
+
+    //Leaving suspend restarts the module -- it announces itself with MESG_STARTUP_MESG_ID (RESET_SUSPEND)
+    digitalWrite(SUSPEND_PIN, HIGH);
+    digitalWrite(SLEEP_PIN,   LOW);
+    setPowerState(ANT_POWER_AWAKE);
+    msgResponseExpected = MESG_STARTUP_MESG_ID;
+    rxBufCnt = 0;
+    last_tx_len = 0;
+    stall_ref_ms = millis();
+    restoreChannels();
+}
+
+void ANTPlus::setPowerState( ANT_POWER_STATE state )
+{
+    unsigned long now_ms = millis();
+    if(power_state == ANT_POWER_SLEEP)
+    {
+      stats.module_sleep_ms += now_ms - power_state_ms;
+    }
+    else
+    if(power_state == ANT_POWER_SUSPEND)
+    {
+      stats.module_suspend_ms += now_ms - power_state_ms;
+    }
+    power_state = state;
+    power_state_ms = now_ms;
+}
+
+unsigned long ANTPlus::msUntilNextEvent()
+{
+    if(power_state == ANT_POWER_SUSPEND)
+    {
+      return ANT_IDLE_MAX_MS;
+    }
+    if(!clear_to_send || awaitingResponseLastSent() || mySerial->available())
+    {
+      return 0;
+    }
+
+    unsigned long now_ms = millis();
+    unsigned long idle_ms = ANT_IDLE_MAX_MS;
+    for(byte i = 0; i < ANT_DEVICE_NUMBER_CHANNELS; i++)
+    {
+      ANT_Channel * channel = channels[i];
+      if(channel == NULL)
+      {
+        continue;
+      }
+      if((channel->channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE) || channel->scan_mode)
+      {
+        //Setup messages to send, or data from any device at any time
+        return 0;
+      }
+      if((channel->channel_state != ANT_CHANNEL_STATE_TRACKING) && (channel->channel_state != ANT_CHANNEL_STATE_DROPPED))
+      {
+        //Searching -- the first broadcast could come at any time
+        continue;
+      }
+      //Channel period is in 1/32768 s
+      unsigned long period_ms = ((unsigned long)channel->period * 1000UL) / 32768UL;
+      if(period_ms <= (2 * ANT_IDLE_GUARD_MS))
+      {
+        return 0;
+      }
+      //A missed broadcast (EVENT_RX_FAIL) comes at the same point in the period
+      unsigned long phase_ms = (now_ms - channel->data_ms) % period_ms;
+      if(phase_ms < ANT_IDLE_GUARD_MS)
+      {
+        //Due now (or running a little late)
+        return 0;
+      }
+      unsigned long until_ms = period_ms - phase_ms;
+      until_ms = (until_ms > ANT_IDLE_GUARD_MS) ? (until_ms - ANT_IDLE_GUARD_MS) : 0;
+      if(until_ms < idle_ms)
+      {
+        idle_ms = until_ms;
+      }
+    }
+    return idle_ms;
+}
+
+//! Decode the sender's device ID from a data message that carries extended data.
+//Handles both the flagged format (ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID -- flag byte after the 8 byte payload)
+// and the legacy extended messages (MESG_EXT_*_DATA_ID -- device ID before the payload).
+//payload (optional) is set to the 8 byte data payload.
+//Returns false if the packet is not a data message or has no device ID.
+boolean ANTPlus::get_extended_device_id( const ANT_Packet * packet, ANT_DeviceId * id, const byte ** payload )
+{
+  const byte * dev_id = NULL;
+  const byte * data = NULL;
+
+  switch(packet->msg_id)
+  {
+    case MESG_BROADCAST_DATA_ID:
+    case MESG_ACKNOWLEDGED_DATA_ID:
+    case MESG_BURST_DATA_ID:
+      // <channel> <8 data> <flag> <dev# LSB> <dev# MSB> <dev type> <trans type> [RSSI...] [timestamp...]
+      if((packet->length >= (MESG_CHANNEL_NUM_SIZE + ANT_STANDARD_DATA_PAYLOAD_SIZE + MESG_EXT_MESG_BF_SIZE + ANT_EXT_MESG_DEVICE_ID_FIELD_SIZE))
+          && (packet->data[MESG_CHANNEL_NUM_SIZE + ANT_STANDARD_DATA_PAYLOAD_SIZE] & ANT_EXT_MESG_BITFIELD_DEVICE_ID))
+      {
+        data   = &packet->data[MESG_CHANNEL_NUM_SIZE];
+        dev_id = &packet->data[MESG_CHANNEL_NUM_SIZE + ANT_STANDARD_DATA_PAYLOAD_SIZE + MESG_EXT_MESG_BF_SIZE];
+      }
+      break;
+
+    case MESG_EXT_BROADCAST_DATA_ID:
+    case MESG_EXT_ACKNOWLEDGED_DATA_ID:
+    case MESG_EXT_BURST_DATA_ID:
+      // <channel> <dev# LSB> <dev# MSB> <dev type> <trans type> <8 data>
+      if(packet->length >= MESG_EXT_DATA_SIZE)
+      {
+        dev_id = &packet->data[MESG_CHANNEL_NUM_SIZE];
+        data   = &packet->data[MESG_CHANNEL_NUM_SIZE + ANT_EXT_MESG_DEVICE_ID_FIELD_SIZE];
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if(dev_id == NULL)
+  {
+    return false;
+  }
+
+  id->device_number     = (unsigned int)dev_id[ANT_ID_DEVICE_NUMBER_LOW_OFFSET] | ((unsigned int)dev_id[ANT_ID_DEVICE_NUMBER_HIGH_OFFSET] << 8);
+  id->device_type       = dev_id[ANT_ID_DEVICE_TYPE_OFFSET];
+  id->transmission_type = dev_id[ANT_ID_TRANS_TYPE_OFFSET];
+  if(payload)
+  {
+    *payload = data;
+  }
+  return true;
 }
 
 // SDM -- 6.2.2
@@ -28,26 +28,67 @@
 #define ANTPLUS_DEBUG //!< Prints various debug messages. Disable here or via using NDEBUG externally
 #define ANTPLUS_MSG_STR_DECODE //<! Stringiser for various codes for easier debugging
 
+#define ANTPLUS_DUPLICATE_FILTER //!< Optional per-channel dropping of repeated broadcasts (ANT_Channel::duplicate_filter). Costs ~12 bytes SRAM per channel.
+
+//#define ANTPLUS_SCAN_MODE //!< Continuous scan mode receiver (see ANTDeviceTable). Enlarges the receive buffer to hold extended data.
+
+//#define ANTPLUS_PROFILE //!< Cycle count histograms around the hot paths (see ANTProfile.h). Nothing is compiled in when disabled.
+
+//#define ANTPLUS_CAPTURE //!< Record UART bytes and RTS into an ANTCapture (see ANTPlus::setCapture())
+
+//#define ANTPLUS_STATS_MSG_ID //!< Per message ID RX/TX counts in ANT_Stats. Costs ~260 bytes SRAM.
+
+#define ANTPLUS_DEBUG_BUFFER_SIZE (128) //!< Debug output is logged as binary records and printed later by flushDebug(). Power of two.
+#define ANTPLUS_DEBUG_FLUSH_ON_IDLE //!< readPacket() prints the debug log to Serial when the UART is empty. Disable to call flushDebug() yourself.
+
 #if defined(NDEBUG)
 #undef ANTPLUS_DEBUG
 #undef ANTPLUS_MSG_STR_DECODE
 #endif
 
+#if !defined(ANTPLUS_DEBUG)
+#undef ANTPLUS_DEBUG_FLUSH_ON_IDLE
+#endif
+
 //These are from the ANT+ packages (under Apache license)
 #include "antdefines.h"
 #include "antmessage.h"
 
-#define ANT_PACKET_READ_NEXT_BYTE_TIMEOUT_MS  (10) //<! If we get a byte in a read -- how long do we wait for the next byte before timing out...
+#include "ANTRingBuffer.h"
+
+#define ANT_PACKET_READ_NEXT_BYTE_TIMEOUT_BYTES (10) //!< If we get a byte in a read -- how long (in byte times) we wait for the next byte before timing out. Scaled by the baud rate (see setBaudRate()).
 
-#if defined(ANTPLUS_MINIMAL_RECEIVE_BUFFER_FOR_BROADCAST_DATA)
+#define ANT_BAUD_RATE_DEFAULT       (9600)
+#define ANT_BAUD_PROBE_TIMEOUT_MS   (100)  //!< How long beginAutoBaud() waits for a response at each rate
+
+//! Reconfigures the UART that ANTPlus uses. e.g. { Serial1.begin(baud_rate); }
+typedef void (*ANT_SetBaudRate)( unsigned long baud_rate );
+
+#if defined(ANTPLUS_MINIMAL_RECEIVE_BUFFER_FOR_BROADCAST_DATA) && !defined(ANTPLUS_SCAN_MODE)
 #define ANT_MAX_PACKET_LEN        (16) //!< This is the size of a packet buffer that should be presented for a read function (optimised for size with only small broadcast packets (e.g. HRM) ).
+#elif defined(ANTPLUS_MINIMAL_RECEIVE_BUFFER_FOR_BROADCAST_DATA)
+#define ANT_MAX_PACKET_LEN        (24) //!< Broadcast packets plus flagged extended data (device ID, RSSI and timestamp).
 #else
 #define ANT_MAX_PACKET_LEN        (80)             //!< This is the size of a packet buffer that should be presented for a read function.
 #endif
 
+#if !defined(ANTPLUS_MAX_INSTANCES)
+#define ANTPLUS_MAX_INSTANCES (1) //!< ANTPlus objects that can have the library RTS interrupt (up to 4)
+#endif
+
+#if defined(ANTPLUS_HOST)
+#define ANTPLUS_THREAD_LOCAL __thread //!< Host builds -- the RTS slots are per thread, as the host core's interrupts are (extras/host)
+#else
+#define ANTPLUS_THREAD_LOCAL
+#endif
+
 //BK - Hack to save the teeniest of SRAM space....
+#if !defined(ANT_DEVICE_NUMBER_CHANNELS)
 //#define ANT_DEVICE_NUMBER_CHANNELS (8) //!< nRF24AP2 has an 8 channel version.
-#define ANT_DEVICE_NUMBER_CHANNELS (1) //!< nRF24AP2 has an 8 channel version. However -- it seems there are issues bringing up two channels with this code. TODO: Review and fix.
+#define ANT_DEVICE_NUMBER_CHANNELS (1) //!< Channels that can be registered (nRF24AP2 has an 8 channel version). Raise here or as a build flag for progress_setup_channels().
+#endif
+
+#define ANT_OPEN_STAGGER_MS (1000) //!< progress_setup_channels() holds an open this long while an earlier channel is still searching
 
 //TODO: Make this into a class
 #define DATA_PAGE_HEART_RATE_0              (0x00)
@@ -122,6 +163,14 @@ typedef struct ANT_Packet_struct
 
 #define ANT_PACKET_CHECKSUM(/*Ant_Packet * */ packet) (packet->data[packet->length])
 
+//! Device ID of a remote ANT device. Decoded from extended data (see ANTPlus::get_extended_device_id()).
+typedef struct ANT_DeviceId_struct
+{
+   unsigned int device_number;
+   byte device_type;
+   byte transmission_type;
+} ANT_DeviceId;
+
 //TODO: Rename?
 typedef struct ANT_Broadcast_struct
 {
@@ -315,6 +364,30 @@ typedef struct Bike_Trainer_with_Power_struct
 } Bike_Trainer_with_Power;
 
 
+//! Steps of progress_setup_channel(). Held in ANT_Channel::state_counter.
+typedef enum
+{
+  ANT_SETUP_STEP_BEGIN,
+  ANT_SETUP_STEP_REQUEST_CAPABILITIES,
+  ANT_SETUP_STEP_ASSIGN_CHANNEL,
+  ANT_SETUP_STEP_CHANNEL_ID,
+  ANT_SETUP_STEP_NETWORK_KEY,
+  ANT_SETUP_STEP_SEARCH_TIMEOUT,
+  ANT_SETUP_STEP_LP_SEARCH_TIMEOUT, //!< Only with ANT_Channel::lp_search_timeout
+  ANT_SETUP_STEP_HIGH_DUTY_SEARCH,  //!< Only with ANT_Channel::high_duty_search
+  ANT_SETUP_STEP_PROXIMITY,         //!< Only with ANT_Channel::proximity_bin
+  ANT_SETUP_STEP_SEARCH_PRIORITY,   //!< Only with ANT_Channel::search_priority
+  ANT_SETUP_STEP_SEARCH_SHARING,    //!< Only with ANT_Channel::search_sharing_cycles
+  ANT_SETUP_STEP_RSSI_THRESHOLD,    //!< Only with ANT_Channel::rssi_threshold
+  ANT_SETUP_STEP_RADIO_FREQ,
+  ANT_SETUP_STEP_PERIOD,
+  ANT_SETUP_STEP_LIB_CONFIG,     //!< Scan mode only -- extended data with the device ID
+  ANT_SETUP_STEP_ID_LIST,        //!< Only with an ANT_Channel::id_list
+  ANT_SETUP_STEP_OPEN,
+  ANT_SETUP_STEP_AWAIT_OPEN,
+
+}   ANT_SETUP_STEP;
+
 //! See progress_setup_channel().
 typedef enum
 {
@@ -324,8 +397,86 @@ typedef enum
 
 }   ANT_CHANNEL_ESTABLISH;
 
+//! Channel state once open. Driven by the channel events from the module (see ANT_Channel::channel_state).
+typedef enum
+{
+  ANT_CHANNEL_STATE_CLOSED,
+  ANT_CHANNEL_STATE_SEARCHING,  //!< Open -- no device found yet
+  ANT_CHANNEL_STATE_TRACKING,   //!< Receiving from a device
+  ANT_CHANNEL_STATE_DROPPED,    //!< Lost the device (EVENT_RX_FAIL_GO_TO_SEARCH) -- searching for it again
+}   ANT_CHANNEL_STATE;
+
+//! Persisted pairing (see ANT_Channel::pairing)
+typedef enum
+{
+  ANT_PAIRING_NONE,       //!< Store not read yet
+  ANT_PAIRING_SEARCH,     //!< Nothing stored -- wildcard search. The ID of the first device found is learnt.
+  ANT_PAIRING_STORED,     //!< Opening with the stored ID
+  ANT_PAIRING_LEARNT,     //!< paired_id is the device being received (and is in the store)
+  ANT_PAIRING_REQUEST,    //!< Found a device without extended data -- MESG_CHANNEL_ID_ID is requested from poll()
+  ANT_PAIRING_REQUESTED,
+  ANT_PAIRING_EXPIRED,    //!< The paired device was not found before the search timeout -- reopened as a wildcard search
+}   ANT_PAIRING_STATE;
+
+class ANTPairingStore;
+
+#define ANT_LP_SEARCH_OFF      (0xFE) //!< ANT_Channel::lp_search_timeout for a high priority search only (0 leaves the module default)
+#define ANT_LP_SEARCH_INFINITE (0xFF)
+#define ANT_PROXIMITY_BIN_MAX  (10)   //!< Widest proximity bin (1 is the nearest)
+
+#define ANT_SETUP_STEP_RETRIES (2) //!< Times a setup step is re-sent after an error response before ANT_CHANNEL_ESTABLISH_ERROR
+
 #define ANT_CHANNEL_NUMBER_INVALID (-1)
 
+#define ANT_ID_LIST_MAX_SIZE  (4)    //!< Inclusion/exclusion list entries per channel on the nRF24AP2
+#define ANT_ID_LIST_IN_SYNC   (0xFF) //!< ANT_IdList::sync_step when the module holds the same list as the host
+
+//Event filter bits for setEventFilter() (MESG_EVENT_FILTER_CONFIG_ID). A set bit stops the event reaching the host.
+#define ANT_EVENT_FILTER_RX_SEARCH_TIMEOUT      (0x0001)
+#define ANT_EVENT_FILTER_RX_FAIL                (0x0002)
+#define ANT_EVENT_FILTER_TX                     (0x0004)
+#define ANT_EVENT_FILTER_TRANSFER_RX_FAILED     (0x0008)
+#define ANT_EVENT_FILTER_TRANSFER_TX_COMPLETED  (0x0010)
+#define ANT_EVENT_FILTER_TRANSFER_TX_FAILED     (0x0020)
+#define ANT_EVENT_FILTER_CHANNEL_CLOSED         (0x0040)
+#define ANT_EVENT_FILTER_RX_FAIL_GO_TO_SEARCH   (0x0080)
+#define ANT_EVENT_FILTER_CHANNEL_COLLISION      (0x0100)
+#define ANT_EVENT_FILTER_TRANSFER_TX_START      (0x0200)
+
+//Event buffering for setEventBuffering() (MESG_EVENT_BUFFERING_CONFIG_ID)
+#define ANT_EVENT_BUFFER_LOW_PRIORITY  (0x00) //!< Buffer low priority events only (data, EVENT_TX, EVENT_RX_FAIL...)
+#define ANT_EVENT_BUFFER_ALL           (0x01) //!< Buffer everything
+//A size threshold and time threshold of 0 turns buffering off
+
+//Selective Data Update (MESG_SDU_CONFIG_ID / MESG_SDU_SET_MASK_ID)
+#define ANT_SDU_MASK_DISABLED  (0xFF) //!< Mask number to stop SDU for a data page
+//In an SDU mask a set bit marks a payload bit that is compared -- a page is only passed to the host when one of those bits changes
+
+//! Inclusion/exclusion list for a channel. Applied on the radio so unwanted devices never cross the UART.
+//Change it with the ANTPlus::id_list_*() functions -- they flag it to be re-sent (see progress_sync_id_list()).
+//Device number, type or transmission type of 0 are wildcards (as for the channel ID).
+typedef struct ANT_IdList_struct
+{
+   ANT_DeviceId ids[ANT_ID_LIST_MAX_SIZE];
+   byte size;
+   boolean exclude;       //!< Exclusion list (otherwise an inclusion list)
+   byte sync_step;        //Private for internal use only
+
+   long delivered_count;  //!< Data messages passed on from this channel
+   long filtered_count;   //!< Data messages that reached the host but were dropped by the host copy of the list (needs extended data)
+} ANT_IdList;
+
+//Indices into the capabilities message (MESG_CAPABILITIES_ID). See hasCapability().
+#define ANT_CAPABILITIES_MAX_CHANNELS       (0)
+#define ANT_CAPABILITIES_MAX_NETWORKS       (1)
+#define ANT_CAPABILITIES_STANDARD_OPTIONS   (2)
+#define ANT_CAPABILITIES_ADVANCED_OPTIONS   (3)
+#define ANT_CAPABILITIES_ADVANCED_OPTIONS_2 (4)
+#define ANT_CAPABILITIES_MAX_SENSRCORE      (5)
+#define ANT_CAPABILITIES_ADVANCED_OPTIONS_3 (6)
+#define ANT_CAPABILITIES_ADVANCED_OPTIONS_4 (7)
+#define ANT_CAPABILITIES_LEN                (8)
+
 //! Details required to establish an ANT+ (and ANT?) channel. See progress_setup_channel().
 typedef struct ANT_Channel_struct
 {
@@ -342,8 +493,48 @@ typedef struct ANT_Channel_struct
    unsigned char ant_net_key[8];
    
    ANT_CHANNEL_ESTABLISH channel_establish; //Read-only from external
-   boolean data_rx;                         //Broadcast data received. For now this is only updated from external. TODO: Move internally
+   boolean data_rx;                         //Broadcast data received. Set by readPacket() once the channel is registered (progress_setup_channel())
    int state_counter; //Private for internal use only
+
+   //Optional configuration items (zero when left out of an initialiser)
+   boolean scan_mode;                       //!< Open as a continuous scan mode receiver instead of a paired slave. Channel 0 only.
+   ANT_IdList * id_list;                    //!< Optional inclusion/exclusion list
+   boolean stay_closed;                     //!< Do not reopen when the module closes the channel (search timeout). Reopening is the default.
+
+   ANT_CHANNEL_STATE channel_state;         //Read-only from external
+   long rx_fail_count;                      //!< EVENT_RX_FAIL -- a channel period with nothing received
+   long drop_count;                         //!< EVENT_RX_FAIL_GO_TO_SEARCH
+   long reopen_count;
+   byte response_code;                      //Private for internal use only
+   byte setup_retries;                      //Private for internal use only
+   int  sent_step;                          //Private for internal use only
+   ANTPairingStore * pairing;               //!< Optional store (see ANTPairing.h). Only used with a wildcard device number.
+   byte pairing_slot;                       //!< Store slot for this channel
+   ANT_PAIRING_STATE pairing_state;         //Read-only from external
+   ANT_DeviceId paired_id;                  //Read-only from external
+   boolean paired_open;                     //!< The last open used paired_id rather than a wildcard search
+   unsigned long open_ms;                   //Private for internal use only
+   unsigned long data_ms;                   //Private for internal use only
+   unsigned long acquire_ms;                //!< First open to first data, across reopens after a search timeout (compare with paired_open). 0 until then.
+   byte lp_search_timeout;                  //!< Low priority search ahead of the high priority search (timeout) in 2.5 s units. 0 == module default (5 s). See ANT_LP_SEARCH_OFF.
+   boolean high_duty_search;                //!< MESG_HIGH_DUTY_SEARCH_MODE_ID -- more radio time while searching for a faster acquire. Module wide.
+   byte proximity_bin;                      //!< Only acquire devices within this bin (1 nearest .. ANT_PROXIMITY_BIN_MAX). 0 == off.
+   byte proximity_widen_to;                 //!< Proximity pairing -- each search timeout widens the bin by one up to this. 0 == the bin stays.
+   byte search_priority;                    //!< MESG_SET_SEARCH_CH_PRIORITY_ID -- higher searches ahead of the other channels. Also the open order in progress_setup_channels(). 0 == module default.
+   byte search_sharing_cycles;              //!< MESG_ACTIVE_SEARCH_SHARING_ID -- search periods taken in turn with the other searching channels. 0 == off.
+   signed char rssi_threshold;              //!< MESG_RSSI_SEARCH_THRESHOLD_ID -- devices weaker than this (dBm, e.g. -70) are not acquired. 0 == off.
+   byte search_bin;                         //Read-only from external -- proximity bin being searched
+   byte acquired_bin;                       //Read-only from external -- proximity bin of the last acquire (0 for none). See acquire_ms.
+   boolean search_widened;                  //Private for internal use only
+   boolean acquire_pending;                 //Private for internal use only
+#if defined(ANTPLUS_DUPLICATE_FILTER)
+   boolean duplicate_filter;                //!< Drop broadcasts identical to the last one delivered (before readPacket() returns). Not for scan mode.
+   byte duplicate_force_every;              //!< Still deliver every Nth identical payload (liveness). 0 == never.
+   long duplicate_count;                    //!< Duplicates dropped
+   byte duplicate_run;                      //Private for internal use only
+   boolean last_payload_valid;              //Private for internal use only
+   byte last_payload[ANT_STANDARD_DATA_PAYLOAD_SIZE]; //Private for internal use only
+#endif
 } ANT_Channel;
  
 
@@ -362,7 +553,170 @@ typedef enum
 } MESSAGE_READ;
 
 
+//! Link recovery stage (see ANTPlus::poll()). Each stage is tried when the previous one did not bring the module back.
+typedef enum
+{
+  ANT_RECOVERY_NONE,
+  ANT_RECOVERY_RESEND,      //!< Send the last request again
+  ANT_RECOVERY_SOFT_RESET,  //!< MESG_SYSTEM_RESET_ID and set the registered channels up again
+  ANT_RECOVERY_HARD_RESET,  //!< Reset pin and set the registered channels up again
+  ANT_RECOVERY_STAGES
+} ANT_RECOVERY_STAGE;
+
+#define ANT_HEALTH_RESPONSE_TIMEOUT_MS  (250)  //!< No response to a request in this time is a stall
+#define ANT_HEALTH_RTS_TIMEOUT_MS       (100)  //!< No RTS after a message in this time is a stall
+#define ANT_HEALTH_RESET_TIMEOUT_MS     (1000) //!< No startup message in this time after a reset is a stall
+#define ANT_HEALTH_RESEND_TRIES         (2)
+#define ANT_HEALTH_LAST_TX_MAX          (16)   //!< Longer requests are not kept for resending
+
+//! Hardware reset sequence (see ANTPlus::hardwareReset()). Driven by poll().
+typedef enum
+{
+  ANT_RESET_DONE,             //!< Startup message received
+  ANT_RESET_ASSERTED,         //!< RESET pin low for ANT_RESET_PULSE_MS
+  ANT_RESET_AWAIT_STARTUP,    //!< Released -- MESG_STARTUP_MESG_ID due within ANT_HEALTH_RESET_TIMEOUT_MS (poll() recovers after that)
+} ANT_RESET_STATE;
+
+#define ANT_RESET_PULSE_MS       (5)
+#define ANT_RESET_REASON_UNKNOWN (0xFF) //!< getResetReason() before the first startup message. Otherwise RESET_* from antdefines.h.
+
+//! Startup latency in ms from begin(). 0 until reached. See ANTPlus::getBootTiming().
+typedef struct ANT_BootTiming_struct
+{
+   unsigned long reset_release_ms;
+   unsigned long startup_ms;                //!< MESG_STARTUP_MESG_ID received
+   unsigned long first_open_ms;             //!< First channel open accepted by the module
+} ANT_BootTiming;
+
+//! Module power (see ANTPlus::sleep() and ANTPlus::suspend())
+typedef enum
+{
+  ANT_POWER_AWAKE,
+  ANT_POWER_SLEEP,    //!< SLEEP pin high -- UART asleep, channels keep running. send() wakes it.
+  ANT_POWER_SUSPEND,  //!< Channels closed. Resuming restarts the module.
+} ANT_POWER_STATE;
+
+#define ANT_IDLE_MAX_MS    (1000) //!< msUntilNextEvent() when nothing is expected sooner (searching or no channels)
+#define ANT_IDLE_GUARD_MS  (5)    //!< Wake this long ahead of an expected broadcast
 
+#define ANT_STATS_MSG_ID_FIRST  (0x40) //!< Per message ID counts cover 0x40..0x7F (every channel and configuration message)
+#define ANT_STATS_MSG_ID_COUNT  (0x40)
+#define ANT_STATS_MSG_ID_OTHER  (ANT_STATS_MSG_ID_COUNT) //!< Bucket for everything outside that range
+
+//! Counters since begin() or the last reset. See ANTPlus::getStats().
+typedef struct ANT_Stats_struct
+{
+   unsigned long since_ms;                  //!< When counting started
+   unsigned long snapshot_ms;               //!< When this copy was taken
+
+   //Receive
+   unsigned long rx_packets;                //!< Complete frames (including those with a bad checksum)
+   unsigned long rx_bytes;
+   unsigned long rx_wakeups;                //!< Bursts of packets -- readPacket() returned a packet after having returned none
+   unsigned long rx_bad_checksum;
+   unsigned long rx_missing_sync;           //!< Bytes discarded while looking for a sync
+   unsigned long rx_size_exceeded;
+   unsigned long rx_timeout_midmessage;
+   unsigned long rx_filtered;               //!< Dropped by the host ID list or duplicate filters
+   unsigned long rx_channel_data[ANT_DEVICE_NUMBER_CHANNELS]; //!< Data messages per channel (see ANTPlus::stats_per_minute())
+
+   //Transmit
+   unsigned long tx_packets;
+   unsigned long tx_bytes;
+   unsigned long tx_refused_not_clear;      //!< send() refused -- no RTS since the last message (caller retries)
+   unsigned long tx_refused_awaiting;       //!< send() refused -- the response to the last message is outstanding (caller retries)
+
+   //Module
+   unsigned long hw_resets;
+   unsigned long rts_pulses;                //!< Module ready again (RTS fell)
+   unsigned long rts_high_count;            //!< Pulses with both edges seen (library interrupt)
+   unsigned long rts_high_us_min;
+   unsigned long rts_high_us_max;
+   unsigned long rts_high_us_total;         //!< Mean is rts_high_us_total / rts_high_count
+   unsigned long rts_missed;                //!< RTS found low without the edge having been seen
+
+   //Recovery -- indexed by the last ANT_RECOVERY_STAGE needed ([ANT_RECOVERY_NONE] is unused)
+   unsigned long recovery_count[ANT_RECOVERY_STAGES];
+   unsigned long recovery_ms_total[ANT_RECOVERY_STAGES]; //!< Stall detected to the module answering again
+   unsigned long recovery_ms_max[ANT_RECOVERY_STAGES];
+
+   //Power
+   unsigned long host_idle_ms;              //!< Reported by recordHostIdle(). See ANTPlus::awake_fraction().
+   unsigned long module_sleep_ms;
+   unsigned long module_suspend_ms;
+
+#if defined(ANTPLUS_DEBUG)
+   unsigned long debug_dropped;             //!< Debug records lost to a full log (flush more often or enlarge ANTPLUS_DEBUG_BUFFER_SIZE)
+#endif
+
+   //Command to response latency
+   unsigned long response_count;
+   unsigned long response_us_min;
+   unsigned long response_us_max;
+   unsigned long response_us_total;         //!< Mean is response_us_total / response_count
+
+#if defined(ANTPLUS_STATS_MSG_ID)
+   unsigned int rx_msg_id[ANT_STATS_MSG_ID_COUNT + 1]; //!< Indexed by msg_id - ANT_STATS_MSG_ID_FIRST (saturates)
+   unsigned int tx_msg_id[ANT_STATS_MSG_ID_COUNT + 1];
+#endif
+} ANT_Stats;
+
+//Stats can be updated from the RTS interrupt -- copies are taken with it held off
+//The block puts back the interrupt state it found (as ATOMIC_RESTORESTATE) so it can be used in the RTS ISR
+// (ANTCapture) and with interrupts already held off.
+#if defined(__AVR__)
+#include <util/atomic.h>
+#define ANTPLUS_ATOMIC_BLOCK ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#else
+#if defined(ANTPLUS_HOST)
+//Host core (extras/host)
+static inline unsigned long antplus_interrupts_save() {unsigned long enabled = host_interrupts_enabled(); noInterrupts(); return enabled;}
+static inline void antplus_interrupts_restore( unsigned long enabled ) {if(enabled) {interrupts();}}
+#elif defined(__ARM_ARCH_PROFILE) && (__ARM_ARCH_PROFILE == 'M')
+//Cortex-M (Due, Zero, Teensy 3/4, STM32, nRF52) -- PRIMASK
+static inline unsigned long antplus_interrupts_save()
+{
+  unsigned long primask;
+  __asm__ volatile("mrs %0, primask\n\tcpsid i" : "=r" (primask) : : "memory");
+  return primask;
+}
+static inline void antplus_interrupts_restore( unsigned long primask ) {__asm__ volatile("msr primask, %0" : : "r" (primask) : "memory");}
+#elif defined(ESP8266)
+static inline unsigned long antplus_interrupts_save() {return xt_rsil(15);}
+static inline void antplus_interrupts_restore( unsigned long ps ) {xt_wsr_ps(ps);}
+#else
+//No way to read the state on other cores -- only nesting is counted, so do not hold interrupts off around the library there
+//The RTS ISR counts as a level (ANTPlus::rts_isr()) so a block taken inside it does not turn interrupts back on
+extern volatile byte antplus_interrupts_depth;
+static inline unsigned long antplus_interrupts_save() {noInterrupts(); antplus_interrupts_depth++; return 0;}
+static inline void antplus_interrupts_restore( unsigned long unused ) {(void)unused; if(--antplus_interrupts_depth == 0) {interrupts();}}
+#define ANTPLUS_INTERRUPTS_DEPTH
+#endif
+class ANTPlus_CriticalSection
+{
+  public:
+    ANTPlus_CriticalSection() : done(false) {state = antplus_interrupts_save();};
+    ~ANTPlus_CriticalSection() {antplus_interrupts_restore(state);};
+    boolean once() {boolean first = !done; done = true; return first;};
+  private:
+    unsigned long state;
+    boolean done;
+};
+#define ANTPLUS_ATOMIC_BLOCK for(ANTPlus_CriticalSection antplus_cs; antplus_cs.once(); )
+#endif
+
+
+
+
+//Debug log record types (flushDebug() raw output)
+// TX      : type, time ms (4 bytes LE), TX index (4 bytes LE), then the frame as sent (sync, length, msg id, data, checksum)
+// TEXT(_LN) : type, length, characters
+#define ANT_DEBUG_RECORD_TX       (1)
+#define ANT_DEBUG_RECORD_TEXT     (2)
+#define ANT_DEBUG_RECORD_TEXT_LN  (3)
+#define ANT_DEBUG_TX_HEADER_LEN   (9)
+
+class ANTCapture;
 
 //TODO: Look at ANT and ANT+ and work out the appropriate breakdown for a subclass/separate class
 class ANTPlus
@@ -374,54 +728,218 @@ class ANTPlus
         byte SLEEP_PIN,
         byte RESET_PIN
     );
+    ~ANTPlus() {end();};
 
     void     begin(Stream &serial);
+    void     begin(Stream &serial, unsigned long baud_rate); //!< serial must already be running at baud_rate
+    //! Releases the RTS interrupt and its ANTPLUS_MAX_INSTANCES slot (also on destruction). begin() again to carry on.
+    void     end();
+    //! Try each rate the nRF24AP2 supports until the module answers a request. Returns the rate found (0 if none -- left at the default).
+    unsigned long beginAutoBaud(Stream &serial, ANT_SetBaudRate set_baud_rate);
+    //! Scales the mid-message timeout to the UART rate
+    void     setBaudRate(unsigned long baud_rate);
+    unsigned long getBaudRate() {return baud_rate;};
+    //! Returns straight away -- the RESET pin is released and the startup message waited for by poll() (see ANT_RESET_STATE)
     void     hardwareReset( );
+    ANT_RESET_STATE getResetState() {return reset_state;};
+    //! Reason byte of the last startup message (RESET_POR, RESET_RST, RESET_WDT or RESET_CMD/SYNC/SUSPEND flags)
+    byte     getResetReason() {return reset_reason;};
+    const ANT_BootTiming * getBootTiming() {return &boot_timing;};
 
     boolean send(unsigned msgId, unsigned msgId_ResponseExpected, unsigned char argCnt, ...);
     MESSAGE_READ readPacket( ANT_Packet * packet, int packetSize, int wait_timeout );
+    //! Most UART bytes one readPacket() call takes (0 == no limit, the default). With a budget a frame cut short
+    //is kept for the next call and the rest of a frame is not waited for. See ANTScheduler.
+    void         setReadBudget( unsigned int bytes ) {read_budget = bytes;};
+    unsigned int getReadBytes() {return read_bytes;}; //!< Bytes taken by the last readPacket()
     
     void         printPacket(const ANT_Packet * packet, boolean final_carriage_return);
 
-    void sleep( boolean activate_sleep=true );
+#if defined(ANTPLUS_DEBUG)
+    //! Print the debug log (as text or raw records for a host tool). Call from idle time.
+    void         flushDebug( Print & out, boolean raw = false );
+#endif
+
+    //! UART sleep (SLEEP pin). Refused (false) while an RTS or a response is outstanding. send() wakes the module.
+    boolean sleep( boolean activate_sleep=true );
+    //! Lowest power -- the module closes its channels. Resuming restarts it and the registered channels are set up again.
     void suspend(boolean activate_suspend=true );
+    ANT_POWER_STATE getPowerState() {return power_state;};
+
+    //! How long the host can sleep before the next broadcast is due (less ANT_IDLE_GUARD_MS). 0 while a setup, RTS or response is outstanding.
+    unsigned long msUntilNextEvent();
+    //! Time the host spent asleep (e.g. after sleeping for msUntilNextEvent()). Counted in ANT_Stats::host_idle_ms.
+    void recordHostIdle( unsigned long idle_ms ) {stats.host_idle_ms += idle_ms;};
     
-    //Callback from the main code
+    //! RTS edge with the pin level. Called by the library interrupt (attached in begin()). Sets clear to send when RTS falls.
+    void   handleRtsEdge( boolean rts_high );
+    //! False if the RTS pin has no interrupt or ANTPLUS_MAX_INSTANCES are in use -- then call rTSHighAssertion() from loop()
+    boolean rtsInterruptAttached() {return (rts_isr_slot < ANTPLUS_MAX_INSTANCES);};
+
+    //Callback from the main code. Only needed when the library could not attach its own RTS interrupt.
     void   rTSHighAssertion();
 
     boolean awaitingResponseLastSent() {return (msgResponseExpected != MESG_INVALID_ID);};
 
+    //! Link health monitor. Detects a missing response or RTS and escalates through ANT_RECOVERY_STAGE.
+    //Called by readPacket() when nothing is waiting -- only call it yourself if you stop reading.
+    void poll();
+    ANT_RECOVERY_STAGE getRecoveryStage() {return recovery_stage;};
+    unsigned long msSinceLastRx() {return millis() - last_rx_ms;};
+    unsigned long msSinceLastRts();
+    unsigned long msSinceLastResponse() {return millis() - last_response_ms;};
+
+    //! Capabilities reported by the module (requested in progress_setup_channel()). False until they have been received.
+    boolean hasCapability( byte index, byte flag ) {return (capabilities_valid && (capabilities[index] & flag));};
+
     //!ANT+ to setup a channel
     ANT_CHANNEL_ESTABLISH progress_setup_channel( ANT_Channel * channel );
+    //! Several channels (up to ANT_DEVICE_NUMBER_CHANNELS) in search_priority order. An open waits while an earlier channel is still searching (ANT_OPEN_STAGGER_MS).
+    //Call every loop -- it also reopens closed channels. COMPLETE once every channel is, ERROR if any failed.
+    ANT_CHANNEL_ESTABLISH progress_setup_channels( ANT_Channel ** channel_list, byte count );
 
 #if defined(ANTPLUS_MSG_STR_DECODE)
-    static const char * get_msg_id_str(byte msg_id);
+    static const __FlashStringHelper * get_msg_id_str(byte msg_id); //!< Every MESG_*_ID in antmessage.h
+    static const __FlashStringHelper * get_response_code_str(byte code); //!< Response/event codes in antdefines.h
 #endif /*defined(ANTPLUS_MSG_STR_DECODE)*/
 
+#if defined(ANTPLUS_CAPTURE)
+    //! Record all UART traffic and RTS from now on (NULL to stop)
+    void     setCapture( ANTCapture * capture ) {this->capture = capture;};
+#endif
+
+    //! Copy the counters (with interrupts held off). Optionally zero them in the same step.
+    void     getStats( ANT_Stats * snapshot, boolean reset = false );
+    void     resetStats();
+    //! Rate of a counter over a snapshot window. e.g. stats_per_minute(&stats, stats.rx_channel_data[0])
+    static unsigned long stats_per_minute( const ANT_Stats * stats, unsigned long count );
+    //! Host awake time as a fraction of a snapshot window (1.0 if recordHostIdle() is never called)
+    static float awake_fraction( const ANT_Stats * stats );
+
     static int update_sdm_rollover( byte MessageValue, unsigned long int * Cumulative, byte * PreviousMessageValue );
 
+    static boolean get_extended_device_id( const ANT_Packet * packet, ANT_DeviceId * id, const byte ** payload = NULL );
+
+    //!Inclusion/exclusion lists (host copy). Push changes to the module with progress_sync_id_list().
+    static boolean id_list_add( ANT_IdList * list, const ANT_DeviceId * id );
+    static boolean id_list_remove( ANT_IdList * list, const ANT_DeviceId * id );
+    static void    id_list_clear( ANT_IdList * list );
+    static void    id_list_set_exclude( ANT_IdList * list, boolean exclude );
+    static boolean id_list_accepts( const ANT_IdList * list, const ANT_DeviceId * id );
+    //!Call until COMPLETE after changing the list of an established channel
+    ANT_CHANNEL_ESTABLISH progress_sync_id_list( ANT_Channel * channel );
+
+    //!Batch events on the module. Flushed when size_threshold bytes are buffered or time_threshold_10ms expires.
+    //Check hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS_3, CAPABILITIES_EVENT_BUFFERING_ENABLED) first. Returns as send().
+    boolean setEventBuffering( byte buffer_config, unsigned int size_threshold, unsigned int time_threshold_10ms );
+    //!Stop unwanted events (ANT_EVENT_FILTER_*) being sent to the host. Needs CAPABILITIES_EVENT_FILTERING_ENABLED. Returns as send().
+    boolean setEventFilter( unsigned int filter_mask );
+
+    //!Selective Data Update -- the module only forwards a data page when the masked bytes change.
+    //Store a mask, then select it for a channel and data page. Needs CAPABILITIES_SELECTIVE_DATA_UPDATE_ENABLED. Return as send().
+    boolean setSduMask( byte mask_number, const byte mask[ANT_STANDARD_DATA_PAYLOAD_SIZE] );
+    boolean configSdu( byte channel_number, byte data_page_number, byte mask_number );
+
   private:
     MESSAGE_READ      readPacketInternal( ANT_Packet * packet, int packetSize, unsigned int readTimeout);
+    boolean           acceptDataPacket( const ANT_Packet * packet );
+    void              handleChannelEvent( const ANT_Packet * packet );
+    void              learnPairing( ANT_Channel * channel, const ANT_DeviceId * id );
+    void              progress_pairing();
+    boolean           sendNextIdListMessage( ANT_Channel * channel );
     unsigned char     writeByte(unsigned char out, unsigned char chksum);
+    void              recordResponseLatency( unsigned long latency_us );
+#if defined(ANTPLUS_STATS_MSG_ID)
+    static void       countMsgId( unsigned int * counts, byte msg_id );
+#endif
+
+    void        attachRtsInterrupt();
+    void        resendLast();
+    void        softReset();
+    void        restoreChannels();
+    static void rts_isr( byte slot );
+    static void rts_isr_0();
+#if ANTPLUS_MAX_INSTANCES > 1
+    static void rts_isr_1();
+#endif
+#if ANTPLUS_MAX_INSTANCES > 2
+    static void rts_isr_2();
+#endif
+#if ANTPLUS_MAX_INSTANCES > 3
+    static void rts_isr_3();
+#endif
 
     static void serial_print_byte_padded_hex(byte value);
     static void serial_print_int_padded_dec(long int value, unsigned int width, boolean final_carriage_return = false);
+    static void print_byte_padded_hex(Print & out, byte value);
+    static void print_int_padded_dec(Print & out, long int value, unsigned int width, boolean final_carriage_return = false);
+
+#if defined(ANTPLUS_DEBUG)
+    void          logDebugText( byte type, const char * text );
+    void          putDebugLong( unsigned long value );
+    unsigned long getDebugLong();
+#endif
 
   private:
     Stream* mySerial; //!< Serial -- Software serial or Hardware serial
-
-  public: //TODO: Just temp (to eventually be removed -- or added to the interface properly)
-    long rx_packet_count;
-    long tx_packet_count;
-    long hw_reset_count;
+#if defined(ANTPLUS_CAPTURE)
+    ANTCapture * capture;
+#endif
+#if defined(ANTPLUS_DEBUG)
+    byte          debug_buffer[ANTPLUS_DEBUG_BUFFER_SIZE];
+    ANTRingBuffer debug_log;
+    boolean       debug_tx_logging; //!< send() is adding the frame to the log
+#endif
 
   private:
+    ANT_Stats stats;
+    boolean response_timed;          //!< response_sent_us is valid for msgResponseExpected
+    unsigned long response_sent_us;
+
     unsigned msgResponseExpected; //TODO: This should be an enum.....
+    byte msgSent;                    //!< To match MESG_RESPONSE_EVENT_ID against (it also carries channel events)
+    ANT_Channel * response_channel;  //!< Set up step waiting on the response (NULL for other requests)
+
+    unsigned long last_rx_ms;
+    volatile unsigned long last_rts_ms;
+    unsigned long last_response_ms;
+    unsigned long stall_ref_ms;      //!< Last send or recovery action -- stalls are timed from here
+    ANT_RECOVERY_STAGE recovery_stage;
+    byte recovery_resends;
+    unsigned long recovery_start_ms;
+    boolean tx_keep;                 //!< send() is copying the frame into last_tx
+    byte last_tx_len;
+    byte last_tx[ANT_HEALTH_LAST_TX_MAX]; //!< Last request (with a response expected) for ANT_RECOVERY_RESEND
+
+    boolean capabilities_valid;
+    ANT_RESET_STATE reset_state;
+    byte reset_reason;
+    unsigned long reset_ms; //!< When RESET was pulled low
+    unsigned long begin_ms;
+    ANT_BootTiming boot_timing;
+    byte capabilities[ANT_CAPABILITIES_LEN];
+
+    ANT_Channel * channels[ANT_DEVICE_NUMBER_CHANNELS]; //!< Registered at the start of progress_setup_channel()
     
     volatile boolean clear_to_send;
+
+    static ANTPLUS_THREAD_LOCAL ANTPlus * rts_isr_instances[ANTPLUS_MAX_INSTANCES]; //!< Per instance trampolines -- attachInterrupt() takes no argument
+    byte rts_isr_slot;
+    volatile boolean rts_high_seen;
+    volatile unsigned long rts_rise_us;
+    
+    unsigned long baud_rate;
+    unsigned int  next_byte_timeout_ms;
     
+    boolean rxIdle; //!< Last readPacket() found nothing (for ANT_Stats::rx_wakeups)
+    ANT_POWER_STATE power_state;
+    unsigned long power_state_ms; //!< Since when (module sleep/suspend time is added on a change or getStats())
+    void setPowerState( ANT_POWER_STATE state );
     int rxBufCnt;
+    unsigned char rxChksum;          //!< Of rxBuf so far -- kept with it when a frame spans calls
     unsigned char rxBuf[ANT_MAX_PACKET_LEN];
+    unsigned int read_budget;
+    unsigned int read_bytes;
 
     byte RTS_PIN;
     byte SUSPEND_PIN;
@@ -0,0 +1,95 @@
+//Copyright 2013 Brody Kenrick.
+//Cycle count profiling of the library hot paths
+
+#include "ANTProfile.h"
+
+#if defined(ANTPLUS_PROFILE)
+
+ANT_ProfileHistogram ANTProfile::histograms[ANT_PROFILE_POINTS];
+
+void ANTProfile::begin()
+{
+#if defined(ANTPLUS_PROFILE_TIMER1)
+  //Normal mode, no prescaler
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+#endif
+  reset();
+}
+
+void ANTProfile::reset()
+{
+  memset(histograms, 0, sizeof(histograms));
+}
+
+void ANTProfile::record( ANT_PROFILE_POINT point, ANT_ProfileCycles cycles )
+{
+  ANT_ProfileHistogram * histogram = &histograms[point];
+
+  //floor(log2(cycles)) -- 0 and 1 share the first bucket
+  byte bucket = 0;
+  ANT_ProfileCycles value = cycles;
+  while((value >>= 1) && (bucket < (ANT_PROFILE_BUCKETS - 1)))
+  {
+    bucket++;
+  }
+
+  if(histogram->buckets[bucket] != (unsigned int)~0U)
+  {
+    histogram->buckets[bucket]++;
+  }
+  histogram->count++;
+  histogram->total += cycles;
+  if(cycles > histogram->max)
+  {
+    histogram->max = cycles;
+  }
+}
+
+const char * ANTProfile::get_point_str( ANT_PROFILE_POINT point )
+{
+  switch(point)
+  {
+    case ANT_PROFILE_READ_PACKET:
+      return "READ_PACKET";
+    case ANT_PROFILE_FRAME_BYTE:
+      return "FRAME_BYTE";
+    case ANT_PROFILE_SEND:
+      return "SEND";
+    case ANT_PROFILE_DISPATCH:
+      return "DISPATCH";
+    case ANT_PROFILE_SETUP_CHANNEL:
+      return "SETUP_CHANNEL";
+    default:
+      return "...";
+  }
+}
+
+void ANTProfile::print( Print & out )
+{
+  for(byte point = 0; point < ANT_PROFILE_POINTS; point++)
+  {
+    const ANT_ProfileHistogram * histogram = &histograms[point];
+    out.print(get_point_str((ANT_PROFILE_POINT)point));
+    out.print(" n=");
+    out.print(histogram->count);
+    out.print(" mean=");
+    out.print(histogram->count ? (histogram->total / histogram->count) : 0);
+    out.print(" max=");
+    out.print((unsigned long)histogram->max);
+    for(byte bucket = 0; bucket < ANT_PROFILE_BUCKETS; bucket++)
+    {
+      if(histogram->buckets[bucket])
+      {
+        //<2^(n+1) cycles : count
+        out.print(" <2^");
+        out.print(bucket + 1);
+        out.print(":");
+        out.print(histogram->buckets[bucket]);
+      }
+    }
+    out.println();
+  }
+}
+
+#endif //defined(ANTPLUS_PROFILE)
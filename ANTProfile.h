@@ -0,0 +1,106 @@
+//Copyright 2013 Brody Kenrick.
+//Cycle count profiling of the library hot paths (enable ANTPLUS_PROFILE in ANTPlus.h)
+
+//Each hook times a scope and adds it to a log2 histogram for its point:
+// bucket n holds [2^n, 2^(n+1)) cycles, the last bucket is open ended.
+//With ANTPLUS_PROFILE disabled the hooks are empty and nothing here is compiled in.
+
+//Cycle sources
+// AVR   : Timer1 run free at the CPU clock (ANTProfile::begin() takes it over -- no PWM on its pins). Wraps every 65536 cycles.
+// x86   : rdtsc
+// Linux : clock_gettime(CLOCK_MONOTONIC) in ns
+// Other : micros()
+//Define ANTPLUS_PROFILE_CYCLES() next to ANTPLUS_PROFILE to use another source.
+
+#ifndef ANTProfile_h
+#define ANTProfile_h
+
+#include "ANTPlus.h"
+
+//! See ANTProfile::get_point_str()
+typedef enum
+{
+  ANT_PROFILE_READ_PACKET,    //!< readPacketInternal() -- a whole call including waiting
+  ANT_PROFILE_FRAME_BYTE,     //!< The framer for one received byte
+  ANT_PROFILE_SEND,           //!< send() including the UART writes
+  ANT_PROFILE_DISPATCH,       //!< readPacket() handling of a complete packet (capabilities, response matching, filters)
+  ANT_PROFILE_SETUP_CHANNEL,  //!< progress_setup_channel()
+  ANT_PROFILE_POINTS
+} ANT_PROFILE_POINT;
+
+#define ANT_PROFILE_BUCKETS (16)
+
+#if defined(ANTPLUS_PROFILE)
+
+#if !defined(ANTPLUS_PROFILE_CYCLES)
+#if defined(__AVR__)
+typedef uint16_t ANT_ProfileCycles;
+#define ANTPLUS_PROFILE_CYCLES() ((ANT_ProfileCycles)TCNT1)
+#define ANTPLUS_PROFILE_TIMER1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+typedef uint32_t ANT_ProfileCycles;
+#define ANTPLUS_PROFILE_CYCLES() ((ANT_ProfileCycles)__rdtsc())
+#elif defined(__linux__)
+#include <time.h>
+typedef uint32_t ANT_ProfileCycles;
+static inline ANT_ProfileCycles antplus_profile_clock() {struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts); return (ANT_ProfileCycles)((ts.tv_sec * 1000000000UL) + ts.tv_nsec);}
+#define ANTPLUS_PROFILE_CYCLES() (antplus_profile_clock())
+#else
+typedef uint32_t ANT_ProfileCycles;
+#define ANTPLUS_PROFILE_CYCLES() ((ANT_ProfileCycles)micros())
+#endif
+#else
+typedef uint32_t ANT_ProfileCycles;
+#endif //!defined(ANTPLUS_PROFILE_CYCLES)
+
+//! Histogram of one profiling point
+typedef struct ANT_ProfileHistogram_struct
+{
+   unsigned long count;
+   unsigned long total;                     //!< Mean is total / count (wraps on long runs -- reset() between measurements)
+   ANT_ProfileCycles max;
+   unsigned int buckets[ANT_PROFILE_BUCKETS]; //!< Saturate
+} ANT_ProfileHistogram;
+
+
+class ANTProfile
+{
+  public:
+    //! Starts the cycle counter where one has to be set up (AVR Timer1)
+    static void begin();
+    static void reset();
+
+    static void record( ANT_PROFILE_POINT point, ANT_ProfileCycles cycles );
+    static const ANT_ProfileHistogram * get( ANT_PROFILE_POINT point ) {return &histograms[point];};
+
+    static const char * get_point_str( ANT_PROFILE_POINT point );
+    //! One line per point: count, mean, max and the non-empty buckets
+    static void print( Print & out );
+
+  private:
+    static ANT_ProfileHistogram histograms[ANT_PROFILE_POINTS];
+};
+
+
+//! Records the time from construction to the end of the enclosing scope
+class ANTProfileScope
+{
+  public:
+    ANTProfileScope( ANT_PROFILE_POINT point ) : point(point), start(ANTPLUS_PROFILE_CYCLES()) {};
+    ~ANTProfileScope() {ANTProfile::record(point, (ANT_ProfileCycles)(ANTPLUS_PROFILE_CYCLES() - start));};
+
+  private:
+    ANT_PROFILE_POINT point;
+    ANT_ProfileCycles start;
+};
+
+#define ANTPLUS_PROFILE_SCOPE(point) ANTProfileScope antplus_profile_scope(point)
+
+#else
+
+#define ANTPLUS_PROFILE_SCOPE(point)
+
+#endif //defined(ANTPLUS_PROFILE)
+
+#endif //ANTProfile_h
@@ -0,0 +1,32 @@
+//Copyright 2013 Brody Kenrick.
+//Byte ring buffer over caller supplied storage (used by ANTCapture)
+
+#ifndef ANTRingBuffer_h
+#define ANTRingBuffer_h
+
+#include <Arduino.h>
+
+//Indices run freely and are masked on access so full and empty are told apart without a spare byte.
+//One writer and one reader. If either side is an ISR take the other side's calls with interrupts held off.
+class ANTRingBuffer
+{
+  public:
+    //! size must be a power of two
+    ANTRingBuffer( byte * buffer, unsigned int size ) : buffer(buffer), mask(size - 1), head(0), tail(0) {};
+
+    unsigned int available() const {return (unsigned int)(head - tail);};
+    unsigned int space() const {return (mask + 1) - available();};
+    void         clear() {head = tail = 0;};
+
+    void put( byte value ) {buffer[head & mask] = value; head++;}; //!< Check space() first
+    int  get() {if(head == tail) return -1; byte value = buffer[tail & mask]; tail++; return value;};
+    int  peek() const {return (head == tail) ? -1 : buffer[tail & mask];};
+
+  private:
+    byte * buffer;
+    unsigned int mask;
+    volatile unsigned int head;
+    volatile unsigned int tail;
+};
+
+#endif //ANTRingBuffer_h
@@ -0,0 +1,104 @@
+//Copyright 2013 Brody Kenrick.
+//Round robin poll scheduler for several ANTPlus instances (see ANTScheduler.h)
+
+#include "ANTScheduler.h"
+
+ANTScheduler::ANTScheduler( unsigned int byte_budget )
+{
+  memset(modules, 0, sizeof(modules));
+  module_count = 0;
+  first = 0;
+  this->byte_budget = byte_budget;
+  handler = NULL;
+  context = NULL;
+}
+
+boolean ANTScheduler::add( ANTPlus * antplus, ANT_Channel ** channel_list, byte channel_count )
+{
+  if(module_count >= ANT_SCHEDULER_MAX_MODULES)
+  {
+    return false;
+  }
+  ANT_SchedulerModule * module = &modules[module_count++];
+  module->antplus = antplus;
+  module->channel_list = channel_list;
+  module->channel_count = channel_count;
+  module->establish = channel_count ? ANT_CHANNEL_ESTABLISH_PROGRESSING : ANT_CHANNEL_ESTABLISH_COMPLETE;
+  return true;
+}
+
+unsigned int ANTScheduler::poll()
+{
+  unsigned int packets = 0;
+  for(byte i = 0; i < module_count; i++)
+  {
+    packets += turn((first + i) % module_count);
+  }
+  if(module_count)
+  {
+    first = (first + 1) % module_count;
+  }
+  return packets;
+}
+
+unsigned int ANTScheduler::turn( byte index )
+{
+  ANT_SchedulerModule * module = &modules[index];
+  ANTPlus * antplus = module->antplus;
+  byte packet_buffer[ANT_MAX_PACKET_LEN];
+  ANT_Packet * packet = (ANT_Packet *) packet_buffer;
+  unsigned int packets = 0;
+  unsigned int left = byte_budget;
+
+  module->stats.turns++;
+  while(true)
+  {
+    antplus->setReadBudget(left);
+    MESSAGE_READ ret_val = antplus->readPacket(packet, ANT_MAX_PACKET_LEN, 0);
+    unsigned int taken = antplus->getReadBytes();
+    module->stats.bytes += taken;
+    if((ret_val == MESSAGE_READ_EXPECTED) || (ret_val == MESSAGE_READ_OTHER))
+    {
+      packets++;
+      if(handler)
+      {
+        handler(index, antplus, packet, context);
+      }
+    }
+    if(byte_budget)
+    {
+      left = (taken < left) ? (left - taken) : 0;
+      if(left == 0)
+      {
+        //Possibly mid-frame -- readPacket() returned NONE and keeps the rest for the next turn
+        module->stats.budget_used_up++;
+        break;
+      }
+    }
+    if(ret_val == MESSAGE_READ_NONE)
+    {
+      break;
+    }
+  }
+  //Other users of readPacket() get the whole UART
+  antplus->setReadBudget(0);
+  module->stats.packets += packets;
+
+  if(module->channel_count)
+  {
+    module->establish = antplus->progress_setup_channels(module->channel_list, module->channel_count);
+  }
+  return packets;
+}
+
+ANT_CHANNEL_ESTABLISH ANTScheduler::channelsEstablished()
+{
+  for(byte i = 0; i < module_count; i++)
+  {
+    if(modules[i].establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+    {
+      return modules[i].establish;
+    }
+  }
+  return ANT_CHANNEL_ESTABLISH_COMPLETE;
+}
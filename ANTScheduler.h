@@ -0,0 +1,74 @@
+//Copyright 2013 Brody Kenrick.
+//Round robin poll scheduler for several ANTPlus instances (one nRF24AP2 each)
+
+//Each module takes a turn of reading up to byte_budget UART bytes (ANTPlus::setReadBudget()) and then
+// progresses its channel list. A frame cut off at the end of a turn is finished on the module's next turn,
+// so a busy module (e.g. a scan mode receiver) cannot hold the loop while the others' UART buffers fill.
+//The module that goes first moves on by one each round.
+//Raise ANTPLUS_MAX_INSTANCES to the number of modules so each gets its own RTS interrupt.
+
+#ifndef ANTScheduler_h
+#define ANTScheduler_h
+
+#include "ANTPlus.h"
+
+#if !defined(ANT_SCHEDULER_MAX_MODULES)
+#define ANT_SCHEDULER_MAX_MODULES  (ANTPLUS_MAX_INSTANCES)
+#endif
+#define ANT_SCHEDULER_BYTE_BUDGET  (32)  //!< Default bytes per module per turn -- about two broadcasts with extended data
+
+//! Packets (MESSAGE_READ_EXPECTED or MESSAGE_READ_OTHER) with the index of the module they came from
+typedef void (*ANT_SchedulerHandler)( byte module, ANTPlus * antplus, const ANT_Packet * packet, void * context );
+
+//! Per module counters
+typedef struct ANT_SchedulerStats_struct
+{
+   unsigned long turns;
+   unsigned long bytes;
+   unsigned long packets;
+   unsigned long budget_used_up;  //!< Turns that ended on the budget rather than an empty UART (backlog)
+} ANT_SchedulerStats;
+
+class ANTScheduler
+{
+  public:
+    //! A byte_budget of 0 reads each module until its UART is empty (and waits for the rest of a frame)
+    ANTScheduler( unsigned int byte_budget = ANT_SCHEDULER_BYTE_BUDGET );
+
+    //! The module index is the order added. channel_list (optional) is passed to progress_setup_channels() each turn.
+    //False if ANT_SCHEDULER_MAX_MODULES are already added.
+    boolean add( ANTPlus * antplus, ANT_Channel ** channel_list = NULL, byte channel_count = 0 );
+    void    setHandler( ANT_SchedulerHandler handler, void * context = NULL ) {this->handler = handler; this->context = context;};
+    void    setByteBudget( unsigned int byte_budget ) {this->byte_budget = byte_budget;};
+
+    //! One round -- a turn for every module. Call from loop(). Returns the packets handed to the handler.
+    unsigned int poll();
+
+    byte      count() {return module_count;};
+    ANTPlus * module( byte index ) {return (index < module_count) ? modules[index].antplus : NULL;};
+    const ANT_SchedulerStats * getStats( byte index ) {return (index < module_count) ? &modules[index].stats : NULL;};
+    //! ANT_CHANNEL_ESTABLISH_COMPLETE once every module's channel list is
+    ANT_CHANNEL_ESTABLISH channelsEstablished();
+
+  private:
+    unsigned int turn( byte index );
+
+  private:
+    typedef struct ANT_SchedulerModule_struct
+    {
+       ANTPlus * antplus;
+       ANT_Channel ** channel_list;
+       byte channel_count;
+       ANT_CHANNEL_ESTABLISH establish;
+       ANT_SchedulerStats stats;
+    } ANT_SchedulerModule;
+
+    ANT_SchedulerModule modules[ANT_SCHEDULER_MAX_MODULES];
+    byte module_count;
+    byte first;                        //!< Goes first in the next round
+    unsigned int byte_budget;
+    ANT_SchedulerHandler handler;
+    void * context;
+};
+
+#endif //ANTScheduler_h
@@ -0,0 +1,331 @@
+//Generated by extras/gen_antnames.py from antmessage.h and antdefines.h -- do not edit.
+//Tables are sorted by code for a binary search. Included by ANTPlus.cpp only.
+
+#ifndef antnames_h
+#define antnames_h
+
+static const byte ant_msg_name_codes[] PROGMEM =
+{
+  0x00, //INVALID
+  0x01, //EVENT
+  0x3E, //VERSION
+  0x40, //RESPONSE_EVENT
+  0x41, //UNASSIGN_CHANNEL
+  0x42, //ASSIGN_CHANNEL
+  0x43, //CHANNEL_MESG_PERIOD
+  0x44, //CHANNEL_SEARCH_TIMEOUT
+  0x45, //CHANNEL_RADIO_FREQ
+  0x46, //NETWORK_KEY
+  0x47, //RADIO_TX_POWER
+  0x48, //RADIO_CW_MODE
+  0x4A, //SYSTEM_RESET
+  0x4B, //OPEN_CHANNEL
+  0x4C, //CLOSE_CHANNEL
+  0x4D, //REQUEST
+  0x4E, //BROADCAST_DATA
+  0x4F, //ACKNOWLEDGED_DATA
+  0x50, //BURST_DATA
+  0x51, //CHANNEL_ID
+  0x52, //CHANNEL_STATUS
+  0x53, //RADIO_CW_INIT
+  0x54, //CAPABILITIES
+  0x55, //STACKLIMIT
+  0x56, //SCRIPT_DATA
+  0x57, //SCRIPT_CMD
+  0x59, //ID_LIST_ADD
+  0x5A, //ID_LIST_CONFIG
+  0x5B, //OPEN_RX_SCAN
+  0x5C, //EXT_CHANNEL_RADIO_FREQ
+  0x5D, //EXT_BROADCAST_DATA
+  0x5E, //EXT_ACKNOWLEDGED_DATA
+  0x5F, //EXT_BURST_DATA
+  0x60, //CHANNEL_RADIO_TX_POWER
+  0x61, //GET_SERIAL_NUM
+  0x62, //GET_TEMP_CAL
+  0x63, //SET_LP_SEARCH_TIMEOUT
+  0x64, //SET_TX_SEARCH_ON_NEXT
+  0x65, //SERIAL_NUM_SET_CHANNEL_ID
+  0x66, //RX_EXT_MESGS_ENABLE
+  0x67, //RADIO_CONFIG_ALWAYS
+  0x68, //ENABLE_LED_FLASH
+  0x6D, //XTAL_ENABLE
+  0x6E, //ANTLIB_CONFIG
+  0x6F, //STARTUP_MESG
+  0x70, //AUTO_FREQ_CONFIG
+  0x71, //PROX_SEARCH_CONFIG
+  0x72, //ADV_BURST_DATA
+  0x74, //EVENT_BUFFERING_CONFIG
+  0x75, //SET_SEARCH_CH_PRIORITY
+  0x77, //HIGH_DUTY_SEARCH_MODE
+  0x78, //CONFIG_ADV_BURST
+  0x79, //EVENT_FILTER_CONFIG
+  0x7A, //SDU_CONFIG
+  0x7B, //SDU_SET_MASK
+  0x7C, //USER_CONFIG_PAGE
+  0x7D, //ENCRYPT_ENABLE
+  0x7E, //SET_CRYPTO_KEY
+  0x7F, //SET_CRYPTO_INFO
+  0x80, //CUBE_CMD
+  0x81, //ACTIVE_SEARCH_SHARING
+  0x83, //NVM_CRYPTO_KEY_OPS
+  0x8D, //GET_PIN_DIODE_CONTROL
+  0x8E, //PIN_DIODE_CONTROL
+  0x8F, //FIT1_SET_AGC
+  0x90, //SET_CHANNEL_INPUT_MASK
+  0x91, //FIT1_SET_EQUIP_STATE
+  0x92, //READ_PINS_FOR_SECT
+  0x93, //TIMER_SELECT
+  0x94, //ATOD_SETTINGS
+  0x95, //SET_SHARED_ADDRESS
+  0x96, //ATOD_EXTERNAL_ENABLE
+  0x97, //ATOD_PIN_SETUP
+  0x98, //SETUP_ALARM
+  0x99, //ALARM_VARIABLE_MODIFY_TEST
+  0x9A, //PARTIAL_RESET
+  0x9B, //OVERWRITE_TEMP_CAL
+  0x9C, //SERIAL_PASSTHRU_SETTINGS
+  0xAA, //BIST
+  0xAD, //UNLOCK_INTERFACE
+  0xAE, //SERIAL_ERROR
+  0xAF, //SET_ID_STRING
+  0xB4, //PORT_GET_IO_STATE
+  0xB5, //PORT_SET_IO_STATE
+  0xC0, //RSSI
+  0xC1, //RSSI_BROADCAST_DATA
+  0xC2, //RSSI_ACKNOWLEDGED_DATA
+  0xC3, //RSSI_BURST_DATA
+  0xC4, //RSSI_SEARCH_THRESHOLD
+  0xC5, //SLEEP
+  0xC6, //GET_GRMN_ESN
+  0xC7, //SET_USB_INFO
+  0xC8, //HCI_COMMAND_COMPLETE
+  0xE0, //EXT_ID_0
+  0xE1, //EXT_ID_1
+  0xE2, //EXT_ID_2
+};
+
+static const char ant_msg_name_text[] PROGMEM =
+  "INVALID\0"
+  "EVENT\0"
+  "VERSION\0"
+  "RESPONSE_EVENT\0"
+  "UNASSIGN_CHANNEL\0"
+  "ASSIGN_CHANNEL\0"
+  "CHANNEL_MESG_PERIOD\0"
+  "CHANNEL_SEARCH_TIMEOUT\0"
+  "CHANNEL_RADIO_FREQ\0"
+  "NETWORK_KEY\0"
+  "RADIO_TX_POWER\0"
+  "RADIO_CW_MODE\0"
+  "SYSTEM_RESET\0"
+  "OPEN_CHANNEL\0"
+  "CLOSE_CHANNEL\0"
+  "REQUEST\0"
+  "BROADCAST_DATA\0"
+  "ACKNOWLEDGED_DATA\0"
+  "BURST_DATA\0"
+  "CHANNEL_ID\0"
+  "CHANNEL_STATUS\0"
+  "RADIO_CW_INIT\0"
+  "CAPABILITIES\0"
+  "STACKLIMIT\0"
+  "SCRIPT_DATA\0"
+  "SCRIPT_CMD\0"
+  "ID_LIST_ADD\0"
+  "ID_LIST_CONFIG\0"
+  "OPEN_RX_SCAN\0"
+  "EXT_CHANNEL_RADIO_FREQ\0"
+  "EXT_BROADCAST_DATA\0"
+  "EXT_ACKNOWLEDGED_DATA\0"
+  "EXT_BURST_DATA\0"
+  "CHANNEL_RADIO_TX_POWER\0"
+  "GET_SERIAL_NUM\0"
+  "GET_TEMP_CAL\0"
+  "SET_LP_SEARCH_TIMEOUT\0"
+  "SET_TX_SEARCH_ON_NEXT\0"
+  "SERIAL_NUM_SET_CHANNEL_ID\0"
+  "RX_EXT_MESGS_ENABLE\0"
+  "RADIO_CONFIG_ALWAYS\0"
+  "ENABLE_LED_FLASH\0"
+  "XTAL_ENABLE\0"
+  "ANTLIB_CONFIG\0"
+  "STARTUP_MESG\0"
+  "AUTO_FREQ_CONFIG\0"
+  "PROX_SEARCH_CONFIG\0"
+  "ADV_BURST_DATA\0"
+  "EVENT_BUFFERING_CONFIG\0"
+  "SET_SEARCH_CH_PRIORITY\0"
+  "HIGH_DUTY_SEARCH_MODE\0"
+  "CONFIG_ADV_BURST\0"
+  "EVENT_FILTER_CONFIG\0"
+  "SDU_CONFIG\0"
+  "SDU_SET_MASK\0"
+  "USER_CONFIG_PAGE\0"
+  "ENCRYPT_ENABLE\0"
+  "SET_CRYPTO_KEY\0"
+  "SET_CRYPTO_INFO\0"
+  "CUBE_CMD\0"
+  "ACTIVE_SEARCH_SHARING\0"
+  "NVM_CRYPTO_KEY_OPS\0"
+  "GET_PIN_DIODE_CONTROL\0"
+  "PIN_DIODE_CONTROL\0"
+  "FIT1_SET_AGC\0"
+  "SET_CHANNEL_INPUT_MASK\0"
+  "FIT1_SET_EQUIP_STATE\0"
+  "READ_PINS_FOR_SECT\0"
+  "TIMER_SELECT\0"
+  "ATOD_SETTINGS\0"
+  "SET_SHARED_ADDRESS\0"
+  "ATOD_EXTERNAL_ENABLE\0"
+  "ATOD_PIN_SETUP\0"
+  "SETUP_ALARM\0"
+  "ALARM_VARIABLE_MODIFY_TEST\0"
+  "PARTIAL_RESET\0"
+  "OVERWRITE_TEMP_CAL\0"
+  "SERIAL_PASSTHRU_SETTINGS\0"
+  "BIST\0"
+  "UNLOCK_INTERFACE\0"
+  "SERIAL_ERROR\0"
+  "SET_ID_STRING\0"
+  "PORT_GET_IO_STATE\0"
+  "PORT_SET_IO_STATE\0"
+  "RSSI\0"
+  "RSSI_BROADCAST_DATA\0"
+  "RSSI_ACKNOWLEDGED_DATA\0"
+  "RSSI_BURST_DATA\0"
+  "RSSI_SEARCH_THRESHOLD\0"
+  "SLEEP\0"
+  "GET_GRMN_ESN\0"
+  "SET_USB_INFO\0"
+  "HCI_COMMAND_COMPLETE\0"
+  "EXT_ID_0\0"
+  "EXT_ID_1\0"
+  "EXT_ID_2\0"
+;
+
+static const uint16_t ant_msg_name_offsets[] PROGMEM =
+{
+  0, 8, 14, 22, 37, 54, 69, 89,
+  112, 131, 143, 158, 172, 185, 198, 212,
+  220, 235, 253, 264, 275, 290, 304, 317,
+  328, 340, 351, 363, 378, 391, 414, 433,
+  455, 470, 493, 508, 521, 543, 565, 591,
+  611, 631, 648, 660, 674, 687, 704, 723,
+  738, 761, 784, 806, 823, 843, 854, 867,
+  884, 899, 914, 930, 939, 961, 980, 1002,
+  1020, 1033, 1056, 1077, 1096, 1109, 1123, 1142,
+  1163, 1178, 1190, 1217, 1231, 1250, 1275, 1280,
+  1297, 1310, 1324, 1342, 1360, 1365, 1385, 1408,
+  1424, 1446, 1452, 1465, 1478, 1499, 1508, 1517,
+};
+
+#define ANT_MSG_NAME_COUNT (96)
+
+static const byte ant_response_name_codes[] PROGMEM =
+{
+  0x00, //RESPONSE_NO_ERROR
+  0x01, //EVENT_RX_SEARCH_TIMEOUT
+  0x02, //EVENT_RX_FAIL
+  0x03, //EVENT_TX
+  0x04, //EVENT_TRANSFER_RX_FAILED
+  0x05, //EVENT_TRANSFER_TX_COMPLETED
+  0x06, //EVENT_TRANSFER_TX_FAILED
+  0x07, //EVENT_CHANNEL_CLOSED
+  0x08, //EVENT_RX_FAIL_GO_TO_SEARCH
+  0x09, //EVENT_CHANNEL_COLLISION
+  0x0A, //EVENT_TRANSFER_TX_START
+  0x0F, //EVENT_CHANNEL_ACTIVE
+  0x11, //EVENT_TRANSFER_TX_NEXT_MESSAGE
+  0x15, //CHANNEL_IN_WRONG_STATE
+  0x16, //CHANNEL_NOT_OPENED
+  0x18, //CHANNEL_ID_NOT_SET
+  0x19, //CLOSE_ALL_CHANNELS
+  0x1F, //TRANSFER_IN_PROGRESS
+  0x20, //TRANSFER_SEQUENCE_NUMBER_ERROR
+  0x21, //TRANSFER_IN_ERROR
+  0x22, //TRANSFER_BUSY
+  0x26, //INVALID_MESSAGE_CRC
+  0x27, //MESSAGE_SIZE_EXCEEDS_LIMIT
+  0x28, //INVALID_MESSAGE
+  0x29, //INVALID_NETWORK_NUMBER
+  0x30, //INVALID_LIST_ID
+  0x31, //INVALID_SCAN_TX_CHANNEL
+  0x33, //INVALID_PARAMETER_PROVIDED
+  0x34, //EVENT_SERIAL_QUE_OVERFLOW
+  0x35, //EVENT_QUE_OVERFLOW
+  0x36, //EVENT_CLK_ERROR
+  0x37, //EVENT_STATE_OVERRUN
+  0x38, //EVENT_ENCRYPT_NEGOTIATION_SUCCESS
+  0x39, //EVENT_ENCRYPT_NEGOTIATION_FAIL
+  0x40, //SCRIPT_FULL_ERROR
+  0x41, //SCRIPT_WRITE_ERROR
+  0x42, //SCRIPT_INVALID_PAGE_ERROR
+  0x43, //SCRIPT_LOCKED_ERROR
+  0x50, //NO_RESPONSE_MESSAGE
+  0x51, //RETURN_TO_MFG
+  0x60, //FIT_ACTIVE_SEARCH_TIMEOUT
+  0x61, //FIT_WATCH_PAIR
+  0x62, //FIT_WATCH_UNPAIR
+  0x70, //USB_STRING_WRITE_FAIL
+};
+
+static const char ant_response_name_text[] PROGMEM =
+  "RESPONSE_NO_ERROR\0"
+  "EVENT_RX_SEARCH_TIMEOUT\0"
+  "EVENT_RX_FAIL\0"
+  "EVENT_TX\0"
+  "EVENT_TRANSFER_RX_FAILED\0"
+  "EVENT_TRANSFER_TX_COMPLETED\0"
+  "EVENT_TRANSFER_TX_FAILED\0"
+  "EVENT_CHANNEL_CLOSED\0"
+  "EVENT_RX_FAIL_GO_TO_SEARCH\0"
+  "EVENT_CHANNEL_COLLISION\0"
+  "EVENT_TRANSFER_TX_START\0"
+  "EVENT_CHANNEL_ACTIVE\0"
+  "EVENT_TRANSFER_TX_NEXT_MESSAGE\0"
+  "CHANNEL_IN_WRONG_STATE\0"
+  "CHANNEL_NOT_OPENED\0"
+  "CHANNEL_ID_NOT_SET\0"
+  "CLOSE_ALL_CHANNELS\0"
+  "TRANSFER_IN_PROGRESS\0"
+  "TRANSFER_SEQUENCE_NUMBER_ERROR\0"
+  "TRANSFER_IN_ERROR\0"
+  "TRANSFER_BUSY\0"
+  "INVALID_MESSAGE_CRC\0"
+  "MESSAGE_SIZE_EXCEEDS_LIMIT\0"
+  "INVALID_MESSAGE\0"
+  "INVALID_NETWORK_NUMBER\0"
+  "INVALID_LIST_ID\0"
+  "INVALID_SCAN_TX_CHANNEL\0"
+  "INVALID_PARAMETER_PROVIDED\0"
+  "EVENT_SERIAL_QUE_OVERFLOW\0"
+  "EVENT_QUE_OVERFLOW\0"
+  "EVENT_CLK_ERROR\0"
+  "EVENT_STATE_OVERRUN\0"
+  "EVENT_ENCRYPT_NEGOTIATION_SUCCESS\0"
+  "EVENT_ENCRYPT_NEGOTIATION_FAIL\0"
+  "SCRIPT_FULL_ERROR\0"
+  "SCRIPT_WRITE_ERROR\0"
+  "SCRIPT_INVALID_PAGE_ERROR\0"
+  "SCRIPT_LOCKED_ERROR\0"
+  "NO_RESPONSE_MESSAGE\0"
+  "RETURN_TO_MFG\0"
+  "FIT_ACTIVE_SEARCH_TIMEOUT\0"
+  "FIT_WATCH_PAIR\0"
+  "FIT_WATCH_UNPAIR\0"
+  "USB_STRING_WRITE_FAIL\0"
+;
+
+static const uint16_t ant_response_name_offsets[] PROGMEM =
+{
+  0, 18, 42, 56, 65, 90, 118, 143,
+  164, 191, 215, 239, 260, 291, 314, 333,
+  352, 371, 392, 423, 441, 455, 475, 502,
+  518, 541, 557, 581, 608, 634, 653, 669,
+  689, 723, 754, 772, 791, 817, 837, 857,
+  871, 897, 912, 929,
+};
+
+#define ANT_RESPONSE_NAME_COUNT (44)
+
+#endif //antnames_h
@@ -157,8 +157,8 @@ static ANT_Channel fitness_channel =
 	DEVCE_TYPE_FITNESS_EQUIPMENT,
 	DEVCE_SENSOR_FREQ,
 	DEVCE_FITNESS_LOWEST_RATE,
-	0x06, //device number MSB
-	0x00, //device number LSB
+	0x00, //device number MSB
+	0x06, //device number LSB
 	ANT_SENSOR_NETWORK_KEY,
 	ANT_CHANNEL_ESTABLISH_PROGRESSING,
 	FALSE,
@@ -166,8 +166,6 @@ static ANT_Channel fitness_channel =
 	0, //state_counter
 };
 
-volatile int rts_ant_received = 0; //!< ANT RTS interrupt flag see isr_rts_ant()
-
 //Globals for Power measurement 
 Bike_Trainer_with_Power Trainer_Data;
 int testpower;
@@ -180,16 +178,6 @@ unsigned long last_time_ms;
 //Requested data
 boolean flagged_for_Send_Page54 = false;
 
-// **************************************************************************************************
-// *********************************  ISRs  *********************************************************
-// **************************************************************************************************
-
-//! Interrupt service routine to get RTS from ANT messages
-void isr_rts_ant()
-{
-	rts_ant_received = 1;
-}
-
 // **************************************************************************************************
 // ***********************************  ANT+  *******************************************************
 // **************************************************************************************************
@@ -427,7 +415,6 @@ void Send_Page54()
 // **************************************************************************************************
 void setup()
 {
-	delay(2000);
 #if defined(USE_SERIAL_CONSOLE)
 	Serial.begin(115200); 
 #endif //defined(USE_SERIAL_CONSOLE)
@@ -437,9 +424,7 @@ void setup()
 
 	SERIAL_DEBUG_PRINTLN_F("ANT+ Config.");
 
-	//We setup an interrupt to detect when the RTS is received from the ANT chip.
-	//This is a 50 usec HIGH signal at the end of each valid ANT message received from the host at the chip
-	attachInterrupt(digitalPinToInterrupt(RTS_PIN), isr_rts_ant, RISING);
+	//ANTPlus attaches its own interrupt to RTS_PIN in begin() (clear to send on the falling edge)
 
 
 #if defined(ANTPLUS_ON_HW_UART)
@@ -481,14 +466,6 @@ void loop()
 	ANT_Packet * packet = (ANT_Packet *) packet_buffer;
 	MESSAGE_READ ret_val = MESSAGE_READ_NONE;
 
-	if(rts_ant_received == 1)
-	{
-		SERIAL_DEBUG_PRINTLN_F("Received RTS Interrupt. ");
-		antplus.rTSHighAssertion();
-		//Clear the ISR flag
-		rts_ant_received = 0;
-	}
-
 	//Read messages until we get a none
 	while( (ret_val = antplus.readPacket(packet, ANT_MAX_PACKET_LEN, 0 )) != MESSAGE_READ_NONE )
 	{
@@ -0,0 +1,158 @@
+/* Example for the ANT+ Library @ https://github.com/brodykenrick/ANTPlus_Arduino
+Copyright 2013 Brody Kenrick.
+
+Interfacing of Garmin ANT+ device (via a cheap Nordic nRF24AP UART module) to an Arduino.
+
+Opens the radio in continuous scan mode and tracks every HRM in range (e.g. a gym or studio).
+Each HRM is told apart by its extended data device ID and kept in an ANTDeviceTable.
+Prints the table of device numbers and computed heart rates once a second.
+
+NOTE: Needs ANTPLUS_SCAN_MODE enabled in ANTPlus.h (the receive buffer must hold the extended data).
+
+Hardware
+An Arduino Pro Mini 3v3 connected to this nRF24AP2 module : http://www.goodluckbuy.com/nrf24ap2-networking-module-zigbee-module-with-ant-transceiver-.html
+Wiring is the same as the ANTPlus_HearRateMonitor example.
+*/
+
+#include <Arduino.h>
+
+#include <SoftwareSerial.h>
+
+#include <ANTPlus.h>
+#include <ANTDeviceTable.h>
+
+#if !defined(ANTPLUS_SCAN_MODE)
+#error "Enable ANTPLUS_SCAN_MODE in ANTPlus.h for this example"
+#endif
+
+#define ANTPLUS_BAUD_RATE (9600) //!< The module I am using is hardcoded to this baud rate.
+
+#define PRINT_PERIOD_MS   (1000)
+
+//The ANT+ network keys are not allowed to be published so they are stripped from here.
+//They are available in the ANT+ docs at thisisant.com
+//#define ANT_SENSOR_NETWORK_KEY {0xb9, 0xa5, 0x21, 0xfb, 0xbd, 0x72, 0xc3, 0x45}
+
+#if !defined( ANT_SENSOR_NETWORK_KEY )
+#error "The Network Keys are missing. Better go find them by signing up at thisisant.com"
+#endif
+
+// ****************************************************************************
+// ******************************  GLOBALS  ***********************************
+// ****************************************************************************
+
+static const int RTS_PIN      = 2; //!< RTS on the nRF24AP2 module
+
+static const int TX_PIN       = 8; //Using software serial for the UART
+static const int RX_PIN       = 9; //Ditto
+static SoftwareSerial ant_serial(TX_PIN, RX_PIN); // RXArd, TXArd -- Arduino is opposite to nRF24AP2 module
+
+static ANTPlus        antplus   = ANTPlus(RTS_PIN, 3/*SUSPEND*/, 4/*SLEEP*/, 5/*RESET*/ );
+
+static ANTDeviceTable hrm_table;
+
+//Scan mode is always on channel 0. Device number 0/0 -- any HRM.
+static ANT_Channel scan_channel =
+{
+  0, //Channel Number
+  PUBLIC_NETWORK,
+  0, //Network Number
+  DEVCE_TIMEOUT,
+  DEVCE_TYPE_HRM,
+  DEVCE_SENSOR_FREQ,
+  DEVCE_HRM_LOWEST_RATE,
+  0, //device number MSB
+  0, //device number LSB
+  ANT_SENSOR_NETWORK_KEY,
+  ANT_CHANNEL_ESTABLISH_PROGRESSING,
+  FALSE,
+  0, //state_counter
+  TRUE, //scan_mode
+};
+
+unsigned long last_print_ms = 0;
+
+// **************************************************************************************************
+// ***********************************  ANT+  *******************************************************
+// **************************************************************************************************
+
+void print_table()
+{
+  Serial.print(F("HRMs in range: "));
+  Serial.println(hrm_table.count());
+  for(unsigned int slot = 0; slot < ANT_DEVICE_TABLE_SIZE; slot++)
+  {
+    const ANT_DeviceEntry * entry = hrm_table.entry(slot);
+    if(entry)
+    {
+      ANT_DeviceId id;
+      ANTDeviceTable::get_device_id(entry, &id);
+      const ANT_HRMDataPage * hrm_dp = (const ANT_HRMDataPage *) entry->data;
+      Serial.print(F("  #"));
+      Serial.print(id.device_number);
+      Serial.print(F(" BPM = "));
+      Serial.print(hrm_dp->computed_heart_rate);
+      Serial.print(F(" age(ms) = "));
+      Serial.println(millis() - entry->last_seen_ms);
+    }
+  }
+}
+
+// **************************************************************************************************
+// ************************************  Setup  *****************************************************
+// **************************************************************************************************
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println(F("ANTPlus HRM Scanner!"));
+
+  //ANTPlus attaches its own interrupt to RTS_PIN in begin() (clear to send on the falling edge)
+
+  ant_serial.begin( ANTPLUS_BAUD_RATE );
+  antplus.begin( ant_serial );
+}
+
+// **************************************************************************************************
+// ************************************  Loop *******************************************************
+// **************************************************************************************************
+
+void loop()
+{
+  byte packet_buffer[ANT_MAX_PACKET_LEN];
+  ANT_Packet * packet = (ANT_Packet *) packet_buffer;
+  MESSAGE_READ ret_val = MESSAGE_READ_NONE;
+
+  //Read messages until we get a none
+  while( (ret_val = antplus.readPacket(packet, ANT_MAX_PACKET_LEN, 0 )) != MESSAGE_READ_NONE )
+  {
+    if((ret_val == MESSAGE_READ_EXPECTED) || (ret_val == MESSAGE_READ_OTHER))
+    {
+      //Non-HRM devices are ignored
+      ANT_DeviceId id;
+      if(ANTPlus::get_extended_device_id(packet, &id) && ((id.device_type & ~ANT_ID_DEVICE_TYPE_PAIRING_FLAG) == DEVCE_TYPE_HRM))
+      {
+        hrm_table.update(packet, millis());
+      }
+    }
+    else
+    if((ret_val != MESSAGE_READ_ERROR_MISSING_SYNC) && (ret_val != MESSAGE_READ_ERROR_BAD_CHECKSUM))
+    {
+      break;
+    }
+  }
+
+  if(scan_channel.channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+  {
+    antplus.progress_setup_channel( &scan_channel );
+    if(scan_channel.channel_establish == ANT_CHANNEL_ESTABLISH_ERROR)
+    {
+      Serial.println(F("Scan mode - ERROR!"));
+    }
+  }
+
+  if((millis() - last_print_ms) >= PRINT_PERIOD_MS)
+  {
+    last_print_ms = millis();
+    print_table();
+  }
+}
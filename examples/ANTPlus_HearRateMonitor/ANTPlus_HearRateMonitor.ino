@@ -33,6 +33,7 @@ Wiring to the Arduino Pro Mini 3v3 can be seen in 'antplus' below.
 #endif
 
 #include <ANTPlus.h>
+#include <ANTPairing.h>
 
 
 #define USE_SERIAL_CONSOLE //!<Use the hardware serial as the console. This needs to be off if using hardware serial for driving the ANT+ module.
@@ -91,7 +92,6 @@ Wiring to the Arduino Pro Mini 3v3 can be seen in 'antplus' below.
 
 //Arduino Pro Mini pins to the nrf24AP2 modules pinouts
 static const int RTS_PIN      = 2; //!< RTS on the nRF24AP2 module
-static const int RTS_PIN_INT  = 0; //!< The interrupt equivalent of the RTS_PIN
 
 
 #if !defined(ANTPLUS_ON_HW_UART)
@@ -109,27 +109,44 @@ static ANT_Channel hrm_channel =
 {
   0, //Channel Number
   PUBLIC_NETWORK,
+  0, //Network Number
   DEVCE_TIMEOUT,
   DEVCE_TYPE_HRM,
   DEVCE_SENSOR_FREQ,
   DEVCE_HRM_LOWEST_RATE,
+  0, //device number MSB
+  0, //device number LSB
   ANT_SENSOR_NETWORK_KEY,
   ANT_CHANNEL_ESTABLISH_PROGRESSING,
   FALSE,
   0, //state_counter
 };
 
-volatile int rts_ant_received = 0; //!< ANT RTS interrupt flag see isr_rts_ant()
+#define USE_IDLE_SLEEP //!< Sleep the module UART and the MCU (idle mode) until the next HRM broadcast is due
 
-// **************************************************************************************************
-// *********************************  ISRs  *********************************************************
-// **************************************************************************************************
+#if defined(USE_IDLE_SLEEP) && defined(__AVR__)
+#include <avr/sleep.h>
+#endif
 
-//! Interrupt service routine to get RTS from ANT messages
-void isr_rts_ant()
-{
-  rts_ant_received = 1;
-}
+#define USE_PAIRING //!< Remember the HRM that is found (EEPROM) and open with its ID on the next start instead of a wildcard search
+
+#if !defined(ANTPLUS_PAIRING_EEPROM)
+#undef USE_PAIRING //EEPROM store is AVR only
+#endif
+
+#if defined(USE_PAIRING)
+static ANTPairingEEPROM pairing_store( 0 /*EEPROM address*/ );
+static boolean acquire_reported = false;
+#endif
+
+#define USE_SDU //!< Ask the module to only pass on HRM pages when the beat count/heart rate changes (if it supports Selective Data Update)
+
+#if defined(USE_SDU)
+//HRMs repeat a page ~4 times per beat. Only compare the heart beat count and computed heart rate bytes.
+static const byte hrm_sdu_mask[ANT_STANDARD_DATA_PAYLOAD_SIZE] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF};
+static const byte hrm_sdu_pages[] = {DATA_PAGE_HEART_RATE_0, DATA_PAGE_HEART_RATE_0ALT, DATA_PAGE_HEART_RATE_4, DATA_PAGE_HEART_RATE_4ALT};
+static int sdu_step = 0; //!< 0 == set mask, then one step per page
+#endif
 
 // **************************************************************************************************
 // ***********************************  ANT+  *******************************************************
@@ -157,6 +174,23 @@ void process_packet( ANT_Packet * packet )
       if( broadcast->channel_number == hrm_channel.channel_number )
       {
         hrm_channel.data_rx = true;
+#if defined(USE_PAIRING)
+        if(!acquire_reported && (hrm_channel.acquire_ms != 0))
+        {
+          //Compare a cold (wildcard) search with the next start
+          acquire_reported = true;
+          if(hrm_channel.paired_open)
+          {
+            SERIAL_DEBUG_PRINT_F( "Paired HRM" );
+          }
+          else
+          {
+            SERIAL_DEBUG_PRINT_F( "Searched HRM" );
+          }
+          SERIAL_DEBUG_PRINT_F( " acquired in (ms) " );
+          SERIAL_DEBUG_PRINTLN( hrm_channel.acquire_ms );
+        }
+#endif
         //To determine the device type -- and the data pages -- check channel setups
         if(hrm_channel.device_type == DEVCE_TYPE_HRM)
         {
@@ -214,9 +248,12 @@ void setup()
 
   SERIAL_DEBUG_PRINTLN_F("ANT+ Config.");
 
-  //We setup an interrupt to detect when the RTS is received from the ANT chip.
-  //This is a 50 usec HIGH signal at the end of each valid ANT message received from the host at the chip
-  attachInterrupt(RTS_PIN_INT, isr_rts_ant, RISING);
+#if defined(USE_PAIRING)
+  hrm_channel.pairing = &pairing_store;
+  hrm_channel.pairing_slot = 0;
+#endif
+
+  //ANTPlus attaches its own interrupt to RTS_PIN in begin() (clear to send on the falling edge)
 
 
 #if defined(ANTPLUS_ON_HW_UART)
@@ -243,14 +280,6 @@ void loop()
   ANT_Packet * packet = (ANT_Packet *) packet_buffer;
   MESSAGE_READ ret_val = MESSAGE_READ_NONE;
   
-  if(rts_ant_received == 1)
-  {
-    SERIAL_DEBUG_PRINTLN_F("Received RTS Interrupt. ");
-    antplus.rTSHighAssertion();
-    //Clear the ISR flag
-    rts_ant_received = 0;
-  }
-
   //Read messages until we get a none
   while( (ret_val = antplus.readPacket(packet, ANT_MAX_PACKET_LEN, 0 )) != MESSAGE_READ_NONE )
   {
@@ -296,6 +325,8 @@ void loop()
     {
       SERIAL_DEBUG_PRINT( hrm_channel.channel_number );
       SERIAL_DEBUG_PRINTLN_F( " - Established." );
+      SERIAL_DEBUG_PRINT_F( "Boot to open (ms) " );
+      SERIAL_DEBUG_PRINTLN( antplus.getBootTiming()->first_open_ms );
     }
     else
     if(hrm_channel.channel_establish == ANT_CHANNEL_ESTABLISH_PROGRESSING)
@@ -309,5 +340,45 @@ void loop()
       SERIAL_DEBUG_PRINTLN_F( " - ERROR!" );
     }
   }
+#if defined(USE_SDU)
+  else
+  if( (sdu_step <= (int)sizeof(hrm_sdu_pages))
+      && antplus.hasCapability(ANT_CAPABILITIES_ADVANCED_OPTIONS_3, CAPABILITIES_SELECTIVE_DATA_UPDATE_ENABLED) )
+  {
+    //One message per loop -- each waits for its response like the channel setup
+    boolean sent_ok;
+    if(sdu_step == 0)
+    {
+      sent_ok = antplus.setSduMask( 0, hrm_sdu_mask );
+    }
+    else
+    {
+      sent_ok = antplus.configSdu( hrm_channel.channel_number, hrm_sdu_pages[sdu_step - 1], 0 );
+    }
+    if(sent_ok)
+    {
+      sdu_step++;
+    }
+  }
+#endif //defined(USE_SDU)
+
+#if defined(USE_IDLE_SLEEP) && defined(__AVR__)
+  unsigned long idle_ms = antplus.msUntilNextEvent();
+  if((idle_ms != 0) && antplus.sleep(true))
+  {
+    //Timer 0 (millis()), RTS and the UART still wake the MCU -- back to sleep until the broadcast is due
+    unsigned long idle_start_ms = millis();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+#if defined(ANTPLUS_ON_HW_UART)
+    while(((millis() - idle_start_ms) < idle_ms) && !Serial.available())
+#else
+    while(((millis() - idle_start_ms) < idle_ms) && !ant_serial.available())
+#endif
+    {
+      sleep_mode();
+    }
+    antplus.recordHostIdle(millis() - idle_start_ms);
+  }
+#endif //defined(USE_IDLE_SLEEP) && defined(__AVR__)
 }
 
@@ -109,29 +109,19 @@ static ANT_Channel hrm_channel =
 {
   0, //Channel Number
   PUBLIC_NETWORK,
+  0, //Network Number
   DEVCE_TIMEOUT,
   DEVCE_TYPE_HRM,
   DEVCE_SENSOR_FREQ,
   DEVCE_HRM_LOWEST_RATE,
+  0, //device number MSB
+  0, //device number LSB
   ANT_SENSOR_NETWORK_KEY,
   ANT_CHANNEL_ESTABLISH_PROGRESSING,
   FALSE,
   0, //state_counter
 };
 
-volatile int rts_ant_received = 0; //!< ANT RTS interrupt flag see isr_rts_ant()
-
-// **************************************************************************************************
-// *********************************  ISRs  *********************************************************
-// **************************************************************************************************
-
-//! Interrupt service routine to get RTS from ANT messages
-void isr_rts_ant()
-{
-  rts_ant_received = 1;
-  Serial.println("ISR_ANT");
-}
-
 // **************************************************************************************************
 // ***********************************  ANT+  *******************************************************
 // **************************************************************************************************
@@ -201,6 +191,14 @@ void process_packet( ANT_Packet * packet )
 
 
 
+#if defined(ANTPLUS_ON_HW_UART)
+//! Called by beginAutoBaud() for each rate it tries
+void set_ant_baud_rate( unsigned long baud_rate )
+{
+  Serial1.begin( baud_rate );
+}
+#endif
+
 // **************************************************************************************************
 // ************************************  Setup  *****************************************************
 // **************************************************************************************************
@@ -215,15 +213,13 @@ void setup()
 
   SERIAL_DEBUG_PRINTLN_F("ANT+ Config.");
 
-  //We setup an interrupt to detect when the RTS is received from the ANT chip.
-  //This is a 50 usec HIGH signal at the end of each valid ANT message received from the host at the chip
-  attachInterrupt(RTS_PIN_INT, isr_rts_ant, RISING);
+  //ANTPlus attaches its own interrupt to RTS_PIN in begin() (clear to send on the falling edge)
 
 
 #if defined(ANTPLUS_ON_HW_UART)
   //Using hardware UART
-  Serial1.begin(ANTPLUS_BAUD_RATE); 
-  antplus.begin( Serial1 );
+  //The module's baud rate pins decide the rate -- find it
+  antplus.beginAutoBaud( Serial1, set_ant_baud_rate );
 #else
   //Using soft serial
   ant_serial.begin( ANTPLUS_BAUD_RATE ); 
@@ -244,14 +240,6 @@ void loop()
   ANT_Packet * packet = (ANT_Packet *) packet_buffer;
   MESSAGE_READ ret_val = MESSAGE_READ_NONE;
   
-  if(rts_ant_received == 1)
-  {
-    SERIAL_DEBUG_PRINTLN_F("Received RTS Interrupt. ");
-    antplus.rTSHighAssertion();
-    //Clear the ISR flag
-    rts_ant_received = 0;
-  }
-
   //Read messages until we get a none
   while( (ret_val = antplus.readPacket(packet, ANT_MAX_PACKET_LEN, 0 )) != MESSAGE_READ_NONE )
   {
@@ -0,0 +1,72 @@
+#!/usr/bin/env python
+# Copyright 2013 Brody Kenrick.
+# Generates antnames.h -- flash resident name tables for ANTPlus::get_msg_id_str()
+# and ANTPlus::get_response_code_str() from antmessage.h and antdefines.h.
+#
+# Usage (from the library directory): python extras/gen_antnames.py > antnames.h
+
+import re
+import sys
+
+DEFINE = re.compile(r'^#define\s+(\w+)\s+\(\(UCHAR\)\s*0x([0-9A-Fa-f]{2})\)')
+
+
+def section(path, start, end):
+    """(name, value) for the UCHAR defines between two marker lines. The first name for a value wins."""
+    seen = {}
+    inside = False
+    for line in open(path):
+        if start in line:
+            inside = True
+            continue
+        if inside and end in line:
+            break
+        match = DEFINE.match(line) if inside else None
+        if match and int(match.group(2), 16) not in seen:
+            seen[int(match.group(2), 16)] = match.group(1)
+    return sorted(seen.items())
+
+
+def msg_name(name):
+    name = re.sub(r'^MESG_', '', name)
+    return re.sub(r'_ID$', '', name)
+
+
+def table(out, prefix, entries):
+    out.write('static const byte %s_codes[] PROGMEM =\n{\n' % prefix)
+    for value, name in entries:
+        out.write('  0x%02X, //%s\n' % (value, name))
+    out.write('};\n\n')
+
+    # One string blob and offsets -- no per-string pointer table
+    offsets = []
+    offset = 0
+    out.write('static const char %s_text[] PROGMEM =\n' % prefix)
+    for value, name in entries:
+        offsets.append(offset)
+        offset += len(name) + 1
+        out.write('  "%s\\0"\n' % name)
+    out.write(';\n\n')
+
+    out.write('static const uint16_t %s_offsets[] PROGMEM =\n{\n' % prefix)
+    for i in range(0, len(offsets), 8):
+        out.write('  ' + ', '.join('%d' % o for o in offsets[i:i + 8]) + ',\n')
+    out.write('};\n\n')
+    out.write('#define %s_COUNT (%d)\n\n' % (prefix.upper(), len(entries)))
+
+
+def main():
+    messages = [(v, msg_name(n)) for v, n in section('antmessage.h', "// Message ID's", 'USHORT')]
+    codes = section('antdefines.h', '// Response / Event Codes', 'INTERNAL_ONLY_EVENTS')
+
+    out = sys.stdout
+    out.write('//Generated by extras/gen_antnames.py from antmessage.h and antdefines.h -- do not edit.\n')
+    out.write('//Tables are sorted by code for a binary search. Included by ANTPlus.cpp only.\n\n')
+    out.write('#ifndef antnames_h\n#define antnames_h\n\n')
+    table(out, 'ant_msg_name', messages)
+    table(out, 'ant_response_name', codes)
+    out.write('#endif //antnames_h\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,480 @@
+//Copyright 2013 Brody Kenrick.
+//Multithreaded gateway for Linux hosts (see ANTGateway.h)
+
+#include "ANTGateway.h"
+#include "ANTMetricsShm.h"
+
+#include <sched.h>
+#include <time.h>
+
+#define DECODER_IDLE_YIELDS (4) //!< sched_yield()s before a decoder sleeps
+
+unsigned long long ANTGateway::now_ns()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((unsigned long long)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+static void idle_sleep_us( unsigned long us )
+{
+  struct timespec sleep_time;
+  sleep_time.tv_sec = 0;
+  sleep_time.tv_nsec = us * 1000L;
+  nanosleep(&sleep_time, NULL);
+}
+
+
+Stream * ANTGatewayPosixPort::open()
+{
+  host_set_real_time(true);
+  if(!port.open(path, baud_rate))
+  {
+    return NULL;
+  }
+  port.setRtsPin(ANT_GATEWAY_RTS_PIN, rts_mode);
+  port.setResetPin(ANT_GATEWAY_RESET_PIN, reset_mode);
+  return &port;
+}
+
+
+ANTGateway::ANTGateway()
+{
+  memset(modules, 0, sizeof(modules));
+  module_count = 0;
+  memset(decoders, 0, sizeof(decoders));
+  decoder_count = 0;
+  memset(subscribers, 0, sizeof(subscribers));
+  subscriber_count = 0;
+  publisher = NULL;
+  running = false;
+  decoding = false;
+}
+
+ANTGateway::~ANTGateway()
+{
+  stop();
+  for(byte i = 0; i < module_count; i++)
+  {
+    delete modules[i];
+  }
+  for(byte i = 0; i < subscriber_count; i++)
+  {
+    delete subscribers[i];
+  }
+}
+
+boolean ANTGateway::addModule( ANTGatewayPort * port, ANT_Channel ** channel_list, byte channel_count )
+{
+  if(running || (module_count >= ANT_GATEWAY_MAX_MODULES))
+  {
+    return false;
+  }
+  //Queues are too big for a thread stack or to copy
+  Module * module = new Module();
+  module->gateway = this;
+  module->index = module_count;
+  module->port = port;
+  module->channel_list = channel_list;
+  module->channel_count = channel_count;
+  memset(module->device_type, 0, sizeof(module->device_type));
+  for(byte i = 0; i < channel_count; i++)
+  {
+    if(channel_list[i]->channel_number < ANT_DEVICE_NUMBER_CHANNELS)
+    {
+      module->device_type[channel_list[i]->channel_number] = channel_list[i]->device_type;
+    }
+  }
+  memset(&module->stats, 0, sizeof(module->stats));
+  memset(module->decode_state, 0, sizeof(module->decode_state));
+  modules[module_count++] = module;
+  return true;
+}
+
+int ANTGateway::subscribe( ANT_GATEWAY_FULL full )
+{
+  if(running || (subscriber_count >= ANT_GATEWAY_MAX_SUBSCRIBERS))
+  {
+    return -1;
+  }
+  Subscriber * subscriber = new Subscriber();
+  subscriber->full = full;
+  memset(&subscriber->stats, 0, sizeof(subscriber->stats));
+  subscribers[subscriber_count] = subscriber;
+  return subscriber_count++;
+}
+
+boolean ANTGateway::start( byte decoders )
+{
+  if(running || (decoders == 0) || (decoders > ANT_GATEWAY_MAX_DECODERS))
+  {
+    return false;
+  }
+  __atomic_store_n(&running, true, __ATOMIC_RELEASE);
+  __atomic_store_n(&decoding, true, __ATOMIC_RELEASE);
+  decoder_count = decoders;
+  for(byte i = 0; i < decoder_count; i++)
+  {
+    this->decoders[i].gateway = this;
+    this->decoders[i].index = i;
+    memset(&this->decoders[i].stats, 0, sizeof(this->decoders[i].stats));
+    pthread_create(&this->decoders[i].thread, NULL, decoder_thread, &this->decoders[i]);
+  }
+  for(byte i = 0; i < module_count; i++)
+  {
+    pthread_create(&modules[i]->thread, NULL, reader_thread, modules[i]);
+  }
+  return true;
+}
+
+void ANTGateway::stop()
+{
+  if(!running)
+  {
+    return;
+  }
+  __atomic_store_n(&running, false, __ATOMIC_RELEASE);
+  //Readers first -- the decoders take what is left
+  for(byte i = 0; i < module_count; i++)
+  {
+    pthread_join(modules[i]->thread, NULL);
+  }
+  __atomic_store_n(&decoding, false, __ATOMIC_RELEASE);
+  for(byte i = 0; i < decoder_count; i++)
+  {
+    pthread_join(decoders[i].thread, NULL);
+  }
+}
+
+boolean ANTGateway::pop( int subscriber, ANT_GatewayMetric * metric )
+{
+  return (subscriber >= 0) && (subscriber < subscriber_count) && subscribers[subscriber]->metrics.pop(metric);
+}
+
+
+//Readers
+
+void * ANTGateway::reader_thread( void * module )
+{
+  Module * m = (Module *)module;
+  m->gateway->read(m);
+  return NULL;
+}
+
+void ANTGateway::read( Module * module )
+{
+  //A new thread is a board just powered up (clock at 0, pins low)
+  Stream * serial = module->port->open();
+  if(!serial)
+  {
+    __atomic_store_n(&module->stats.failed, true, __ATOMIC_RELEASE);
+    return;
+  }
+  ANTPlus antplus(ANT_GATEWAY_RTS_PIN, ANT_GATEWAY_SUSPEND_PIN, ANT_GATEWAY_SLEEP_PIN, ANT_GATEWAY_RESET_PIN);
+  antplus.begin(*serial);
+  antplus.setReadBudget(ANT_GATEWAY_READ_BUDGET);
+
+  byte packet_buffer[ANT_MAX_PACKET_LEN];
+  ANT_Packet * packet = (ANT_Packet *) packet_buffer;
+  ANT_GatewayFrame frame;
+  frame.module = module->index;
+  boolean established = false;
+  boolean rts_seen_high = false;
+
+  while(isRunning())
+  {
+    MESSAGE_READ ret_val;
+    while((ret_val = antplus.readPacket(packet, ANT_MAX_PACKET_LEN, 0)) != MESSAGE_READ_NONE)
+    {
+      if((ret_val != MESSAGE_READ_EXPECTED) && (ret_val != MESSAGE_READ_OTHER))
+      {
+        continue;
+      }
+      count(&module->stats.packets);
+      if(((packet->msg_id == MESG_BROADCAST_DATA_ID) || (packet->msg_id == MESG_ACKNOWLEDGED_DATA_ID))
+         && (packet->length >= (1 + ANT_STANDARD_DATA_PAYLOAD_SIZE)))
+      {
+        frame.received_ns = now_ns();
+        frame.msg_id = packet->msg_id;
+        frame.channel_number = packet->data[0] & CHANNEL_NUMBER_MASK;
+        memcpy(frame.payload, &packet->data[1], ANT_STANDARD_DATA_PAYLOAD_SIZE);
+        count(&module->stats.frames);
+        if(!module->frames.push(frame))
+        {
+          //Never wait -- the module UART would overflow instead
+          count(&module->stats.dropped);
+        }
+      }
+    }
+    if(!established)
+    {
+      established = (antplus.progress_setup_channels(module->channel_list, module->channel_count) == ANT_CHANNEL_ESTABLISH_COMPLETE);
+      __atomic_store_n(&module->stats.established, established, __ATOMIC_RELEASE);
+    }
+    if(!antplus.rtsInterruptAttached())
+    {
+      //No RTS interrupt (a port whose RTS pin has none) -- follow the pin. Only a fall after a rise is the module
+      // ready for the next message; a pulse over between two passes is caught by poll() as a missed RTS.
+      if(digitalRead(ANT_GATEWAY_RTS_PIN) == HIGH)
+      {
+        rts_seen_high = true;
+      }
+      else
+      if(rts_seen_high)
+      {
+        rts_seen_high = false;
+        antplus.rTSHighAssertion();
+      }
+    }
+    module->port->wait();
+  }
+  antplus.end();
+  module->port->close();
+}
+
+boolean ANTGateway::established()
+{
+  for(byte i = 0; i < module_count; i++)
+  {
+    if(!__atomic_load_n(&modules[i]->stats.established, __ATOMIC_ACQUIRE))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+//Decoders
+
+void * ANTGateway::decoder_thread( void * decoder )
+{
+  Decoder * d = (Decoder *)decoder;
+  d->gateway->decodeFrames(d);
+  return NULL;
+}
+
+void ANTGateway::decodeFrames( Decoder * decoder )
+{
+  unsigned int idle = 0;
+  while(true)
+  {
+    //Read before the queues so the last frames in are still taken after stop()
+    boolean stopping = !isDecoding();
+    boolean any = false;
+    for(byte i = decoder->index; i < module_count; i += decoder_count)
+    {
+      Module * module = modules[i];
+      ANT_GatewayFrame frame;
+      while(module->frames.pop(&frame))
+      {
+        any = true;
+        count(&decoder->stats.frames);
+        byte channel_number = (frame.channel_number < ANT_DEVICE_NUMBER_CHANNELS) ? frame.channel_number : 0;
+        byte metrics[2];
+        long values[2];
+        byte decoded = decode(module->device_type[channel_number], frame.payload, &module->decode_state[channel_number], metrics, values);
+        if(decoded == 0)
+        {
+          count(&decoder->stats.undecoded);
+        }
+        for(byte m = 0; m < decoded; m++)
+        {
+          ANT_GatewayMetric metric;
+          metric.received_ns = frame.received_ns;
+          metric.value = values[m];
+          metric.module = frame.module;
+          metric.channel_number = frame.channel_number;
+          metric.metric = metrics[m];
+          count(&decoder->stats.metrics);
+          if(publisher)
+          {
+            //This decoder is the only writer of the module's slots
+            publisher->publish(metric.module, metric.channel_number, metric.metric, metric.value, metric.received_ns);
+          }
+          for(byte s = 0; s < subscriber_count; s++)
+          {
+            deliver(decoder, s, &metric);
+          }
+        }
+      }
+    }
+    if(any)
+    {
+      idle = 0;
+    }
+    else
+    if(stopping)
+    {
+      break;
+    }
+    else
+    if(idle++ < DECODER_IDLE_YIELDS)
+    {
+      sched_yield();
+    }
+    else
+    {
+      idle_sleep_us(ANT_GATEWAY_IDLE_US);
+    }
+  }
+}
+
+void ANTGateway::deliver( Decoder * decoder, byte subscriber, const ANT_GatewayMetric * metric )
+{
+  Subscriber * s = subscribers[subscriber];
+  while(!s->metrics.push(*metric))
+  {
+    if((s->full == ANT_GATEWAY_FULL_DROP) || !isDecoding())
+    {
+      count(&s->stats.dropped);
+      return;
+    }
+    //Backpressure -- this decoder's readers fill up behind it
+    count(&decoder->stats.waits);
+    sched_yield();
+  }
+  count(&s->stats.delivered);
+}
+
+
+//! Page to metrics by device type. Anything not understood (or marked invalid) gives nothing.
+byte ANTGateway::decode( byte device_type, const byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE], ANT_GatewayDecodeState * state,
+                         byte metrics[2], long values[2] )
+{
+  byte decoded = 0;
+  byte page = payload[0];
+  switch(device_type)
+  {
+    case DEVCE_TYPE_HRM:
+      //Every page ends with the computed heart rate (the top bit of the page number is the toggle)
+      metrics[decoded] = ANT_METRIC_HEART_RATE;
+      values[decoded++] = payload[7];
+      break;
+
+    case DEVCE_TYPE_POWER:
+      if((page == DATA_PAGE_POWER_POWER_ONLY) || (page == DATA_PAGE_POWER_WHEEL_TORQUE))
+      {
+        if(payload[3] != 0xFF)
+        {
+          metrics[decoded] = ANT_METRIC_CADENCE;
+          values[decoded++] = payload[3];
+        }
+        if(page == DATA_PAGE_POWER_POWER_ONLY)
+        {
+          metrics[decoded] = ANT_METRIC_POWER;
+          values[decoded++] = payload[6] | (payload[7] << 8);
+        }
+      }
+      break;
+
+    case DEVCE_TYPE_FITNESS_EQUIPMENT:
+      switch(page)
+      {
+        case DATA_PAGE_SPECIFIC_TRAINER_DATA_PAGE:
+          if(payload[2] != 0xFF)
+          {
+            metrics[decoded] = ANT_METRIC_CADENCE;
+            values[decoded++] = payload[2];
+          }
+          metrics[decoded] = ANT_METRIC_POWER;
+          values[decoded++] = payload[5] | ((payload[6] & 0x0F) << 8);
+          break;
+        case GENERAL_FE_DATA_PAGE:
+          if(payload[6] != 0xFF)
+          {
+            metrics[decoded] = ANT_METRIC_HEART_RATE;
+            values[decoded++] = payload[6];
+          }
+          break;
+        case DATA_PAGE_FITNESS_BASIC_RESISTANCE:
+          metrics[decoded] = ANT_METRIC_FE_RESISTANCE;
+          values[decoded++] = payload[7];
+          break;
+        case DATA_PAGE_FITNESS_TARGET_POWER:
+          metrics[decoded] = ANT_METRIC_FE_TARGET_POWER;
+          values[decoded++] = payload[6] | (payload[7] << 8);
+          break;
+        case DATA_PAGE_TRACK_RESISTANCE:
+          if((payload[5] != 0xFF) || (payload[6] != 0xFF))
+          {
+            //0.01 % from -200.00 %
+            metrics[decoded] = ANT_METRIC_FE_GRADE;
+            values[decoded++] = (long)(payload[5] | (payload[6] << 8)) - 20000L;
+          }
+          break;
+      }
+      break;
+
+    case DEVCE_TYPE_SPEED_AND_CADENCE:
+      //Event time (1/1024 s) and revolution count -- cadence is the change since the last page
+      if(state->valid)
+      {
+        unsigned int time_delta = (unsigned int)((payload[0] | (payload[1] << 8)) - (state->last[0] | (state->last[1] << 8))) & 0xFFFF;
+        unsigned int revolutions = (unsigned int)((payload[2] | (payload[3] << 8)) - (state->last[2] | (state->last[3] << 8))) & 0xFFFF;
+        if(time_delta)
+        {
+          metrics[decoded] = ANT_METRIC_CADENCE;
+          values[decoded++] = (long)(((unsigned long)revolutions * 1024UL * 60UL) / time_delta);
+        }
+      }
+      if(!state->valid || (decoded != 0))
+      {
+        //Held while the event time does not move so the next change is measured from the last event
+        memcpy(state->last, payload, ANT_STANDARD_DATA_PAYLOAD_SIZE);
+        state->valid = true;
+      }
+      break;
+
+    case DEVCE_TYPE_SDM:
+      if(page == DATA_PAGE_SPEED_DISTANCE_2)
+      {
+        //Strides a minute
+        metrics[decoded] = ANT_METRIC_CADENCE;
+        values[decoded++] = payload[3];
+      }
+      break;
+  }
+  return decoded;
+}
+
+
+//Stats
+
+void ANTGateway::getReaderStats( byte module, ANT_GatewayReaderStats * stats )
+{
+  memset(stats, 0, sizeof(*stats));
+  if(module < module_count)
+  {
+    ANT_GatewayReaderStats * from = &modules[module]->stats;
+    stats->frames      = __atomic_load_n(&from->frames, __ATOMIC_RELAXED);
+    stats->dropped     = __atomic_load_n(&from->dropped, __ATOMIC_RELAXED);
+    stats->packets     = __atomic_load_n(&from->packets, __ATOMIC_RELAXED);
+    stats->established = __atomic_load_n(&from->established, __ATOMIC_ACQUIRE);
+    stats->failed      = __atomic_load_n(&from->failed, __ATOMIC_ACQUIRE);
+  }
+}
+
+void ANTGateway::getDecoderStats( byte decoder, ANT_GatewayDecoderStats * stats )
+{
+  memset(stats, 0, sizeof(*stats));
+  if(decoder < decoder_count)
+  {
+    ANT_GatewayDecoderStats * from = &decoders[decoder].stats;
+    stats->frames    = __atomic_load_n(&from->frames, __ATOMIC_RELAXED);
+    stats->metrics   = __atomic_load_n(&from->metrics, __ATOMIC_RELAXED);
+    stats->undecoded = __atomic_load_n(&from->undecoded, __ATOMIC_RELAXED);
+    stats->waits     = __atomic_load_n(&from->waits, __ATOMIC_RELAXED);
+  }
+}
+
+void ANTGateway::getSubscriberStats( int subscriber, ANT_GatewaySubscriberStats * stats )
+{
+  memset(stats, 0, sizeof(*stats));
+  if((subscriber >= 0) && (subscriber < subscriber_count))
+  {
+    ANT_GatewaySubscriberStats * from = &subscribers[subscriber]->stats;
+    stats->delivered = __atomic_load_n(&from->delivered, __ATOMIC_RELAXED);
+    stats->dropped   = __atomic_load_n(&from->dropped, __ATOMIC_RELAXED);
+  }
+}
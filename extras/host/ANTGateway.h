@@ -0,0 +1,229 @@
+//Copyright 2013 Brody Kenrick.
+//Multithreaded gateway for Linux hosts -- a reader thread per module, a decoder pool and subscribers
+
+//Pipeline
+// reader     -- one thread per module. Owns the module's port and ANTPlus (readPacket() is the framer) and sets its
+//               channels up. Data frames are stamped and pushed onto the reader's own queue (ANTSpscQueue).
+//               A reader never waits on the rest of the pipeline: with its queue full the frame is dropped and counted.
+// decoder    -- a pool of threads. Each module is served by one decoder (module % decoders) so a channel's frames
+//               stay in order and the per channel decode state has a single owner. Pages are decoded to metrics
+//               (heart rate, power, cadence, FE targets) and pushed to every subscriber (ANTMpscQueue), and
+//               written to the latest values in shared memory with setPublisher().
+// subscriber -- takes metrics with pop() from a thread of its own. When its queue is full either the metric is
+//               dropped and counted (ANT_GATEWAY_FULL_DROP) or the decoder waits for room (ANT_GATEWAY_FULL_WAIT) --
+//               backpressure that ends with the readers dropping frames rather than stalling.
+//
+//Each thread is a board of its own (host clock, pins and interrupts -- see Arduino.h) so every module is wired the
+// same. The RTS interrupt slots are per thread on the host too, so every reader has the library RTS interrupt.
+
+#ifndef ANTGateway_h
+#define ANTGateway_h
+
+#include <Arduino.h>
+#include <pthread.h>
+
+#include "ANTPlus.h"
+#include "ANTQueue.h"
+#include "ANTPosixSerial.h"
+
+class ANTMetricsShm;
+
+#define ANT_GATEWAY_MAX_MODULES      (16)
+#define ANT_GATEWAY_MAX_DECODERS     (8)
+#define ANT_GATEWAY_MAX_SUBSCRIBERS  (8)
+#define ANT_GATEWAY_FRAME_QUEUE      (256)   //!< Frames per reader (power of two)
+#define ANT_GATEWAY_METRIC_QUEUE     (1024)  //!< Metrics per subscriber (power of two)
+#define ANT_GATEWAY_READ_BUDGET      (64)    //!< UART bytes per readPacket() -- back to the port's wait() on a half received frame
+#define ANT_GATEWAY_WAIT_MS          (10)    //!< Longest a reader sleeps in its port's wait() (stop() takes up to this)
+#define ANT_GATEWAY_IDLE_US          (50)    //!< Decoder sleep when all its queues are empty
+
+//As wired in the examples -- the same for every module
+#define ANT_GATEWAY_RTS_PIN      (2)
+#define ANT_GATEWAY_SUSPEND_PIN  (3)
+#define ANT_GATEWAY_SLEEP_PIN    (4)
+#define ANT_GATEWAY_RESET_PIN    (5)
+
+typedef enum
+{
+  ANT_METRIC_HEART_RATE,       //!< bpm
+  ANT_METRIC_POWER,            //!< W
+  ANT_METRIC_CADENCE,          //!< rpm
+  ANT_METRIC_FE_TARGET_POWER,  //!< 0.25 W
+  ANT_METRIC_FE_RESISTANCE,    //!< 0.5 % of maximum
+  ANT_METRIC_FE_GRADE,         //!< 0.01 % (signed)
+  ANT_METRICS
+} ANT_METRIC;
+
+typedef enum
+{
+  ANT_GATEWAY_FULL_DROP,
+  ANT_GATEWAY_FULL_WAIT
+} ANT_GATEWAY_FULL;
+
+//! A data message as the reader had it
+typedef struct ANT_GatewayFrame_struct
+{
+   unsigned long long received_ns;  //!< CLOCK_MONOTONIC
+   byte module;
+   byte msg_id;
+   byte channel_number;
+   byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE];
+} ANT_GatewayFrame;
+
+typedef struct ANT_GatewayMetric_struct
+{
+   unsigned long long received_ns;  //!< Of the frame it came from
+   long value;                      //!< Units per ANT_METRIC
+   byte module;
+   byte channel_number;
+   byte metric;                     //!< ANT_METRIC
+} ANT_GatewayMetric;
+
+//! Per channel -- the previous page for metrics worked out from event counts (speed and cadence sensors)
+typedef struct ANT_GatewayDecodeState_struct
+{
+   boolean valid;
+   byte last[ANT_STANDARD_DATA_PAYLOAD_SIZE];
+} ANT_GatewayDecodeState;
+
+typedef struct ANT_GatewayReaderStats_struct
+{
+   unsigned long frames;            //!< Data messages read
+   unsigned long dropped;           //!< ... lost to a full reader queue
+   unsigned long packets;           //!< Everything readPacket() returned
+   boolean established;             //!< Channel list set up
+   boolean failed;                  //!< The port did not open
+} ANT_GatewayReaderStats;
+
+typedef struct ANT_GatewayDecoderStats_struct
+{
+   unsigned long frames;
+   unsigned long metrics;
+   unsigned long undecoded;         //!< Pages with nothing to report (or an unknown device type)
+   unsigned long waits;             //!< Backoffs on a full ANT_GATEWAY_FULL_WAIT subscriber
+} ANT_GatewayDecoderStats;
+
+typedef struct ANT_GatewaySubscriberStats_struct
+{
+   unsigned long delivered;
+   unsigned long dropped;           //!< Lost to a full queue (ANT_GATEWAY_FULL_DROP)
+} ANT_GatewaySubscriberStats;
+
+
+//! Where a reader gets its bytes. Called in the reader thread.
+class ANTGatewayPort
+{
+  public:
+    virtual ~ANTGatewayPort() {};
+    //! Open the port (or start the simulator) on the reader's board. NULL if it cannot.
+    virtual Stream * open() = 0;
+    //! Nothing to read -- wait for more (up to ANT_GATEWAY_WAIT_MS)
+    virtual void     wait() = 0;
+    virtual void     close() {};
+};
+
+//! A module on a serial port or USB-serial adapter
+class ANTGatewayPosixPort : public ANTGatewayPort
+{
+  public:
+    ANTGatewayPosixPort( const char * path, unsigned long baud_rate, ANT_POSIX_RTS rts_mode, ANT_POSIX_RESET reset_mode )
+      : path(path), baud_rate(baud_rate), rts_mode(rts_mode), reset_mode(reset_mode) {};
+    Stream * open();
+    void     wait() {port.waitReadable(ANT_GATEWAY_WAIT_MS);};
+    void     close() {port.close();};
+    const ANT_PosixStats * getStats() {return port.getStats();};
+
+  private:
+    const char * path;
+    unsigned long baud_rate;
+    ANT_POSIX_RTS rts_mode;
+    ANT_POSIX_RESET reset_mode;
+    ANTPosixSerial port;
+};
+
+
+class ANTGateway
+{
+  public:
+    ANTGateway();
+    ~ANTGateway();
+
+    //! Before start(). channel_list is set up by the reader (and read for each channel's device type). False when full.
+    boolean addModule( ANTGatewayPort * port, ANT_Channel ** channel_list, byte channel_count );
+    //! Before start(). Returns the subscriber index for pop(), or -1 when full.
+    int     subscribe( ANT_GATEWAY_FULL full = ANT_GATEWAY_FULL_DROP );
+    //! Before start(). The decoders also write every metric to its channel's slot (see ANTMetricsShm).
+    void    setPublisher( ANTMetricsShm * publisher ) {this->publisher = publisher;};
+    //! Starts the readers and decoders (1 to ANT_GATEWAY_MAX_DECODERS)
+    boolean start( byte decoders );
+    void    stop();
+
+    //! From the subscriber's own thread. False when there is nothing waiting.
+    boolean pop( int subscriber, ANT_GatewayMetric * metric );
+
+    //! Decodes one page (static for use outside the pipeline). Returns the number of metrics written (up to 2).
+    static byte decode( byte device_type, const byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE], ANT_GatewayDecodeState * state,
+                        byte metrics[2], long values[2] );
+
+    //Snapshots (the counters move on while they are read)
+    byte moduleCount() {return module_count;};
+    void getReaderStats( byte module, ANT_GatewayReaderStats * stats );
+    void getDecoderStats( byte decoder, ANT_GatewayDecoderStats * stats );
+    void getSubscriberStats( int subscriber, ANT_GatewaySubscriberStats * stats );
+    //! Every module's channels are set up
+    boolean established();
+
+    static unsigned long long now_ns();  //!< CLOCK_MONOTONIC
+
+  private:
+    typedef struct Module_struct
+    {
+       ANTGateway * gateway;
+       byte index;
+       ANTGatewayPort * port;
+       ANT_Channel ** channel_list;
+       byte channel_count;
+       byte device_type[ANT_DEVICE_NUMBER_CHANNELS];  //!< By channel number (0 -- not in the list)
+       pthread_t thread;
+       ANT_GatewayReaderStats stats;
+       ANTSpscQueue<ANT_GatewayFrame, ANT_GATEWAY_FRAME_QUEUE> frames;
+       ANT_GatewayDecodeState decode_state[ANT_DEVICE_NUMBER_CHANNELS];  //Decoder only
+    } Module;
+
+    typedef struct Decoder_struct
+    {
+       ANTGateway * gateway;
+       byte index;
+       pthread_t thread;
+       ANT_GatewayDecoderStats stats;
+    } Decoder;
+
+    typedef struct Subscriber_struct
+    {
+       ANT_GATEWAY_FULL full;
+       ANT_GatewaySubscriberStats stats;
+       ANTMpscQueue<ANT_GatewayMetric, ANT_GATEWAY_METRIC_QUEUE> metrics;
+    } Subscriber;
+
+    static void * reader_thread( void * module );
+    static void * decoder_thread( void * decoder );
+    void read( Module * module );
+    void decodeFrames( Decoder * decoder );
+    void deliver( Decoder * decoder, byte subscriber, const ANT_GatewayMetric * metric );
+    static void count( unsigned long * counter ) {__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);};
+    boolean isRunning() {return __atomic_load_n(&running, __ATOMIC_ACQUIRE);};
+    boolean isDecoding() {return __atomic_load_n(&decoding, __ATOMIC_ACQUIRE);};
+
+  private:
+    Module * modules[ANT_GATEWAY_MAX_MODULES];
+    byte module_count;
+    Decoder decoders[ANT_GATEWAY_MAX_DECODERS];
+    byte decoder_count;
+    Subscriber * subscribers[ANT_GATEWAY_MAX_SUBSCRIBERS];
+    byte subscriber_count;
+    ANTMetricsShm * publisher;
+    boolean running;             //!< Readers
+    boolean decoding;            //!< Decoders -- cleared once the readers have stopped
+};
+
+#endif //ANTGateway_h
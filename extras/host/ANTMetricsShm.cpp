@@ -0,0 +1,108 @@
+//Copyright 2013 Brody Kenrick.
+//Latest decoded metrics in shared memory (see ANTMetricsShm.h)
+
+#include "ANTMetricsShm.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ANTMetricsShm::ANTMetricsShm()
+{
+  header = NULL;
+  size = 0;
+  writable = false;
+  retries = 0;
+}
+
+boolean ANTMetricsShm::create( const char * name, byte modules, byte channels )
+{
+  close();
+  if((modules == 0) || (channels == 0))
+  {
+    return false;
+  }
+  //A segment left by an earlier run may have another layout -- and its readers keep their old mapping
+  shm_unlink(name);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if(fd < 0)
+  {
+    return false;
+  }
+  size_t length = sizeof(ANT_MetricsShmHeader) + ((size_t)modules * channels * sizeof(ANT_MetricsShmSlot));
+  void * mapping = MAP_FAILED;
+  if(ftruncate(fd, length) == 0)
+  {
+    mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if(mapping == MAP_FAILED)
+  {
+    shm_unlink(name);
+    return false;
+  }
+  //ftruncate() zeroed it -- every slot is at sequence 0 and never reported
+  header = (ANT_MetricsShmHeader *)mapping;
+  size = length;
+  writable = true;
+  header->version = ANT_METRICS_SHM_VERSION;
+  header->modules = modules;
+  header->channels = channels;
+  header->metrics = ANT_METRICS;
+  header->slot_size = sizeof(ANT_MetricsShmSlot);
+  //Last -- a reader that finds the magic finds the rest
+  __atomic_store_n(&header->magic, (uint32_t)ANT_METRICS_SHM_MAGIC, __ATOMIC_RELEASE);
+  return true;
+}
+
+boolean ANTMetricsShm::open( const char * name )
+{
+  close();
+  int fd = shm_open(name, O_RDONLY, 0);
+  if(fd < 0)
+  {
+    return false;
+  }
+  struct stat status;
+  void * mapping = MAP_FAILED;
+  if((fstat(fd, &status) == 0) && ((size_t)status.st_size >= sizeof(ANT_MetricsShmHeader)))
+  {
+    mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if(mapping == MAP_FAILED)
+  {
+    return false;
+  }
+  header = (ANT_MetricsShmHeader *)mapping;
+  size = status.st_size;
+  writable = false;
+  boolean matches = (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == ANT_METRICS_SHM_MAGIC)
+                    && (header->version == ANT_METRICS_SHM_VERSION)
+                    && (header->metrics == ANT_METRICS)
+                    && (header->slot_size == sizeof(ANT_MetricsShmSlot))
+                    && (size >= (sizeof(ANT_MetricsShmHeader) + ((size_t)header->modules * header->channels * header->slot_size)));
+  if(!matches)
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ANTMetricsShm::close()
+{
+  if(header)
+  {
+    munmap(header, size);
+    header = NULL;
+    size = 0;
+    writable = false;
+  }
+}
+
+boolean ANTMetricsShm::unlink( const char * name )
+{
+  return (shm_unlink(name) == 0);
+}
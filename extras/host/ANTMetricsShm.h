@@ -0,0 +1,143 @@
+//Copyright 2013 Brody Kenrick.
+//Latest decoded metrics for each channel in a shared memory segment -- seqlock versioned (Linux hosts)
+
+//The gateway (ANTGateway::setPublisher()) writes a metric into its channel's slot as it is decoded. Dashboards
+// and control processes open() the segment by name and read() a channel whenever they like: no locks and no
+// syscalls, and any number of readers in any number of processes.
+//Seqlock: each slot has a sequence number that is odd while its writer is part way through an update. A reader
+// copies the slot between two reads of the sequence and goes round again if they differ (or were odd), so it never
+// sees half an update. The writer pays two stores of the sequence on top of the value and its time and never
+// waits on a reader. There must be one writer per slot -- in the gateway the decoder that owns the module.
+//A reader only makes a syscall when a slot stays mid-update for ANT_METRICS_SHM_SPINS tries -- a writer preempted
+// part way through, which on one CPU cannot finish until the reader gives way.
+//Slots are two cache lines so decoders writing neighbouring channels do not share a line.
+
+#ifndef ANTMetricsShm_h
+#define ANTMetricsShm_h
+
+#include <Arduino.h>
+
+#include <sched.h>
+
+#include "ANTGateway.h"
+
+#define ANT_METRICS_SHM_MAGIC    (0x4D544E41UL) //!< "ANTM"
+#define ANT_METRICS_SHM_VERSION  (1)
+#define ANT_METRICS_SHM_SLOT     (128)          //!< Bytes per channel slot
+#define ANT_METRICS_SHM_SPINS    (64)           //!< read() tries before it yields to a writer that may be off the CPU
+#define ANT_METRICS_SHM_TRIES    (100000)       //!< read() gives up on a slot left part way through (its writer died)
+
+//! At the start of the segment (a slot long so the slots that follow are aligned)
+typedef struct ANT_MetricsShmHeader_struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t modules;
+   uint32_t channels;       //!< Slots per module
+   uint32_t metrics;        //!< ANT_METRICS of the writer
+   uint32_t slot_size;
+} __attribute__((aligned(ANT_METRICS_SHM_SLOT))) ANT_MetricsShmHeader;
+
+//! One channel. Slot (module, channel) is at header + (module * channels + channel) * slot_size.
+typedef struct ANT_MetricsShmSlot_struct
+{
+   uint32_t sequence;                  //!< Odd while an update is part way through
+   int32_t  value[ANT_METRICS];        //!< By ANT_METRIC
+   uint64_t updated_ns[ANT_METRICS];   //!< CLOCK_MONOTONIC of the frame each value came from (0 -- never)
+} __attribute__((aligned(ANT_METRICS_SHM_SLOT))) ANT_MetricsShmSlot;
+
+//! A reader's copy of one channel
+typedef struct ANT_MetricsSnapshot_struct
+{
+   long value[ANT_METRICS];
+   unsigned long long updated_ns[ANT_METRICS];  //!< 0 -- never reported
+   unsigned long sequence;                      //!< Updates to the channel so far (times two)
+} ANT_MetricsSnapshot;
+
+class ANTMetricsShm
+{
+  public:
+    ANTMetricsShm();
+    ~ANTMetricsShm() {close();};
+
+    //! Writer. Creates the segment /name (replacing any left over) for modules x channels, all never reported.
+    boolean create( const char * name, byte modules, byte channels = ANT_DEVICE_NUMBER_CHANNELS );
+    //! Reader. Maps an existing segment read only. False if it is missing or from another layout.
+    boolean open( const char * name );
+    //! Unmaps. The segment stays until unlink().
+    void    close();
+    static boolean unlink( const char * name );
+    boolean isOpen() {return (header != NULL);};
+
+    byte modules() {return header ? header->modules : 0;};
+    byte channels() {return header ? header->channels : 0;};
+
+    //! The slot's one writer. Out of range is ignored.
+    void publish( byte module, byte channel_number, byte metric, long value, unsigned long long updated_ns )
+    {
+      if(!writable || (module >= header->modules) || (channel_number >= header->channels) || (metric >= ANT_METRICS))
+      {
+        return;
+      }
+      ANT_MetricsShmSlot * s = slot(module, channel_number);
+      uint32_t sequence = __atomic_load_n(&s->sequence, __ATOMIC_RELAXED);
+      __atomic_store_n(&s->sequence, sequence + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      __atomic_store_n(&s->value[metric], (int32_t)value, __ATOMIC_RELAXED);
+      __atomic_store_n(&s->updated_ns[metric], (uint64_t)updated_ns, __ATOMIC_RELAXED);
+      __atomic_store_n(&s->sequence, sequence + 2, __ATOMIC_RELEASE);
+    };
+
+    //! Any reader. Goes round again while the slot is being written (counted in getRetries()).
+    //False if out of range or the slot never settles.
+    boolean read( byte module, byte channel_number, ANT_MetricsSnapshot * snapshot )
+    {
+      if(!header || (module >= header->modules) || (channel_number >= header->channels))
+      {
+        return false;
+      }
+      const ANT_MetricsShmSlot * s = slot(module, channel_number);
+      for(unsigned long tries = 0; tries < ANT_METRICS_SHM_TRIES; tries++)
+      {
+        uint32_t before = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE);
+        if(!(before & 1))
+        {
+          for(byte m = 0; m < ANT_METRICS; m++)
+          {
+            snapshot->value[m] = __atomic_load_n(&s->value[m], __ATOMIC_RELAXED);
+            snapshot->updated_ns[m] = __atomic_load_n(&s->updated_ns[m], __ATOMIC_RELAXED);
+          }
+          __atomic_thread_fence(__ATOMIC_ACQUIRE);
+          if(__atomic_load_n(&s->sequence, __ATOMIC_RELAXED) == before)
+          {
+            snapshot->sequence = before;
+            return true;
+          }
+        }
+        retries++;
+        if((tries % ANT_METRICS_SHM_SPINS) == (ANT_METRICS_SHM_SPINS - 1))
+        {
+          sched_yield();
+        }
+      }
+      return false;
+    };
+
+    //! This reader's reads that met an update and went round again
+    unsigned long getRetries() {return retries;};
+
+  private:
+    ANT_MetricsShmSlot * slot( byte module, byte channel_number )
+    {
+      return (ANT_MetricsShmSlot *)((byte *)header + sizeof(ANT_MetricsShmHeader)
+                                    + (((module * header->channels) + channel_number) * header->slot_size));
+    };
+
+  private:
+    ANT_MetricsShmHeader * header;
+    size_t size;
+    boolean writable;
+    unsigned long retries;
+};
+
+#endif //ANTMetricsShm_h
@@ -0,0 +1,372 @@
+//Copyright 2013 Brody Kenrick.
+//Stream over a POSIX tty (see ANTPosixSerial.h)
+
+#include "ANTPosixSerial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+static boolean baud_to_speed( unsigned long baud_rate, speed_t * speed )
+{
+  switch(baud_rate)
+  {
+    case 4800:  *speed = B4800;  return true;
+    case 9600:  *speed = B9600;  return true;
+    case 19200: *speed = B19200; return true;
+    case 38400: *speed = B38400; return true;
+    case 57600: *speed = B57600; return true;
+    default:
+      //50000 has no termios constant
+      return false;
+  }
+}
+
+ANTPosixSerial::ANTPosixSerial()
+{
+  fd = -1;
+  memset(&stats, 0, sizeof(stats));
+  rx_head = rx_count = 0;
+  tx_count = tx_frame_left = 0;
+  rts_pin = 0;
+  rts_mode = ANT_POSIX_RTS_NONE;
+  rts_emulated_us = ANT_POSIX_RTS_EMULATED_US;
+  rts_high = false;
+  rts_fall_us = 0;
+  reset_pin = 0;
+  reset_mode = ANT_POSIX_RESET_NONE;
+  reset_level = HIGH;
+}
+
+ANTPosixSerial::~ANTPosixSerial()
+{
+  close();
+}
+
+boolean ANTPosixSerial::open( const char * path, unsigned long baud_rate )
+{
+  close();
+  fd = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if(fd < 0)
+  {
+    error(errno);
+    return false;
+  }
+  struct termios settings;
+  if(tcgetattr(fd, &settings) != 0)
+  {
+    error(errno);
+    close();
+    return false;
+  }
+  cfmakeraw(&settings);
+  settings.c_cflag |= CLOCAL | CREAD;
+  settings.c_cflag &= ~CRTSCTS;   //The module RTS is not a hardware flow control line -- it is read as CTS by service()
+  settings.c_cc[VMIN]  = 0;
+  settings.c_cc[VTIME] = 0;
+  if(tcsetattr(fd, TCSANOW, &settings) != 0)
+  {
+    error(errno);
+    close();
+    return false;
+  }
+  if(!setBaudRate(baud_rate))
+  {
+    close();
+    return false;
+  }
+  tcflush(fd, TCIOFLUSH);
+  memset(&stats, 0, sizeof(stats));
+  rx_head = rx_count = 0;
+  tx_count = tx_frame_left = 0;
+  return true;
+}
+
+void ANTPosixSerial::close()
+{
+  if(fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+boolean ANTPosixSerial::setBaudRate( unsigned long baud_rate )
+{
+  speed_t speed;
+  struct termios settings;
+  if((fd < 0) || !baud_to_speed(baud_rate, &speed) || (tcgetattr(fd, &settings) != 0))
+  {
+    return false;
+  }
+  cfsetispeed(&settings, speed);
+  cfsetospeed(&settings, speed);
+  if(tcsetattr(fd, TCSADRAIN, &settings) != 0)
+  {
+    error(errno);
+    return false;
+  }
+  return true;
+}
+
+void ANTPosixSerial::setRtsPin( byte pin, ANT_POSIX_RTS mode, unsigned long rts_emulated_us )
+{
+  rts_pin = pin;
+  rts_mode = mode;
+  this->rts_emulated_us = rts_emulated_us;
+  rts_high = false;
+  if(mode != ANT_POSIX_RTS_NONE)
+  {
+    host_drive_pin(rts_pin, LOW);
+  }
+}
+
+void ANTPosixSerial::setResetPin( byte pin, ANT_POSIX_RESET mode )
+{
+  reset_pin = pin;
+  reset_mode = mode;
+  reset_level = digitalRead(pin);
+}
+
+void ANTPosixSerial::error( int error_number )
+{
+  stats.errors++;
+  stats.errno_last = error_number;
+}
+
+
+//! Follow the pins -- RESET out to the module, RTS in from it
+void ANTPosixSerial::service()
+{
+  micros(); //Catch the host clock up
+  unsigned long long now_us = host_now_us();
+
+  if(reset_mode != ANT_POSIX_RESET_NONE)
+  {
+    byte level = digitalRead(reset_pin);
+    if(level != reset_level)
+    {
+      reset_level = level;
+      stats.resets += (level == HIGH) ? 1 : 0;
+      if(reset_mode == ANT_POSIX_RESET_DTR)
+      {
+        int bits = TIOCM_DTR;
+        if(ioctl(fd, (level == LOW) ? TIOCMBIS : TIOCMBIC, &bits) != 0)
+        {
+          error(errno);
+        }
+      }
+      else
+      if(level == HIGH)
+      {
+        //Released -- whatever was half written is dropped with the old state
+        tx_count = tx_frame_left = 0;
+        const byte reset_frame[] = {MESG_TX_SYNC, 1, MESG_SYSTEM_RESET_ID, 0, MESG_TX_SYNC ^ 1 ^ MESG_SYSTEM_RESET_ID};
+        write(reset_frame, sizeof(reset_frame));
+      }
+    }
+  }
+
+  if((rts_mode == ANT_POSIX_RTS_EMULATED) && rts_high && (now_us >= rts_fall_us))
+  {
+    rts_high = false;
+    stats.rts_pulses++;
+    host_drive_pin(rts_pin, LOW);
+  }
+  else
+  if((rts_mode == ANT_POSIX_RTS_CTS) && (rx_count == 0))
+  {
+    //One syscall -- only while there is nothing buffered to read
+    int bits = 0;
+    if(ioctl(fd, TIOCMGET, &bits) != 0)
+    {
+      error(errno);
+      return;
+    }
+    //CTS# asserted (bit set) while the module holds RTS low
+    boolean high = !(bits & TIOCM_CTS);
+    if(rts_high && !high)
+    {
+      stats.rts_pulses++;
+    }
+    rts_high = high;
+    host_drive_pin(rts_pin, high ? HIGH : LOW);
+  }
+}
+
+//! One read() for as much as there is room for. Only when empty so the buffer never needs compacting.
+void ANTPosixSerial::fill()
+{
+  if((fd < 0) || (rx_count != 0))
+  {
+    return;
+  }
+  rx_head = 0;
+  ssize_t count = ::read(fd, rx, sizeof(rx));
+  if(count > 0)
+  {
+    rx_count = count;
+    stats.read_calls++;
+    stats.bytes_in += count;
+  }
+  else
+  if((count == 0) || (errno == EAGAIN))
+  {
+    //A tty with VMIN and VTIME 0 gives 0 rather than EAGAIN
+    stats.empty_reads++;
+  }
+  else
+  if(count < 0)
+  {
+    error(errno);
+  }
+}
+
+boolean ANTPosixSerial::waitReadable( int timeout_ms )
+{
+  service();
+  fill();
+  if((rx_count != 0) || (fd < 0))
+  {
+    return (rx_count != 0);
+  }
+  if((rts_mode == ANT_POSIX_RTS_EMULATED) && rts_high)
+  {
+    //Wake for the RTS fall
+    unsigned long long now_us = host_now_us();
+    int fall_ms = (rts_fall_us > now_us) ? (int)(((rts_fall_us - now_us) + 999) / 1000) : 0;
+    timeout_ms = (fall_ms < timeout_ms) ? fall_ms : timeout_ms;
+  }
+  else
+  if((rts_mode == ANT_POSIX_RTS_CTS) && (timeout_ms > 1))
+  {
+    //Modem line changes do not wake poll() -- look again each millisecond
+    timeout_ms = 1;
+  }
+  struct pollfd ready;
+  ready.fd = fd;
+  ready.events = POLLIN;
+  ready.revents = 0;
+  stats.poll_calls++;
+  if(::poll(&ready, 1, timeout_ms) < 0)
+  {
+    error(errno);
+  }
+  service();
+  fill();
+  return (rx_count != 0);
+}
+
+
+//Stream
+
+int ANTPosixSerial::available()
+{
+  service();
+  fill();
+  return rx_count;
+}
+
+int ANTPosixSerial::read()
+{
+  if(rx_count == 0)
+  {
+    service();
+    fill();
+  }
+  if(rx_count == 0)
+  {
+    return -1;
+  }
+  rx_count--;
+  return rx[rx_head++];
+}
+
+int ANTPosixSerial::peek()
+{
+  if(rx_count == 0)
+  {
+    fill();
+  }
+  return (rx_count == 0) ? -1 : rx[rx_head];
+}
+
+//! Held until the frame is complete (sync, length, id, data, checksum). Anything that is not a frame goes straight out.
+size_t ANTPosixSerial::write( uint8_t c )
+{
+  if(fd < 0)
+  {
+    return 0;
+  }
+  if(tx_count == ANT_POSIX_TX_BUFFER)
+  {
+    flush();
+  }
+  tx[tx_count++] = c;
+  if(tx_count == 1)
+  {
+    if(c != MESG_TX_SYNC)
+    {
+      flush();
+    }
+  }
+  else
+  if(tx_count == 2)
+  {
+    tx_frame_left = c + 2; //Message ID, data and checksum
+  }
+  else
+  if(--tx_frame_left == 0)
+  {
+    sendFrame();
+  }
+  return 1;
+}
+
+void ANTPosixSerial::flush()
+{
+  unsigned int sent = 0;
+  while((fd >= 0) && (sent < tx_count))
+  {
+    ssize_t count = ::write(fd, &tx[sent], tx_count - sent);
+    if(count > 0)
+    {
+      stats.write_calls++;
+      stats.bytes_out += count;
+      sent += count;
+    }
+    else
+    if((count < 0) && (errno == EAGAIN))
+    {
+      //Kernel buffer full -- wait for room
+      struct pollfd ready;
+      ready.fd = fd;
+      ready.events = POLLOUT;
+      ready.revents = 0;
+      ::poll(&ready, 1, 10);
+    }
+    else
+    {
+      error(errno);
+      break;
+    }
+  }
+  tx_count = 0;
+  tx_frame_left = 0;
+}
+
+void ANTPosixSerial::sendFrame()
+{
+  flush();
+  if(rts_mode == ANT_POSIX_RTS_EMULATED)
+  {
+    //The module is busy with it until rts_emulated_us from now
+    micros();
+    rts_fall_us = host_now_us() + rts_emulated_us;
+    rts_high = true;
+    host_drive_pin(rts_pin, HIGH);
+  }
+}
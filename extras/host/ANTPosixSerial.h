@@ -0,0 +1,116 @@
+//Copyright 2013 Brody Kenrick.
+//Stream over a POSIX tty (termios) -- ANTPlus on a Linux host against a UART or USB-serial module
+
+//The port is non-blocking. Reads take whatever the kernel has (up to ANT_POSIX_RX_BUFFER) in one syscall and
+// writes are held until a frame is complete, so a message is one write(). When readPacket() returns
+// MESSAGE_READ_NONE call waitReadable() -- it sleeps in poll() until bytes arrive rather than spinning. Set a read
+// budget (ANTPlus::setReadBudget()) too, or readPacket() spins on a half received frame until the rest is in.
+//Run the host clock in real time (host_set_real_time()).
+//
+//RTS (module busy, active high) drives the ANTPlus RTS pin so the library interrupt runs as on a board:
+// ANT_POSIX_RTS_CTS      -- wired to the adapter's CTS# input. Read with TIOCMGET each service.
+// ANT_POSIX_RTS_EMULATED -- no line (USB sticks, pseudo-terminals). Pulsed high for rts_emulated_us after each frame sent.
+//RESET (active low) follows the ANTPlus RESET pin:
+// ANT_POSIX_RESET_DTR     -- wired to DTR# (asserted while the pin is low).
+// ANT_POSIX_RESET_COMMAND -- MESG_SYSTEM_RESET_ID is sent when the pin is released (the module answers with the startup message).
+
+#ifndef ANTPosixSerial_h
+#define ANTPosixSerial_h
+
+#include <Arduino.h>
+
+#include "ANTPlus.h"
+
+#define ANT_POSIX_RX_BUFFER        (256)
+#define ANT_POSIX_TX_BUFFER        (64)    //!< Longer than any frame ANTPlus sends
+#define ANT_POSIX_RTS_EMULATED_US  (1000)  //!< Long enough for the module to take the next message at any baud rate
+
+typedef enum
+{
+  ANT_POSIX_RTS_NONE,
+  ANT_POSIX_RTS_CTS,
+  ANT_POSIX_RTS_EMULATED
+} ANT_POSIX_RTS;
+
+typedef enum
+{
+  ANT_POSIX_RESET_NONE,
+  ANT_POSIX_RESET_DTR,
+  ANT_POSIX_RESET_COMMAND
+} ANT_POSIX_RESET;
+
+//! Syscall and line counters since open()
+typedef struct ANT_PosixStats_struct
+{
+   unsigned long read_calls;      //!< read() syscalls that returned bytes
+   unsigned long empty_reads;     //!< ... that found nothing
+   unsigned long bytes_in;
+   unsigned long write_calls;
+   unsigned long bytes_out;
+   unsigned long poll_calls;
+   unsigned long rts_pulses;
+   unsigned long resets;
+   unsigned long errors;          //!< Failed syscalls other than EAGAIN (last in errno_last)
+   int errno_last;
+} ANT_PosixStats;
+
+class ANTPosixSerial : public Stream
+{
+  public:
+    ANTPosixSerial();
+    ~ANTPosixSerial();
+
+    //! Raw 8N1 at baud_rate (4800 to 57600). False if the port will not open or take the settings.
+    boolean open( const char * path, unsigned long baud_rate );
+    void    close();
+    boolean isOpen() {return (fd >= 0);};
+    //! Changes the port rate (e.g. from an ANT_SetBaudRate for beginAutoBaud()). False for a rate termios does not have.
+    boolean setBaudRate( unsigned long baud_rate );
+
+    //! Call before ANTPlus::begin() with the same pin numbers as the ANTPlus constructor
+    void setRtsPin( byte pin, ANT_POSIX_RTS mode, unsigned long rts_emulated_us = ANT_POSIX_RTS_EMULATED_US );
+    void setResetPin( byte pin, ANT_POSIX_RESET mode );
+
+    //! Sleep until there is something to read, the emulated RTS falls or timeout_ms. True if bytes are waiting.
+    boolean waitReadable( int timeout_ms );
+
+    //Stream
+    int    available();
+    int    read();
+    int    peek();
+    size_t write( uint8_t c );
+    using Print::write;
+    void   flush();
+
+    const ANT_PosixStats * getStats() {return &stats;};
+
+  private:
+    void    service();
+    void    fill();
+    void    sendFrame();
+    void    error( int error_number );
+
+  private:
+    int fd;
+    ANT_PosixStats stats;
+
+    byte rx[ANT_POSIX_RX_BUFFER];
+    unsigned int rx_head;
+    unsigned int rx_count;
+
+    byte tx[ANT_POSIX_TX_BUFFER];
+    unsigned int tx_count;
+    unsigned int tx_frame_left;   //!< Bytes still to come of the frame being written (0 -- waiting for a sync)
+
+    byte rts_pin;
+    ANT_POSIX_RTS rts_mode;
+    unsigned long rts_emulated_us;
+    boolean rts_high;
+    unsigned long long rts_fall_us;
+
+    byte reset_pin;
+    ANT_POSIX_RESET reset_mode;
+    byte reset_level;
+};
+
+#endif //ANTPosixSerial_h
@@ -0,0 +1,130 @@
+//Copyright 2013 Brody Kenrick.
+//Bounded lock-free queues between threads (used by ANTGateway). GCC atomics -- Linux hosts only.
+
+//SIZE must be a power of two. Elements are copied in and out. push() and pop() never wait -- false when full or empty.
+//ANTSpscQueue -- one producer thread and one consumer thread. Free running indices (as ANTRingBuffer) published
+// with release stores, so each side only ever writes its own index.
+//ANTMpscQueue -- any number of producers, one consumer. Each cell carries a sequence number: a producer claims a
+// cell with one compare and swap on the head and the consumer takes it only once the sequence says it is filled.
+
+#ifndef ANTQueue_h
+#define ANTQueue_h
+
+#include <Arduino.h>
+
+#define ANT_QUEUE_CACHE_LINE (64)
+
+template<typename T, unsigned int SIZE> class ANTSpscQueue
+{
+  public:
+    ANTSpscQueue() : head(0), tail(0) {};
+
+    //! Producer
+    boolean push( const T & value )
+    {
+      unsigned int h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+      if((h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) == SIZE)
+      {
+        return false;
+      }
+      cells[h & (SIZE - 1)] = value;
+      __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+      return true;
+    };
+
+    //! Consumer
+    boolean pop( T * value )
+    {
+      unsigned int t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+      if(__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t)
+      {
+        return false;
+      }
+      *value = cells[t & (SIZE - 1)];
+      __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+      return true;
+    };
+
+    //! Either side. Only a snapshot -- the other side moves on.
+    unsigned int available() const {return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);};
+
+  private:
+    T cells[SIZE];
+    unsigned int head;  //!< Written by the producer only
+    byte pad[ANT_QUEUE_CACHE_LINE - sizeof(unsigned int)];  //!< head and tail on lines of their own
+    unsigned int tail;  //!< Written by the consumer only
+};
+
+template<typename T, unsigned int SIZE> class ANTMpscQueue
+{
+  public:
+    ANTMpscQueue() : head(0), tail(0)
+    {
+      for(unsigned int i = 0; i < SIZE; i++)
+      {
+        cells[i].sequence = i;
+      }
+    };
+
+    //! Any producer
+    boolean push( const T & value )
+    {
+      unsigned int h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+      while(true)
+      {
+        Cell * cell = &cells[h & (SIZE - 1)];
+        int lag = (int)(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - h);
+        if(lag == 0)
+        {
+          //Free for h -- claim it (a failed exchange reloads h)
+          if(__atomic_compare_exchange_n(&head, &h, h + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+          {
+            cell->value = value;
+            __atomic_store_n(&cell->sequence, h + 1, __ATOMIC_RELEASE);
+            return true;
+          }
+        }
+        else
+        if(lag < 0)
+        {
+          //Still holds the value from a lap ago
+          return false;
+        }
+        else
+        {
+          //Another producer took it
+          h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+      }
+    };
+
+    //! The consumer
+    boolean pop( T * value )
+    {
+      unsigned int t = tail;
+      Cell * cell = &cells[t & (SIZE - 1)];
+      if(__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != (t + 1))
+      {
+        //Empty, or claimed and not filled yet
+        return false;
+      }
+      *value = cell->value;
+      __atomic_store_n(&cell->sequence, t + SIZE, __ATOMIC_RELEASE);
+      tail = t + 1;
+      return true;
+    };
+
+  private:
+    typedef struct Cell_struct
+    {
+       unsigned int sequence;
+       T value;
+    } Cell;
+
+    Cell cells[SIZE];
+    unsigned int head;  //!< Next cell to claim (producers)
+    byte pad[ANT_QUEUE_CACHE_LINE - sizeof(unsigned int)];
+    unsigned int tail;  //!< Next cell to take (consumer only)
+};
+
+#endif //ANTQueue_h
@@ -0,0 +1,1350 @@
+//Copyright 2013 Brody Kenrick.
+//Simulated nRF24AP2 (see ANTSimulator.h)
+
+#include "ANTSimulator.h"
+
+#define NO_DEVICE  (ANT_SIM_DEVICES)
+#define NO_CHANNEL (ANT_SIM_CHANNELS)
+#define FOREVER    (~0ULL)
+
+//What an nRF24AP2 with 8 channels reports
+static const byte sim_capabilities[ANT_CAPABILITIES_LEN] =
+{
+  ANT_SIM_CHANNELS,
+  ANT_SIM_NETWORKS,
+  0x00,
+  CAPABILITIES_NETWORK_ENABLED | CAPABILITIES_SERIAL_NUMBER_ENABLED | CAPABILITIES_PER_CHANNEL_TX_POWER_ENABLED
+    | CAPABILITIES_LOW_PRIORITY_SEARCH_ENABLED | CAPABILITIES_SEARCH_LIST_ENABLED,
+  CAPABILITIES_EXT_MESSAGE_ENABLED | CAPABILITIES_SCAN_MODE_ENABLED | CAPABILITIES_PROX_SEARCH_ENABLED | CAPABILITIES_EXT_ASSIGN_ENABLED,
+  0x00,
+  CAPABILITIES_EVENT_BUFFERING_ENABLED | CAPABILITIES_EVENT_FILTERING_ENABLED | CAPABILITIES_HIGH_DUTY_SEARCH_MODE_ENABLED
+    | CAPABILITIES_ACTIVE_SEARCH_SHARING_MODE_ENABLED | CAPABILITIES_SELECTIVE_DATA_UPDATE_ENABLED,
+  0x00,
+};
+
+//! <sync> <length> <msg id> <data> <checksum>. Returns the frame length.
+static byte build_frame( byte * frame, byte msg_id, const byte * data, byte length )
+{
+  frame[0] = MESG_TX_SYNC;
+  frame[1] = length;
+  frame[2] = msg_id;
+  memcpy(&frame[3], data, length);
+  byte checksum = 0;
+  for(byte i = 0; i < (length + 3); i++)
+  {
+    checksum ^= frame[i];
+  }
+  frame[length + 3] = checksum;
+  return length + 4;
+}
+
+static unsigned long long overlap_us( unsigned long long from_us, unsigned long long to_us, unsigned long long start_us, unsigned long long end_us )
+{
+  unsigned long long a = (from_us > start_us) ? from_us : start_us;
+  unsigned long long b = (to_us < end_us) ? to_us : end_us;
+  return (b > a) ? (b - a) : 0;
+}
+
+
+ANTSimulator::ANTSimulator( byte RTS_PIN, byte SUSPEND_PIN, byte SLEEP_PIN, byte RESET_PIN, unsigned long baud_rate, unsigned long seed )
+{
+  this->RTS_PIN     = RTS_PIN;
+  this->SUSPEND_PIN = SUSPEND_PIN;
+  this->SLEEP_PIN   = SLEEP_PIN;
+  this->RESET_PIN   = RESET_PIN;
+  baud = baud_rate;
+  host_baud = baud_rate;
+  //10 bits per byte on the wire
+  byte_us = ((10UL * 1000000UL) + baud_rate - 1) / baud_rate;
+  random_state = seed ? seed : 1;
+  blocking_writes = true;
+
+  memset(&faults, 0, sizeof(faults));
+  memcpy(capabilities, sim_capabilities, sizeof(capabilities));
+  memset(devices, 0, sizeof(devices));
+  device_count = 0;
+
+  in_reset = false;
+  suspended = false;
+  booting = false;
+  boot_due_us = 0;
+  boot_reason = RESET_POR;
+  rts_fall_us = 0;
+  rts_level = false;
+  updating = false;
+
+  host_tx_head = 0;
+  host_tx_count = 0;
+  host_line_free_us = 0;
+  frame_len = 0;
+  frame_last_us = 0;
+  wire_head = 0;
+  wire_count = 0;
+  wire_free_us = 0;
+  last_arrival_us = 0;
+  host_rx_head = 0;
+  host_rx_count = 0;
+
+  processed_us = host_now_us();
+  radio_accounted_us = processed_us;
+  radio_fraction_us = 0;
+  wipe();
+  resetStats();
+  host_add_tick_handler(tick, this);
+
+  //Powered up -- the startup message follows (stale by the time ANTPlus::begin() flushes the UART)
+  boot(processed_us, RESET_POR);
+}
+
+ANTSimulator::~ANTSimulator()
+{
+  host_remove_tick_handler(tick, this);
+}
+
+void ANTSimulator::resetStats()
+{
+  memset(&stats, 0, sizeof(stats));
+  stats.since_us = host_now_us();
+}
+
+float ANTSimulator::radioDuty()
+{
+  update(host_now_us());
+  unsigned long long window_us = host_now_us() - stats.since_us;
+  return window_us ? ((float)stats.radio_on_us / (float)window_us) : 0.0;
+}
+
+void ANTSimulator::setFaults( const ANT_SimFaults * faults )
+{
+  this->faults = *faults;
+}
+
+void ANTSimulator::setCapabilities( const byte capabilities[ANT_CAPABILITIES_LEN] )
+{
+  memcpy(this->capabilities, capabilities, ANT_CAPABILITIES_LEN);
+}
+
+ANT_SimDevice * ANTSimulator::addDevice( unsigned int device_number, byte device_type, byte transmission_type, unsigned int period, byte freq )
+{
+  if(device_count >= ANT_SIM_DEVICES)
+  {
+    return NULL;
+  }
+  ANT_SimDevice * device = &devices[device_count++];
+  memset(device, 0, sizeof(*device));
+  device->id.device_number     = device_number;
+  device->id.device_type       = device_type;
+  device->id.transmission_type = transmission_type;
+  device->freq = freq;
+  device->period = period;
+  device->proximity_bin = 1;
+  device->rssi = -50;
+  device->present = true;
+  device->payload = hrm_payload;
+  device->heart_rate = 60 + (random32() % 40);
+  //Devices are not in step with each other
+  device->next_tx_us = processed_us + (random32() % ANT_SIM_PERIOD_US(period));
+  return device;
+}
+
+byte ANTSimulator::channelStatus( byte channel_number )
+{
+  update(host_now_us());
+  return (channel_number < ANT_SIM_CHANNELS) ? channels[channel_number].status : STATUS_UNASSIGNED_CHANNEL;
+}
+
+ANT_SimDevice * ANTSimulator::trackedDevice( byte channel_number )
+{
+  update(host_now_us());
+  if((channel_number >= ANT_SIM_CHANNELS) || (channels[channel_number].tracked == NO_DEVICE))
+  {
+    return NULL;
+  }
+  return &devices[channels[channel_number].tracked];
+}
+
+void ANTSimulator::hrm_payload( ANT_SimDevice * device, byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE] )
+{
+  //A beat every fourth message. The heart rate wanders.
+  if((device->tx_count % 4) == 0)
+  {
+    device->heart_beat_count++;
+    int heart_rate = device->heart_rate + (int)(device->tx_count % 3) - 1;
+    device->heart_rate = (heart_rate < 40) ? 40 : ((heart_rate > 200) ? 200 : heart_rate);
+  }
+  unsigned int beat_time = device->heart_beat_count * 1024;
+  payload[0] = DATA_PAGE_HEART_RATE_4 | (((device->tx_count / 4) & 1) ? 0x80 : 0x00);
+  payload[1] = 0xFF;
+  payload[2] = (beat_time - 1024) & 0xFF;
+  payload[3] = ((beat_time - 1024) >> 8) & 0xFF;
+  payload[4] = beat_time & 0xFF;
+  payload[5] = (beat_time >> 8) & 0xFF;
+  payload[6] = device->heart_beat_count;
+  payload[7] = device->heart_rate;
+}
+
+
+//Stream -- the host end of the UART
+
+int ANTSimulator::available()
+{
+  moveToHost(host_now_us());
+  return host_rx_count;
+}
+
+int ANTSimulator::read()
+{
+  moveToHost(host_now_us());
+  if(host_rx_count == 0)
+  {
+    return -1;
+  }
+  byte value = host_rx[host_rx_head];
+  host_rx_head = (host_rx_head + 1) % ANT_SIM_HOST_RX_BUFFER;
+  host_rx_count--;
+  return value;
+}
+
+int ANTSimulator::peek()
+{
+  moveToHost(host_now_us());
+  return (host_rx_count == 0) ? -1 : host_rx[host_rx_head];
+}
+
+size_t ANTSimulator::write( uint8_t c )
+{
+  unsigned long host_byte_us = ((10UL * 1000000UL) + host_baud - 1) / host_baud;
+  unsigned long long now_us = host_now_us();
+  unsigned long long start_us = (host_line_free_us > now_us) ? host_line_free_us : now_us;
+  host_line_free_us = start_us + host_byte_us;
+
+  if(chance(faults.tx_drop))
+  {
+    stats.fault_tx_drop++;
+  }
+  else
+  if(host_tx_count < ANT_SIM_HOST_TX_BUFFER)
+  {
+    SimTimedByte * timed = &host_tx[(host_tx_head + host_tx_count) % ANT_SIM_HOST_TX_BUFFER];
+    timed->ready_us = host_line_free_us;
+    //Sampled at the wrong rate
+    timed->value = (host_baud == baud) ? c : (byte)random32();
+    host_tx_count++;
+  }
+
+  if(blocking_writes)
+  {
+    //SoftwareSerial sends each bit itself -- the host is busy for the whole byte
+    host_advance_us(host_line_free_us - now_us);
+  }
+  return 1;
+}
+
+
+//Time
+
+void ANTSimulator::tick( void * context, unsigned long long now_us )
+{
+  ((ANTSimulator *)context)->update(now_us);
+}
+
+//! Everything due up to now_us, in time order
+void ANTSimulator::update( unsigned long long now_us )
+{
+  if(updating || (now_us < processed_us))
+  {
+    return;
+  }
+  updating = true;
+  followPins(now_us);
+
+  while(true)
+  {
+    unsigned long long t = nextEventUs();
+    if(t > now_us)
+    {
+      break;
+    }
+    if(t < processed_us)
+    {
+      t = processed_us;
+    }
+    accountRadio(t);
+    processed_us = t;
+
+    if(host_tx_count && (host_tx[host_tx_head].ready_us <= t))
+    {
+      byte value = host_tx[host_tx_head].value;
+      host_tx_head = (host_tx_head + 1) % ANT_SIM_HOST_TX_BUFFER;
+      host_tx_count--;
+      receiveByte(t, value);
+      continue;
+    }
+    if(rts_fall_us && (rts_fall_us <= t))
+    {
+      rts_fall_us = 0;
+      if(!booting && !in_reset && !suspended)
+      {
+        rts(false);
+      }
+      continue;
+    }
+    if(booting && (boot_due_us <= t))
+    {
+      booting = false;
+      byte frame[ANT_SIM_FRAME_MAX];
+      byte length = build_frame(frame, MESG_STARTUP_MESG_ID, &boot_reason, 1);
+      output(t, frame, length, false, true);
+      rts(false);
+      continue;
+    }
+    byte next = ANT_SIM_PENDING;
+    for(byte i = 0; i < ANT_SIM_PENDING; i++)
+    {
+      if(pending[i].length && (pending[i].due_us <= t) && ((next == ANT_SIM_PENDING) || (pending[i].due_us < pending[next].due_us)))
+      {
+        next = i;
+      }
+    }
+    if(next != ANT_SIM_PENDING)
+    {
+      output(t, pending[next].frame, pending[next].length, false, !pending[next].event);
+      if(pending[next].event)
+      {
+        stats.events_to_host++;
+      }
+      pending[next].length = 0;
+      continue;
+    }
+    if(event_buffer_len && buffer_time_us && ((event_buffer_start_us + buffer_time_us) <= t))
+    {
+      flushEventBuffer(t);
+      continue;
+    }
+    radioEvents(t);
+  }
+
+  accountRadio(now_us);
+  processed_us = now_us;
+  moveToHost(now_us);
+  updating = false;
+}
+
+unsigned long long ANTSimulator::nextEventUs()
+{
+  unsigned long long next_us = FOREVER;
+  if(host_tx_count && (host_tx[host_tx_head].ready_us < next_us))
+  {
+    next_us = host_tx[host_tx_head].ready_us;
+  }
+  if(rts_fall_us && (rts_fall_us < next_us))
+  {
+    next_us = rts_fall_us;
+  }
+  if(booting && (boot_due_us < next_us))
+  {
+    next_us = boot_due_us;
+  }
+  for(byte i = 0; i < ANT_SIM_PENDING; i++)
+  {
+    if(pending[i].length && (pending[i].due_us < next_us))
+    {
+      next_us = pending[i].due_us;
+    }
+  }
+  if(event_buffer_len && buffer_time_us && ((event_buffer_start_us + buffer_time_us) < next_us))
+  {
+    next_us = event_buffer_start_us + buffer_time_us;
+  }
+
+  boolean radio_active = false;
+  for(byte c = 0; c < ANT_SIM_CHANNELS; c++)
+  {
+    const SimChannel * channel = &channels[c];
+    if(channel->status == STATUS_SEARCHING_CHANNEL)
+    {
+      radio_active = true;
+      if(channel->hp_end_us < next_us)
+      {
+        next_us = channel->hp_end_us;
+      }
+    }
+    else
+    if(channel->status == STATUS_TRACKING_CHANNEL)
+    {
+      radio_active = true;
+      if((channel->type & PARAMETER_TX_NOT_RX) && (channel->next_tx_us < next_us))
+      {
+        next_us = channel->next_tx_us;
+      }
+    }
+  }
+  if(radio_active)
+  {
+    for(byte i = 0; i < device_count; i++)
+    {
+      if(devices[i].next_tx_us < next_us)
+      {
+        next_us = devices[i].next_tx_us;
+      }
+    }
+  }
+  return next_us;
+}
+
+
+//Pins
+
+void ANTSimulator::followPins( unsigned long long now_us )
+{
+  boolean reset_low = (digitalRead(RESET_PIN) == LOW);
+  if(reset_low && !in_reset)
+  {
+    in_reset = true;
+    booting = false;
+    stats.resets++;
+    wipe();
+    rts(true);
+  }
+  else
+  if(!reset_low && in_reset)
+  {
+    in_reset = false;
+    boot(now_us, RESET_RST);
+  }
+
+  boolean suspend = (digitalRead(SUSPEND_PIN) == LOW) && (digitalRead(SLEEP_PIN) == HIGH);
+  if(suspend && !suspended && !in_reset)
+  {
+    suspended = true;
+    booting = false;
+    wipe();
+    rts(true);
+  }
+  else
+  if(!suspend && suspended)
+  {
+    suspended = false;
+    boot(now_us, RESET_SUSPEND);
+  }
+}
+
+//! Everything the module forgets on a reset or suspend
+void ANTSimulator::wipe()
+{
+  memset(channels, 0, sizeof(channels));
+  for(byte c = 0; c < ANT_SIM_CHANNELS; c++)
+  {
+    channels[c].status = STATUS_UNASSIGNED_CHANNEL;
+    channels[c].tracked = NO_DEVICE;
+  }
+  memset(network_key_set, 0, sizeof(network_key_set));
+  lib_config = 0;
+  high_duty_search = false;
+  event_filter = 0;
+  buffer_config = ANT_EVENT_BUFFER_LOW_PRIORITY;
+  buffer_size_threshold = 0;
+  buffer_time_us = 0;
+  event_buffer_len = 0;
+  memset(sdu_masks, 0, sizeof(sdu_masks));
+  memset(pending, 0, sizeof(pending));
+  frame_len = 0;
+  rts_fall_us = 0;
+}
+
+void ANTSimulator::boot( unsigned long long now_us, byte reason )
+{
+  booting = true;
+  boot_due_us = now_us + ANT_SIM_STARTUP_US;
+  boot_reason = reason;
+  rts_fall_us = 0;
+  //Not ready until the startup message is out
+  rts(true);
+}
+
+void ANTSimulator::rts( boolean high )
+{
+  if(rts_level == high)
+  {
+    return;
+  }
+  rts_level = high;
+  if(!high)
+  {
+    stats.rts_pulses++;
+  }
+  host_drive_pin(RTS_PIN, high ? HIGH : LOW);
+}
+
+
+//Host to module
+
+void ANTSimulator::receiveByte( unsigned long long now_us, byte value )
+{
+  if(in_reset || suspended || booting || (digitalRead(SLEEP_PIN) == HIGH))
+  {
+    stats.lost_asleep++;
+    return;
+  }
+  if(frame_len && ((now_us - frame_last_us) > ANT_SIM_FRAME_GAP_US))
+  {
+    stats.bad_frames_from_host++;
+    frame_len = 0;
+  }
+  frame_last_us = now_us;
+  if((frame_len == 0) && (value != MESG_TX_SYNC))
+  {
+    return;
+  }
+  frame[frame_len++] = value;
+  if((frame_len == 2) && (value > (ANT_SIM_FRAME_MAX - 4)))
+  {
+    stats.bad_frames_from_host++;
+    frame_len = 0;
+    return;
+  }
+  if((frame_len >= 4) && (frame_len == (unsigned int)(frame[1] + 4)))
+  {
+    byte checksum = 0;
+    for(unsigned int i = 0; i < (frame_len - 1); i++)
+    {
+      checksum ^= frame[i];
+    }
+    if(checksum != frame[frame_len - 1])
+    {
+      //Dropped without an RTS -- the host times out
+      stats.bad_frames_from_host++;
+    }
+    else
+    {
+      handleFrame(now_us, frame);
+    }
+    frame_len = 0;
+  }
+}
+
+void ANTSimulator::handleFrame( unsigned long long now_us, const byte * frame )
+{
+  stats.frames_from_host++;
+  if(chance(faults.rts_missing))
+  {
+    stats.fault_rts_missing++;
+  }
+  else
+  {
+    rts(true);
+    rts_fall_us = now_us + ANT_SIM_RTS_US;
+  }
+  unsigned long long due_us = now_us + ANT_SIM_RESPONSE_US;
+  if(chance(faults.slow_response))
+  {
+    stats.fault_slow_response++;
+    due_us += faults.slow_response_us;
+  }
+
+  byte length = frame[1];
+  byte msg_id = frame[2];
+  const byte * data = &frame[3];
+  byte channel_number = data[0] & CHANNEL_NUMBER_MASK;
+  SimChannel * channel = (channel_number < ANT_SIM_CHANNELS) ? &channels[channel_number] : NULL;
+
+  switch(msg_id)
+  {
+    case MESG_SYSTEM_RESET_ID:
+      wipe();
+      boot(now_us, RESET_CMD);
+      break;
+
+    case MESG_REQUEST_ID:
+      if(data[1] == MESG_CAPABILITIES_ID)
+      {
+        queueResponse(due_us, MESG_CAPABILITIES_ID, capabilities, ANT_CAPABILITIES_LEN);
+      }
+      else
+      if(channel && (data[1] == MESG_CHANNEL_STATUS_ID))
+      {
+        byte status[2] = {channel_number, channel->status};
+        queueResponse(due_us, MESG_CHANNEL_STATUS_ID, status, sizeof(status));
+      }
+      else
+      if(channel && (data[1] == MESG_CHANNEL_ID_ID) && (channel->status != STATUS_UNASSIGNED_CHANNEL))
+      {
+        //The device being tracked -- otherwise the ID set on the channel
+        const ANT_DeviceId * id = (channel->tracked != NO_DEVICE) ? &devices[channel->tracked].id : &channel->id;
+        byte reply[5] = {channel_number, (byte)(id->device_number & 0xFF), (byte)(id->device_number >> 8), id->device_type, id->transmission_type};
+        queueResponse(due_us, MESG_CHANNEL_ID_ID, reply, sizeof(reply));
+      }
+      else
+      {
+        respond(due_us, channel_number, MESG_REQUEST_ID, (channel && (channel->status == STATUS_UNASSIGNED_CHANNEL)) ? CHANNEL_IN_WRONG_STATE : INVALID_MESSAGE);
+      }
+      break;
+
+    case MESG_BROADCAST_DATA_ID:
+    case MESG_ACKNOWLEDGED_DATA_ID:
+      //Sent with the next message on the channel -- no response
+      if(channel && (length > ANT_STANDARD_DATA_PAYLOAD_SIZE))
+      {
+        memcpy(channel->tx_payload, &data[1], ANT_STANDARD_DATA_PAYLOAD_SIZE);
+        if((msg_id == MESG_ACKNOWLEDGED_DATA_ID) && (channel->status >= STATUS_SEARCHING_CHANNEL))
+        {
+          channel->ack_pending = true;
+        }
+      }
+      break;
+
+    case MESG_OPEN_CHANNEL_ID:
+    case MESG_OPEN_RX_SCAN_ID:
+    {
+      boolean scan = (msg_id == MESG_OPEN_RX_SCAN_ID);
+      if(scan)
+      {
+        channel_number = 0;
+        channel = &channels[0];
+      }
+      if(!channel || (channel->status != STATUS_ASSIGNED_CHANNEL))
+      {
+        respond(due_us, channel_number, msg_id, CHANNEL_IN_WRONG_STATE);
+        break;
+      }
+      respond(due_us, channel_number, msg_id, RESPONSE_NO_ERROR);
+      channel->scan = scan;
+      openChannel(now_us, channel);
+      break;
+    }
+
+    case MESG_CLOSE_CHANNEL_ID:
+      if(!channel || (channel->status < STATUS_SEARCHING_CHANNEL))
+      {
+        respond(due_us, channel_number, msg_id, CHANNEL_IN_WRONG_STATE);
+        break;
+      }
+      respond(due_us, channel_number, msg_id, RESPONSE_NO_ERROR);
+      channel->status = STATUS_ASSIGNED_CHANNEL;
+      channel->tracked = NO_DEVICE;
+      channel->scan = false;
+      if(!(event_filter & ANT_EVENT_FILTER_CHANNEL_CLOSED))
+      {
+        byte event[3] = {channel_number, MESG_EVENT_ID, EVENT_CHANNEL_CLOSED};
+        queueResponse(due_us + ANT_SIM_CLOSE_US, MESG_RESPONSE_EVENT_ID, event, sizeof(event), true);
+      }
+      break;
+
+    default:
+      respond(due_us, data[0], msg_id, configureChannel(now_us, msg_id, data, length));
+      break;
+  }
+}
+
+//! Configuration messages. Returns the response code.
+byte ANTSimulator::configureChannel( unsigned long long now_us, byte msg_id, const byte * data, byte length )
+{
+  byte channel_number = data[0] & CHANNEL_NUMBER_MASK;
+  SimChannel * channel = (channel_number < ANT_SIM_CHANNELS) ? &channels[channel_number] : NULL;
+
+  //Module wide
+  switch(msg_id)
+  {
+    case MESG_ASSIGN_CHANNEL_ID:
+      if(!channel || (length < 3) || (data[2] >= ANT_SIM_NETWORKS))
+      {
+        return INVALID_MESSAGE;
+      }
+      if(channel->status != STATUS_UNASSIGNED_CHANNEL)
+      {
+        return CHANNEL_IN_WRONG_STATE;
+      }
+      memset(channel, 0, sizeof(*channel));
+      channel->status = STATUS_ASSIGNED_CHANNEL;
+      channel->type = data[1];
+      channel->network = data[2];
+      channel->tracked = NO_DEVICE;
+      //Module defaults
+      channel->period = 8192;
+      channel->freq = 66;
+      channel->hp_timeout = 4;
+      channel->lp_timeout = ANT_SIM_LP_DEFAULT;
+      return RESPONSE_NO_ERROR;
+
+    case MESG_UNASSIGN_CHANNEL_ID:
+      if(!channel)
+      {
+        return INVALID_MESSAGE;
+      }
+      if(channel->status != STATUS_ASSIGNED_CHANNEL)
+      {
+        return CHANNEL_IN_WRONG_STATE;
+      }
+      channel->status = STATUS_UNASSIGNED_CHANNEL;
+      return RESPONSE_NO_ERROR;
+
+    case MESG_NETWORK_KEY_ID:
+      if(data[0] >= ANT_SIM_NETWORKS)
+      {
+        return INVALID_MESSAGE;
+      }
+      network_key_set[data[0]] = true;
+      return RESPONSE_NO_ERROR;
+
+    case MESG_HIGH_DUTY_SEARCH_MODE_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_3] & CAPABILITIES_HIGH_DUTY_SEARCH_MODE_ENABLED))
+      {
+        return INVALID_MESSAGE;
+      }
+      high_duty_search = (data[1] != 0);
+      return RESPONSE_NO_ERROR;
+
+    case MESG_ANTLIB_CONFIG_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_2] & CAPABILITIES_EXT_MESSAGE_ENABLED))
+      {
+        return INVALID_MESSAGE;
+      }
+      lib_config = data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_EVENT_BUFFERING_CONFIG_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_3] & CAPABILITIES_EVENT_BUFFERING_ENABLED) || (length < 6))
+      {
+        return INVALID_MESSAGE;
+      }
+      flushEventBuffer(now_us);
+      buffer_config = data[1];
+      buffer_size_threshold = data[2] | (data[3] << 8);
+      buffer_time_us = (data[4] | (data[5] << 8)) * 10000UL;
+      if(buffer_size_threshold > ANT_SIM_EVENT_BUFFER)
+      {
+        buffer_size_threshold = ANT_SIM_EVENT_BUFFER;
+      }
+      return RESPONSE_NO_ERROR;
+
+    case MESG_EVENT_FILTER_CONFIG_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_3] & CAPABILITIES_EVENT_FILTERING_ENABLED) || (length < 3))
+      {
+        return INVALID_MESSAGE;
+      }
+      event_filter = data[1] | (data[2] << 8);
+      return RESPONSE_NO_ERROR;
+
+    case MESG_SDU_SET_MASK_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_3] & CAPABILITIES_SELECTIVE_DATA_UPDATE_ENABLED)
+         || (data[0] >= ANT_SIM_SDU_MASKS) || (length < (1 + ANT_STANDARD_DATA_PAYLOAD_SIZE)))
+      {
+        return INVALID_MESSAGE;
+      }
+      memcpy(sdu_masks[data[0]], &data[1], ANT_STANDARD_DATA_PAYLOAD_SIZE);
+      return RESPONSE_NO_ERROR;
+
+    default:
+      break;
+  }
+
+  //Per channel
+  if(!channel)
+  {
+    return INVALID_MESSAGE;
+  }
+  if(channel->status == STATUS_UNASSIGNED_CHANNEL)
+  {
+    return CHANNEL_IN_WRONG_STATE;
+  }
+  switch(msg_id)
+  {
+    case MESG_CHANNEL_ID_ID:
+      channel->id.device_number     = data[1] | (data[2] << 8);
+      channel->id.device_type       = data[3];
+      channel->id.transmission_type = data[4];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_CHANNEL_MESG_PERIOD_ID:
+      channel->period = data[1] | (data[2] << 8);
+      return (channel->period == 0) ? INVALID_PARAMETER_PROVIDED : RESPONSE_NO_ERROR;
+
+    case MESG_CHANNEL_SEARCH_TIMEOUT_ID:
+      channel->hp_timeout = data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_CHANNEL_RADIO_FREQ_ID:
+      channel->freq = data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_SET_LP_SEARCH_TIMEOUT_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS] & CAPABILITIES_LOW_PRIORITY_SEARCH_ENABLED))
+      {
+        return INVALID_MESSAGE;
+      }
+      channel->lp_timeout = data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_PROX_SEARCH_CONFIG_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_2] & CAPABILITIES_PROX_SEARCH_ENABLED))
+      {
+        return INVALID_MESSAGE;
+      }
+      if(data[1] > ANT_PROXIMITY_BIN_MAX)
+      {
+        return INVALID_PARAMETER_PROVIDED;
+      }
+      channel->proximity_bin = data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_SET_SEARCH_CH_PRIORITY_ID:
+      channel->priority = data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_ACTIVE_SEARCH_SHARING_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_3] & CAPABILITIES_ACTIVE_SEARCH_SHARING_MODE_ENABLED))
+      {
+        return INVALID_MESSAGE;
+      }
+      channel->sharing_cycles = data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_RSSI_SEARCH_THRESHOLD_ID:
+      channel->rssi_threshold = (signed char)data[1];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_ID_LIST_ADD_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS] & CAPABILITIES_SEARCH_LIST_ENABLED) || (data[5] >= ANT_ID_LIST_MAX_SIZE))
+      {
+        return INVALID_MESSAGE;
+      }
+      channel->id_list[data[5]].device_number     = data[1] | (data[2] << 8);
+      channel->id_list[data[5]].device_type       = data[3];
+      channel->id_list[data[5]].transmission_type = data[4];
+      return RESPONSE_NO_ERROR;
+
+    case MESG_ID_LIST_CONFIG_ID:
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS] & CAPABILITIES_SEARCH_LIST_ENABLED) || (data[1] > ANT_ID_LIST_MAX_SIZE))
+      {
+        return INVALID_MESSAGE;
+      }
+      channel->id_list_size = data[1];
+      channel->id_list_exclude = (data[2] != 0);
+      return RESPONSE_NO_ERROR;
+
+    case MESG_SDU_CONFIG_ID:
+    {
+      if(!(capabilities[ANT_CAPABILITIES_ADVANCED_OPTIONS_3] & CAPABILITIES_SELECTIVE_DATA_UPDATE_ENABLED))
+      {
+        return INVALID_MESSAGE;
+      }
+      byte page = data[1];
+      byte mask_number = data[2];
+      byte i = 0;
+      while((i < channel->sdu_count) && (channel->sdu_page[i] != page))
+      {
+        i++;
+      }
+      if(mask_number == ANT_SDU_MASK_DISABLED)
+      {
+        if(i < channel->sdu_count)
+        {
+          //Last one into the gap
+          channel->sdu_count--;
+          channel->sdu_page[i] = channel->sdu_page[channel->sdu_count];
+          channel->sdu_mask[i] = channel->sdu_mask[channel->sdu_count];
+          channel->sdu_valid[i] = false;
+        }
+        return RESPONSE_NO_ERROR;
+      }
+      if((mask_number >= ANT_SIM_SDU_MASKS) || ((i == channel->sdu_count) && (channel->sdu_count >= ANT_SIM_SDU_PAGES)))
+      {
+        return INVALID_MESSAGE;
+      }
+      if(i == channel->sdu_count)
+      {
+        channel->sdu_count++;
+      }
+      channel->sdu_page[i] = page;
+      channel->sdu_mask[i] = mask_number;
+      channel->sdu_valid[i] = false;
+      return RESPONSE_NO_ERROR;
+    }
+
+    default:
+      return INVALID_MESSAGE;
+  }
+}
+
+void ANTSimulator::respond( unsigned long long due_us, byte channel_number, byte msg_id, byte code )
+{
+  byte response[3] = {channel_number, msg_id, code};
+  queueResponse(due_us, MESG_RESPONSE_EVENT_ID, response, sizeof(response));
+}
+
+void ANTSimulator::queueResponse( unsigned long long due_us, byte msg_id, const byte * data, byte length, boolean event )
+{
+  for(byte i = 0; i < ANT_SIM_PENDING; i++)
+  {
+    if(pending[i].length == 0)
+    {
+      pending[i].due_us = due_us;
+      pending[i].event = event;
+      pending[i].length = build_frame(pending[i].frame, msg_id, data, length);
+      return;
+    }
+  }
+  stats.module_overflow++;
+}
+
+
+//Radio
+
+void ANTSimulator::openChannel( unsigned long long now_us, SimChannel * channel )
+{
+  //Devices kept time while nothing was listening
+  for(byte i = 0; i < device_count; i++)
+  {
+    unsigned long long period_us = ANT_SIM_PERIOD_US(devices[i].period);
+    if(devices[i].next_tx_us < now_us)
+    {
+      unsigned long long missed = ((now_us - devices[i].next_tx_us) / period_us) + 1;
+      devices[i].next_tx_us += missed * period_us;
+      devices[i].tx_count += missed;
+    }
+  }
+  accountRadio(now_us);
+  channel->tracked = NO_DEVICE;
+  channel->rx_fails = 0;
+  if(channel->scan || (channel->type & PARAMETER_TX_NOT_RX))
+  {
+    //Scanning or transmitting from the start
+    channel->status = STATUS_TRACKING_CHANNEL;
+    channel->next_tx_us = now_us + ANT_SIM_PERIOD_US(channel->period);
+    return;
+  }
+  startSearch(now_us, channel);
+}
+
+//! Low priority search, then high priority search. 0 turns either off and 255 is no timeout.
+void ANTSimulator::startSearch( unsigned long long now_us, SimChannel * channel )
+{
+  channel->status = STATUS_SEARCHING_CHANNEL;
+  channel->tracked = NO_DEVICE;
+  channel->rx_fails = 0;
+  channel->search_start_us = now_us;
+  if(channel->lp_timeout == 0xFF)
+  {
+    channel->lp_end_us = FOREVER;
+    channel->hp_end_us = FOREVER;
+    return;
+  }
+  channel->lp_end_us = now_us + (channel->lp_timeout * 2500000ULL);
+  channel->hp_end_us = (channel->hp_timeout == 0xFF) ? FOREVER : (channel->lp_end_us + (channel->hp_timeout * 2500000ULL));
+}
+
+void ANTSimulator::radioEvents( unsigned long long now_us )
+{
+  for(byte i = 0; i < device_count; i++)
+  {
+    if(devices[i].next_tx_us <= now_us)
+    {
+      deviceBroadcast(now_us, i);
+      devices[i].next_tx_us += ANT_SIM_PERIOD_US(devices[i].period);
+    }
+  }
+
+  for(byte c = 0; c < ANT_SIM_CHANNELS; c++)
+  {
+    SimChannel * channel = &channels[c];
+    if((channel->status == STATUS_SEARCHING_CHANNEL) && (channel->hp_end_us <= now_us))
+    {
+      stats.searches_timed_out++;
+      channel->status = STATUS_ASSIGNED_CHANNEL;
+      channelEvent(now_us, c, EVENT_RX_SEARCH_TIMEOUT);
+      channelEvent(now_us, c, EVENT_CHANNEL_CLOSED);
+    }
+    else
+    if((channel->status == STATUS_TRACKING_CHANNEL) && (channel->type & PARAMETER_TX_NOT_RX) && (channel->next_tx_us <= now_us))
+    {
+      stats.radio_on_us += ANT_SIM_RX_WINDOW_US;
+      channel->next_tx_us += ANT_SIM_PERIOD_US(channel->period);
+      channelEvent(now_us, c, channel->ack_pending ? EVENT_TRANSFER_TX_COMPLETED : EVENT_TX);
+      channel->ack_pending = false;
+    }
+  }
+}
+
+void ANTSimulator::deviceBroadcast( unsigned long long now_us, byte device_index )
+{
+  ANT_SimDevice * device = &devices[device_index];
+  byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE];
+  device->payload(device, payload);
+  device->tx_count++;
+  byte owner = searchOwner(now_us);
+
+  for(byte c = 0; c < ANT_SIM_CHANNELS; c++)
+  {
+    SimChannel * channel = &channels[c];
+    if(channel->type & PARAMETER_TX_NOT_RX)
+    {
+      continue;
+    }
+    if((channel->status == STATUS_TRACKING_CHANNEL) && channel->scan)
+    {
+      //Everything on the frequency that the ID list lets through
+      if(device->present && (device->freq == channel->freq))
+      {
+        SimChannel any = *channel;
+        memset(&any.id, 0, sizeof(any.id));
+        any.proximity_bin = 0;
+        any.rssi_threshold = 0;
+        if(searchMatches(&any, device))
+        {
+          sendData(now_us, c, device, payload);
+        }
+      }
+    }
+    else
+    if((channel->status == STATUS_TRACKING_CHANNEL) && (channel->tracked == device_index))
+    {
+      stats.radio_on_us += ANT_SIM_RX_WINDOW_US;
+      if(device->present)
+      {
+        channel->rx_fails = 0;
+        sendData(now_us, c, device, payload);
+        if(channel->ack_pending)
+        {
+          channel->ack_pending = false;
+          channelEvent(now_us, c, EVENT_TRANSFER_TX_COMPLETED);
+        }
+      }
+      else
+      if(++channel->rx_fails >= ANT_SIM_DROP_FAILS)
+      {
+        stats.drops++;
+        channelEvent(now_us, c, EVENT_RX_FAIL_GO_TO_SEARCH);
+        startSearch(now_us, channel);
+      }
+      else
+      {
+        channelEvent(now_us, c, EVENT_RX_FAIL);
+      }
+    }
+    else
+    if((channel->status == STATUS_SEARCHING_CHANNEL) && device->present && searchMatches(channel, device))
+    {
+      if(chance(searchDuty(now_us, c, owner) * ANT_SIM_SEARCH_CATCH))
+      {
+        stats.acquires++;
+        stats.acquire_us_total += now_us - channel->search_start_us;
+        channel->status = STATUS_TRACKING_CHANNEL;
+        channel->tracked = device_index;
+        channel->rx_fails = 0;
+        sendData(now_us, c, device, payload);
+      }
+    }
+  }
+}
+
+//! Channel with the high priority search (NO_CHANNEL for none). Highest priority, then the longest searching.
+//With search sharing the sharing channels take it in turns.
+byte ANTSimulator::searchOwner( unsigned long long now_us )
+{
+  byte owner = NO_CHANNEL;
+  byte sharing[ANT_SIM_CHANNELS];
+  byte sharing_count = 0;
+  for(byte c = 0; c < ANT_SIM_CHANNELS; c++)
+  {
+    const SimChannel * channel = &channels[c];
+    if((channel->status != STATUS_SEARCHING_CHANNEL) || (now_us < channel->lp_end_us) || (now_us >= channel->hp_end_us))
+    {
+      continue;
+    }
+    if(channel->sharing_cycles)
+    {
+      sharing[sharing_count++] = c;
+    }
+    if((owner == NO_CHANNEL) || (channel->priority > channels[owner].priority)
+       || ((channel->priority == channels[owner].priority) && (channel->search_start_us < channels[owner].search_start_us)))
+    {
+      owner = c;
+    }
+  }
+  if((owner != NO_CHANNEL) && channels[owner].sharing_cycles && (sharing_count > 1))
+  {
+    unsigned long long slice_us = channels[owner].sharing_cycles * (unsigned long long)ANT_SIM_SHARE_PERIOD_US;
+    owner = sharing[(now_us / slice_us) % sharing_count];
+  }
+  return owner;
+}
+
+float ANTSimulator::searchDuty( unsigned long long now_us, byte channel_number, byte owner )
+{
+  const SimChannel * channel = &channels[channel_number];
+  if(now_us < channel->lp_end_us)
+  {
+    return high_duty_search ? ANT_SIM_LP_HIGH_DUTY : ANT_SIM_LP_DUTY;
+  }
+  //Waiting for the high priority search
+  return (channel_number == owner) ? 1.0 : 0.0;
+}
+
+boolean ANTSimulator::searchMatches( const SimChannel * channel, const ANT_SimDevice * device )
+{
+  if(device->freq != channel->freq)
+  {
+    return false;
+  }
+  //Device number, type and transmission type of 0 match anything
+  if(channel->id.device_number && (channel->id.device_number != device->id.device_number))
+  {
+    return false;
+  }
+  byte device_type = channel->id.device_type & ~ANT_ID_DEVICE_TYPE_PAIRING_FLAG;
+  if(device_type && (device_type != device->id.device_type))
+  {
+    return false;
+  }
+  if(channel->id.transmission_type && (channel->id.transmission_type != device->id.transmission_type))
+  {
+    return false;
+  }
+  if(channel->proximity_bin && (device->proximity_bin > channel->proximity_bin))
+  {
+    return false;
+  }
+  if(channel->rssi_threshold && (device->rssi < channel->rssi_threshold))
+  {
+    return false;
+  }
+  if(channel->id_list_size)
+  {
+    boolean listed = false;
+    for(byte i = 0; (i < channel->id_list_size) && !listed; i++)
+    {
+      const ANT_DeviceId * id = &channel->id_list[i];
+      listed = (!id->device_number || (id->device_number == device->id.device_number))
+               && (!id->device_type || (id->device_type == device->id.device_type))
+               && (!id->transmission_type || (id->transmission_type == device->id.transmission_type));
+    }
+    if(listed == channel->id_list_exclude)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+//! Radio on time from the last call to now_us for the searching and scanning channels
+void ANTSimulator::accountRadio( unsigned long long now_us )
+{
+  if(now_us <= radio_accounted_us)
+  {
+    return;
+  }
+  unsigned long long from_us = radio_accounted_us;
+  radio_accounted_us = now_us;
+  byte owner = searchOwner(from_us);
+  for(byte c = 0; c < ANT_SIM_CHANNELS; c++)
+  {
+    const SimChannel * channel = &channels[c];
+    if((channel->status == STATUS_TRACKING_CHANNEL) && channel->scan)
+    {
+      stats.radio_on_us += now_us - from_us;
+    }
+    if(channel->status != STATUS_SEARCHING_CHANNEL)
+    {
+      continue;
+    }
+    stats.search_us += now_us - from_us;
+    float lp_duty = high_duty_search ? ANT_SIM_LP_HIGH_DUTY : ANT_SIM_LP_DUTY;
+    //Updates can be 1 us apart (millis()) -- keep the fraction
+    radio_fraction_us += lp_duty * overlap_us(from_us, now_us, channel->search_start_us, channel->lp_end_us);
+    unsigned long long whole_us = (unsigned long long)radio_fraction_us;
+    stats.radio_on_us += whole_us;
+    radio_fraction_us -= whole_us;
+    if(c == owner)
+    {
+      stats.radio_on_us += overlap_us(from_us, now_us, channel->lp_end_us, channel->hp_end_us);
+    }
+  }
+}
+
+
+//Module to host
+
+void ANTSimulator::channelEvent( unsigned long long now_us, byte channel_number, byte code )
+{
+  //Filter bits follow the event codes (EVENT_RX_SEARCH_TIMEOUT is bit 0)
+  if((code >= EVENT_RX_SEARCH_TIMEOUT) && (code <= EVENT_TRANSFER_TX_START) && (event_filter & (1 << (code - 1))))
+  {
+    stats.filtered_events++;
+    return;
+  }
+  byte event[3] = {channel_number, MESG_EVENT_ID, code};
+  byte frame[ANT_SIM_FRAME_MAX];
+  byte length = build_frame(frame, MESG_RESPONSE_EVENT_ID, event, sizeof(event));
+  stats.events_to_host++;
+  output(now_us, frame, length, (code == EVENT_RX_FAIL) || (code == EVENT_TX), false);
+}
+
+void ANTSimulator::sendData( unsigned long long now_us, byte channel_number, const ANT_SimDevice * device, const byte * payload )
+{
+  SimChannel * channel = &channels[channel_number];
+  if(!sduPasses(channel, payload))
+  {
+    stats.sdu_suppressed++;
+    return;
+  }
+  byte data[MESG_CHANNEL_NUM_SIZE + ANT_STANDARD_DATA_PAYLOAD_SIZE + MESG_EXT_MESG_BF_SIZE + ANT_EXT_MESG_DEVICE_ID_FIELD_SIZE];
+  byte length = 0;
+  data[length++] = channel_number;
+  memcpy(&data[length], payload, ANT_STANDARD_DATA_PAYLOAD_SIZE);
+  length += ANT_STANDARD_DATA_PAYLOAD_SIZE;
+  if(lib_config & ANT_LIB_CONFIG_MESG_OUT_INC_DEVICE_ID)
+  {
+    data[length++] = ANT_EXT_MESG_BITFIELD_DEVICE_ID;
+    data[length++] = device->id.device_number & 0xFF;
+    data[length++] = (device->id.device_number >> 8) & 0xFF;
+    data[length++] = device->id.device_type;
+    data[length++] = device->id.transmission_type;
+  }
+  byte frame[ANT_SIM_FRAME_MAX];
+  byte frame_length = build_frame(frame, MESG_BROADCAST_DATA_ID, data, length);
+  stats.data_to_host++;
+  output(now_us, frame, frame_length, true, false);
+}
+
+//! Selective Data Update -- a page with a mask only goes to the host when a masked bit changes
+boolean ANTSimulator::sduPasses( SimChannel * channel, const byte * payload )
+{
+  for(byte i = 0; i < channel->sdu_count; i++)
+  {
+    //Bit 7 of the page number is the ANT+ page change toggle
+    if(channel->sdu_page[i] != (payload[0] & 0x7F))
+    {
+      continue;
+    }
+    const byte * mask = sdu_masks[channel->sdu_mask[i]];
+    boolean changed = !channel->sdu_valid[i];
+    for(byte b = 0; (b < ANT_STANDARD_DATA_PAYLOAD_SIZE) && !changed; b++)
+    {
+      changed = ((payload[b] ^ channel->sdu_last[i][b]) & mask[b]) != 0;
+    }
+    if(changed)
+    {
+      memcpy(channel->sdu_last[i], payload, ANT_STANDARD_DATA_PAYLOAD_SIZE);
+      channel->sdu_valid[i] = true;
+    }
+    return changed;
+  }
+  return true;
+}
+
+//! Through event buffering (when on) to the wire. Command responses are never buffered.
+void ANTSimulator::output( unsigned long long now_us, const byte * frame, byte length, boolean low_priority, boolean command_response )
+{
+  byte copy[ANT_SIM_FRAME_MAX];
+  memcpy(copy, frame, length);
+  if(chance(faults.rx_corrupt))
+  {
+    stats.fault_rx_corrupt++;
+    copy[length - 1] ^= 0x55;
+  }
+  stats.frames_to_host++;
+
+  boolean buffering = (buffer_size_threshold != 0) || (buffer_time_us != 0);
+  if(buffering && !command_response && (low_priority || (buffer_config == ANT_EVENT_BUFFER_ALL)))
+  {
+    if((event_buffer_len + length) > ANT_SIM_EVENT_BUFFER)
+    {
+      flushEventBuffer(now_us);
+    }
+    if(event_buffer_len == 0)
+    {
+      event_buffer_start_us = now_us;
+    }
+    memcpy(&event_buffer[event_buffer_len], copy, length);
+    event_buffer_len += length;
+    if(buffer_size_threshold && (event_buffer_len >= buffer_size_threshold))
+    {
+      flushEventBuffer(now_us);
+    }
+    return;
+  }
+  if(buffering && !command_response)
+  {
+    //A high priority event takes the buffered ones out ahead of it
+    flushEventBuffer(now_us);
+  }
+  transmit(now_us, copy, length);
+}
+
+void ANTSimulator::flushEventBuffer( unsigned long long now_us )
+{
+  if(event_buffer_len)
+  {
+    transmit(now_us, event_buffer, event_buffer_len);
+    event_buffer_len = 0;
+  }
+}
+
+void ANTSimulator::transmit( unsigned long long now_us, const byte * bytes, unsigned int length )
+{
+  if((wire_count + length) > ANT_SIM_WIRE_BUFFER)
+  {
+    stats.module_overflow++;
+    return;
+  }
+  for(unsigned int i = 0; i < length; i++)
+  {
+    unsigned long long start_us = (wire_free_us > now_us) ? wire_free_us : now_us;
+    wire_free_us = start_us + byte_us;
+    stats.bytes_to_host++;
+    if(chance(faults.rx_drop))
+    {
+      //Noise on the line -- the byte time still passes
+      stats.fault_rx_drop++;
+      continue;
+    }
+    SimTimedByte * timed = &wire[(wire_head + wire_count) % ANT_SIM_WIRE_BUFFER];
+    timed->ready_us = wire_free_us;
+    timed->value = (host_baud == baud) ? bytes[i] : (byte)random32();
+    wire_count++;
+  }
+}
+
+//! Bytes that have finished arriving go into the host receive buffer (or are lost when it is full)
+void ANTSimulator::moveToHost( unsigned long long now_us )
+{
+  while(wire_count && (wire[wire_head].ready_us <= now_us))
+  {
+    const SimTimedByte * timed = &wire[wire_head];
+    wire_head = (wire_head + 1) % ANT_SIM_WIRE_BUFFER;
+    wire_count--;
+    if((timed->ready_us - last_arrival_us) > (2 * byte_us))
+    {
+      stats.uart_bursts++;
+    }
+    last_arrival_us = timed->ready_us;
+    if(host_rx_count >= ANT_SIM_HOST_RX_BUFFER)
+    {
+      stats.host_overrun++;
+      continue;
+    }
+    host_rx[(host_rx_head + host_rx_count) % ANT_SIM_HOST_RX_BUFFER] = timed->value;
+    host_rx_count++;
+  }
+}
+
+
+//xorshift32 -- repeatable per seed
+unsigned long ANTSimulator::random32()
+{
+  uint32_t x = (uint32_t)random_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state = x;
+  return x;
+}
+
+boolean ANTSimulator::chance( float probability )
+{
+  if(probability <= 0.0)
+  {
+    return false;
+  }
+  return ((random32() & 0xFFFFFF) < (unsigned long)(probability * 16777216.0));
+}
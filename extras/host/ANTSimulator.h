@@ -0,0 +1,306 @@
+//Copyright 2013 Brody Kenrick.
+//Simulated nRF24AP2 for running the library on a Linux host (see README.md in this directory)
+
+//The simulator is the Stream handed to ANTPlus::begin(). It drives the RTS pin and follows the
+// RESET, SLEEP and SUSPEND pins through the host pin model (ArduinoHost.cpp). All timing is on the host virtual clock.
+//Module
+// Bytes cross the UART at the baud rate. Each frame from the host gets an RTS pulse and then its response.
+// Channels are assigned, configured, opened and closed as on the module with the same responses and channel events.
+// Event buffering, event filtering, Selective Data Update, ID lists and extended data (device ID) are followed.
+//Radio
+// Simulated devices broadcast once per period. A searching channel catches a matching broadcast with a chance that
+// follows its share of the radio -- low priority then high priority search, high duty search, search priority and
+// sharing -- from a seeded generator so every run repeats. A tracking channel gets every broadcast of its device
+// (EVENT_RX_FAIL while it is out of range, EVENT_RX_FAIL_GO_TO_SEARCH after ANT_SIM_DROP_FAILS in a row).
+//Faults (ANT_SimFaults)
+// Bytes lost either way, frames to the host with a bad checksum, missing RTS pulses and slow responses.
+
+#ifndef ANTSimulator_h
+#define ANTSimulator_h
+
+#include <Arduino.h>
+#include "ANTPlus.h"
+
+#define ANT_SIM_CHANNELS           (8)
+#define ANT_SIM_NETWORKS           (3)
+#define ANT_SIM_DEVICES            (64)
+#define ANT_SIM_SDU_MASKS          (8)
+#define ANT_SIM_SDU_PAGES          (8)      //!< Data pages with an SDU mask per channel
+
+#define ANT_SIM_HOST_RX_BUFFER     (64)     //!< Host UART receive buffer (as SoftwareSerial). Bytes arriving when it is full are lost.
+#define ANT_SIM_WIRE_BUFFER        (1024)   //!< Module serial queue. Messages that do not fit are lost (ANT_SimStats::module_overflow).
+#define ANT_SIM_HOST_TX_BUFFER     (256)
+#define ANT_SIM_EVENT_BUFFER       (256)    //!< Event buffering space on the module
+#define ANT_SIM_PENDING            (8)      //!< Responses waiting on ANT_SIM_RESPONSE_US
+#define ANT_SIM_FRAME_MAX          (64)     //!< Longest frame either way (sync to checksum)
+
+#define ANT_SIM_STARTUP_US         (2000)   //!< Reset released (or reset command) to the startup message
+#define ANT_SIM_RTS_US             (50)     //!< RTS high time after each frame
+#define ANT_SIM_RESPONSE_US        (300)    //!< Frame received to its response starting out
+#define ANT_SIM_FRAME_GAP_US       (5000)   //!< A partial frame is dropped after this long without a byte
+#define ANT_SIM_CLOSE_US           (1000)   //!< Close command to EVENT_CHANNEL_CLOSED
+
+#define ANT_SIM_SEARCH_CATCH       (0.9)    //!< Chance a broadcast is caught while the search is listening on its channel
+#define ANT_SIM_LP_DUTY            (0.25)   //!< Share of the radio for a low priority search
+#define ANT_SIM_LP_HIGH_DUTY       (0.6)    //!< ... with high duty search mode on
+#define ANT_SIM_LP_DEFAULT         (2)      //!< Low priority search timeout (2.5 s units) until one is set
+#define ANT_SIM_SHARE_PERIOD_US    (50000)  //!< One search sharing cycle
+#define ANT_SIM_RX_WINDOW_US       (1500)   //!< Radio on per channel period while tracking
+#define ANT_SIM_DROP_FAILS         (8)
+
+#define ANT_SIM_PERIOD_US(period)  (((unsigned long long)(period) * 1000000ULL) / 32768ULL) //!< Channel period (32768ths of a second) in us
+
+
+//! Fault injection. Each is a chance per byte or per frame (0 for none).
+typedef struct ANT_SimFaults_struct
+{
+   float rx_drop;                      //!< Byte to the host lost
+   float rx_corrupt;                   //!< Frame to the host with a bad checksum
+   float tx_drop;                      //!< Byte from the host lost
+   float rts_missing;                  //!< Frame from the host with no RTS pulse
+   float slow_response;                //!< Response held back by slow_response_us
+   unsigned long slow_response_us;
+} ANT_SimFaults;
+
+struct ANT_SimDevice_struct;
+//! Fills the next data page of a device. The default is HRM-like (page 4, toggle bit, a beat every fourth message).
+typedef void (*ANT_SimPayload)( struct ANT_SimDevice_struct * device, byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE] );
+
+//! A device on air. Change present, proximity_bin or rssi at any time.
+typedef struct ANT_SimDevice_struct
+{
+   ANT_DeviceId id;
+   byte freq;
+   unsigned int period;                //!< Broadcast period (32768ths of a second)
+   byte proximity_bin;                 //!< Distance (1 nearest .. ANT_PROXIMITY_BIN_MAX)
+   signed char rssi;                   //!< dBm at the module
+   boolean present;                    //!< In range and transmitting
+   ANT_SimPayload payload;
+
+   unsigned long tx_count;             //!< Broadcasts so far
+   byte heart_beat_count;              //Used by the default payload
+   byte heart_rate;
+   unsigned long long next_tx_us;      //Private for internal use only
+} ANT_SimDevice;
+
+//! Counters since construction or resetStats()
+typedef struct ANT_SimStats_struct
+{
+   unsigned long long since_us;
+   unsigned long long radio_on_us;     //!< Searching, tracking and scanning. See ANTSimulator::radioDuty().
+   unsigned long long search_us;       //!< Channel time spent searching (summed over channels)
+
+   unsigned long frames_from_host;
+   unsigned long bad_frames_from_host; //!< Bad checksum or cut short
+   unsigned long frames_to_host;
+   unsigned long bytes_to_host;
+   unsigned long data_to_host;         //!< Data messages (broadcast, acknowledged)
+   unsigned long events_to_host;       //!< Channel events
+   unsigned long uart_bursts;          //!< Transfers to the host starting on an idle line -- each one wakes a sleeping host
+   unsigned long host_overrun;         //!< Bytes lost to a full host receive buffer
+   unsigned long module_overflow;      //!< Messages lost to a full module serial queue
+   unsigned long lost_asleep;          //!< Bytes from the host while the UART was asleep, suspended or in reset
+
+   unsigned long rts_pulses;
+   unsigned long acquires;
+   unsigned long long acquire_us_total; //!< Open (or drop) to acquire
+   unsigned long searches_timed_out;
+   unsigned long drops;
+   unsigned long sdu_suppressed;
+   unsigned long filtered_events;
+   unsigned long resets;
+
+   unsigned long fault_rx_drop;
+   unsigned long fault_rx_corrupt;
+   unsigned long fault_tx_drop;
+   unsigned long fault_rts_missing;
+   unsigned long fault_slow_response;
+} ANT_SimStats;
+
+
+class ANTSimulator : public Stream
+{
+  public:
+    ANTSimulator( byte RTS_PIN, byte SUSPEND_PIN, byte SLEEP_PIN, byte RESET_PIN, unsigned long baud_rate = ANT_BAUD_RATE_DEFAULT, unsigned long seed = 1 );
+    ~ANTSimulator();
+
+    //Stream -- the host UART
+    int    available();
+    int    read();
+    int    peek();
+    size_t write( uint8_t c );
+    using Print::write;
+
+    //! The host UART rate (e.g. from an ANT_SetBaudRate). Anything other than the module rate garbles both ways.
+    void setHostBaud( unsigned long baud_rate ) {host_baud = baud_rate;};
+    unsigned long getBaud() {return baud;};
+    //! SoftwareSerial (the default) keeps the host busy for each byte it sends. Off for a buffered hardware UART.
+    void setBlockingWrites( boolean blocking ) {blocking_writes = blocking;};
+
+    //! NULL if ANT_SIM_DEVICES are on air. The rest (bin 1, -50 dBm, present, HRM-like payload) can be changed on the returned device.
+    ANT_SimDevice * addDevice( unsigned int device_number, byte device_type, byte transmission_type, unsigned int period, byte freq = DEVCE_SENSOR_FREQ );
+    ANT_SimDevice * device( byte index ) {return (index < device_count) ? &devices[index] : NULL;};
+    byte            deviceCount() {return device_count;};
+
+    void setFaults( const ANT_SimFaults * faults );
+    void setCapabilities( const byte capabilities[ANT_CAPABILITIES_LEN] );
+    //! STATUS_*_CHANNEL and the tracked device (NULL for none)
+    byte            channelStatus( byte channel_number );
+    ANT_SimDevice * trackedDevice( byte channel_number );
+
+    const ANT_SimStats * getStats() {return &stats;};
+    void  resetStats();
+    float radioDuty(); //!< Radio on time over the stats window
+
+    static void hrm_payload( ANT_SimDevice * device, byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE] );
+
+  private:
+    typedef struct SimChannel_struct
+    {
+       byte status;
+       byte type;
+       byte network;
+       ANT_DeviceId id;
+       unsigned int period;
+       byte freq;
+       byte hp_timeout;
+       byte lp_timeout;
+       byte proximity_bin;
+       signed char rssi_threshold;
+       byte priority;
+       byte sharing_cycles;
+       boolean scan;
+       ANT_DeviceId id_list[ANT_ID_LIST_MAX_SIZE];
+       byte id_list_size;
+       boolean id_list_exclude;
+       byte sdu_page[ANT_SIM_SDU_PAGES];
+       byte sdu_mask[ANT_SIM_SDU_PAGES];
+       boolean sdu_valid[ANT_SIM_SDU_PAGES];
+       byte sdu_last[ANT_SIM_SDU_PAGES][ANT_STANDARD_DATA_PAYLOAD_SIZE];
+       byte sdu_count;
+
+       unsigned long long search_start_us;
+       unsigned long long lp_end_us;   //!< 0 for no end
+       unsigned long long hp_end_us;
+       unsigned long long next_tx_us;  //!< Master channels
+       byte tracked;                   //!< Device index (ANT_SIM_DEVICES for none)
+       byte rx_fails;
+       boolean ack_pending;
+       byte tx_payload[ANT_STANDARD_DATA_PAYLOAD_SIZE];
+    } SimChannel;
+
+    typedef struct SimTimedByte_struct
+    {
+       unsigned long long ready_us;
+       byte value;
+    } SimTimedByte;
+
+    typedef struct SimPending_struct
+    {
+       unsigned long long due_us;
+       byte length;                    //!< 0 for a free slot
+       boolean event;                  //!< A channel event (buffered and filtered) rather than a command response
+       byte frame[ANT_SIM_FRAME_MAX];
+    } SimPending;
+
+    static void tick( void * context, unsigned long long now_us );
+    void update( unsigned long long now_us );
+    unsigned long long nextEventUs();
+    void followPins( unsigned long long now_us );
+    void wipe();
+    void boot( unsigned long long now_us, byte reason );
+
+    void receiveByte( unsigned long long now_us, byte value );
+    void handleFrame( unsigned long long now_us, const byte * frame );
+    void respond( unsigned long long now_us, byte channel_number, byte msg_id, byte code );
+    void queueResponse( unsigned long long due_us, byte msg_id, const byte * data, byte length, boolean event = false );
+    byte configureChannel( unsigned long long now_us, byte msg_id, const byte * data, byte length );
+
+    void openChannel( unsigned long long now_us, SimChannel * channel );
+    void startSearch( unsigned long long now_us, SimChannel * channel );
+    void radioEvents( unsigned long long now_us );
+    void deviceBroadcast( unsigned long long now_us, byte device_index );
+    byte searchOwner( unsigned long long now_us );
+    float searchDuty( unsigned long long now_us, byte channel_number, byte owner );
+    boolean searchMatches( const SimChannel * channel, const ANT_SimDevice * device );
+    void accountRadio( unsigned long long now_us );
+
+    void channelEvent( unsigned long long now_us, byte channel_number, byte code );
+    void sendData( unsigned long long now_us, byte channel_number, const ANT_SimDevice * device, const byte * payload );
+    boolean sduPasses( SimChannel * channel, const byte * payload );
+    void output( unsigned long long now_us, const byte * frame, byte length, boolean low_priority, boolean command_response );
+    void flushEventBuffer( unsigned long long now_us );
+    void transmit( unsigned long long now_us, const byte * bytes, unsigned int length );
+    void moveToHost( unsigned long long now_us );
+
+    void rts( boolean high );
+    unsigned long random32();
+    boolean chance( float probability );
+
+  private:
+    byte RTS_PIN;
+    byte SUSPEND_PIN;
+    byte SLEEP_PIN;
+    byte RESET_PIN;
+    unsigned long baud;
+    unsigned long host_baud;
+    unsigned long byte_us;
+    boolean blocking_writes;
+    unsigned long random_state;
+
+    ANT_SimFaults faults;
+    ANT_SimStats stats;
+    byte capabilities[ANT_CAPABILITIES_LEN];
+
+    //Module state
+    boolean in_reset;
+    boolean suspended;
+    boolean booting;
+    unsigned long long boot_due_us;
+    byte boot_reason;
+    unsigned long long rts_fall_us;   //!< 0 when RTS is not pulsing
+    boolean rts_level;
+    unsigned long long processed_us;
+    unsigned long long radio_accounted_us;
+    double radio_fraction_us;         //!< Low priority search time below 1 us carried to the next update
+    boolean updating;
+
+    SimChannel channels[ANT_SIM_CHANNELS];
+    boolean network_key_set[ANT_SIM_NETWORKS];
+    byte lib_config;
+    boolean high_duty_search;
+    unsigned int event_filter;
+    byte buffer_config;
+    unsigned int buffer_size_threshold;
+    unsigned long buffer_time_us;
+    byte event_buffer[ANT_SIM_EVENT_BUFFER];
+    unsigned int event_buffer_len;
+    unsigned long long event_buffer_start_us;
+    byte sdu_masks[ANT_SIM_SDU_MASKS][ANT_STANDARD_DATA_PAYLOAD_SIZE];
+
+    ANT_SimDevice devices[ANT_SIM_DEVICES];
+    byte device_count;
+
+    //Host to module
+    SimTimedByte host_tx[ANT_SIM_HOST_TX_BUFFER];
+    unsigned int host_tx_head;
+    unsigned int host_tx_count;
+    unsigned long long host_line_free_us;
+    byte frame[ANT_SIM_FRAME_MAX];
+    unsigned int frame_len;
+    unsigned long long frame_last_us;
+
+    SimPending pending[ANT_SIM_PENDING];
+
+    //Module to host
+    SimTimedByte wire[ANT_SIM_WIRE_BUFFER];
+    unsigned int wire_head;
+    unsigned int wire_count;
+    unsigned long long wire_free_us;
+    unsigned long long last_arrival_us;
+    byte host_rx[ANT_SIM_HOST_RX_BUFFER];
+    unsigned int host_rx_head;
+    unsigned int host_rx_count;
+};
+
+#endif //ANTSimulator_h
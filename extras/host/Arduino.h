@@ -0,0 +1,119 @@
+//Copyright 2013 Brody Kenrick.
+//Host (Linux) stand-in for the Arduino core -- enough of it to build the library, ANTSimulator and the benches
+
+//Virtual clock
+// millis() and micros() read a simulated clock that starts at 0. Every call moves it on by
+// host_call_us so busy waits in the library still finish. delay() and host_advance_us() move it on further.
+// Tick handlers (e.g. an ANTSimulator) run each time it moves and see the time it moved to.
+//Real time
+// host_set_real_time() makes the clock follow CLOCK_MONOTONIC instead (for a real port, see ANTPosixSerial).
+// delay() and delayMicroseconds() then sleep. host_advance_us() only catches the clock up.
+//Pins
+// digitalWrite() levels are kept per pin and read back with digitalRead().
+// host_drive_pin() is the outside world changing an input (e.g. RTS). It runs the attachInterrupt()
+// handler for that pin straight away -- or from interrupts() if they are held off at the time.
+//Threads
+// Clock, pins, interrupts and tick handlers are per thread -- each thread is a board of its own (see ANTGateway).
+// The library RTS interrupt slots (ANTPLUS_MAX_INSTANCES) are per thread too.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#define ANTPLUS_HOST //!< The library uses host_interrupts_enabled() and per thread RTS slots on this core (not on Linux boards)
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HIGH (0x1)
+#define LOW  (0x0)
+
+#define INPUT        (0x0)
+#define OUTPUT       (0x1)
+#define INPUT_PULLUP (0x2)
+
+#define CHANGE  (1)
+#define FALLING (2)
+#define RISING  (3)
+
+#define DEC (10)
+#define HEX (16)
+#define OCT (8)
+#define BIN (2)
+
+#define PROGMEM
+#define PGM_P                const char *
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_ptr(addr)   (*(void * const *)(addr))
+#define strcpy_P             strcpy
+#define strlen_P             strlen
+#define memcpy_P             memcpy
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+#define HOST_PINS             (64)
+#define HOST_TICK_HANDLERS    (4)
+#define NOT_AN_INTERRUPT      (-1)
+#define digitalPinToInterrupt(p) (((p) < HOST_PINS) ? (p) : NOT_AN_INTERRUPT) //!< Every pin can interrupt
+
+unsigned long millis();
+unsigned long micros();
+void delay( unsigned long ms );
+void delayMicroseconds( unsigned int us );
+
+void pinMode( uint8_t pin, uint8_t mode );
+void digitalWrite( uint8_t pin, uint8_t level );
+int  digitalRead( uint8_t pin );
+
+void attachInterrupt( uint8_t interrupt, void (*isr)(void), int mode );
+void detachInterrupt( uint8_t interrupt );
+void noInterrupts();
+void interrupts();
+
+//Host only
+typedef void (*HostTickHandler)( void * context, unsigned long long now_us );
+
+extern unsigned long host_call_us;  //!< Clock advance per millis()/micros() call (the cost of a busy wait loop)
+
+unsigned long long host_now_us();   //!< The clock without moving it
+void    host_advance_us( unsigned long long us );
+boolean host_add_tick_handler( HostTickHandler handler, void * context );
+void    host_remove_tick_handler( HostTickHandler handler, void * context );
+void    host_drive_pin( uint8_t pin, uint8_t level );
+void    host_reset(); //!< Clock back to 0, pins low, interrupts and tick handlers removed -- between bench runs
+void    host_set_real_time( boolean real_time ); //!< Carries on from the current clock value
+boolean host_interrupts_enabled();  //!< False inside a handler or between noInterrupts() and interrupts()
+
+#include "Stream.h"
+
+//! Console. Goes to stdout (setOutput(NULL) to silence the library debug output).
+class HostSerial : public Stream
+{
+  public:
+    HostSerial() : out(stdout) {};
+    void begin( unsigned long baud_rate ) {(void)baud_rate;};
+    void end() {};
+    void setOutput( FILE * out ) {this->out = out;};
+
+    int    available() {return 0;};
+    int    read() {return -1;};
+    int    peek() {return -1;};
+    size_t write( uint8_t c ) {return out ? fwrite(&c, 1, 1, out) : 1;};
+    using Print::write;
+
+  private:
+    FILE * out;
+};
+
+extern HostSerial Serial;
+extern HostSerial Serial1;
+
+#endif //Arduino_h
@@ -0,0 +1,285 @@
+//Copyright 2013 Brody Kenrick.
+//Host (Linux) Arduino core -- virtual clock, pins and interrupts (see Arduino.h)
+
+#include <Arduino.h>
+#include <time.h>
+
+HostSerial Serial;
+HostSerial Serial1;
+
+unsigned long host_call_us = 1;
+
+//Each thread is a board of its own (see Arduino.h)
+static __thread unsigned long long clock_us = 0;
+
+typedef struct HostTick_struct
+{
+   HostTickHandler handler;
+   void * context;
+} HostTick;
+
+static __thread HostTick tick_handlers[HOST_TICK_HANDLERS];
+static __thread boolean  ticking = false; //!< Handlers read the clock too -- they must not move it again
+
+static __thread boolean  real_time = false;
+static __thread unsigned long long real_base_us; //!< CLOCK_MONOTONIC when the clock was 0
+
+static __thread byte    pin_level[HOST_PINS];
+static __thread void    (*pin_isr[HOST_PINS])(void);
+static __thread int     pin_isr_mode[HOST_PINS];
+static __thread boolean pin_isr_pending[HOST_PINS];
+static __thread boolean interrupts_enabled = true;
+static __thread boolean in_isr = false;
+
+
+static void run_tick_handlers()
+{
+  if(ticking)
+  {
+    return;
+  }
+  ticking = true;
+  for(byte i = 0; i < HOST_TICK_HANDLERS; i++)
+  {
+    if(tick_handlers[i].handler)
+    {
+      tick_handlers[i].handler(tick_handlers[i].context, clock_us);
+    }
+  }
+  ticking = false;
+}
+
+static unsigned long long monotonic_us()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((unsigned long long)now.tv_sec * 1000000ULL) + (now.tv_nsec / 1000);
+}
+
+void host_advance_us( unsigned long long us )
+{
+  if(ticking)
+  {
+    //Called back from a handler -- time is already where it should be
+    return;
+  }
+  if(real_time)
+  {
+    unsigned long long now_us = monotonic_us() - real_base_us;
+    if(now_us <= clock_us)
+    {
+      return;
+    }
+    clock_us = now_us;
+  }
+  else
+  {
+    clock_us += us;
+  }
+  run_tick_handlers();
+}
+
+void host_set_real_time( boolean real_time )
+{
+  ::real_time = real_time;
+  real_base_us = monotonic_us() - clock_us;
+}
+
+unsigned long long host_now_us()
+{
+  return clock_us;
+}
+
+boolean host_add_tick_handler( HostTickHandler handler, void * context )
+{
+  for(byte i = 0; i < HOST_TICK_HANDLERS; i++)
+  {
+    if(tick_handlers[i].handler == NULL)
+    {
+      tick_handlers[i].handler = handler;
+      tick_handlers[i].context = context;
+      return true;
+    }
+  }
+  return false;
+}
+
+void host_remove_tick_handler( HostTickHandler handler, void * context )
+{
+  for(byte i = 0; i < HOST_TICK_HANDLERS; i++)
+  {
+    if((tick_handlers[i].handler == handler) && (tick_handlers[i].context == context))
+    {
+      tick_handlers[i].handler = NULL;
+      tick_handlers[i].context = NULL;
+    }
+  }
+}
+
+void host_reset()
+{
+  clock_us = 0;
+  memset(tick_handlers, 0, sizeof(tick_handlers));
+  memset(pin_level, 0, sizeof(pin_level));
+  memset(pin_isr, 0, sizeof(pin_isr));
+  memset(pin_isr_pending, 0, sizeof(pin_isr_pending));
+  interrupts_enabled = true;
+  in_isr = false;
+  real_time = false;
+}
+
+
+unsigned long millis()
+{
+  host_advance_us(host_call_us);
+  return (unsigned long)(clock_us / 1000ULL);
+}
+
+unsigned long micros()
+{
+  host_advance_us(host_call_us);
+  return (unsigned long)clock_us;
+}
+
+static void sleep_us( unsigned long long us )
+{
+  struct timespec wait;
+  wait.tv_sec = us / 1000000ULL;
+  wait.tv_nsec = (us % 1000000ULL) * 1000;
+  nanosleep(&wait, NULL);
+}
+
+void delay( unsigned long ms )
+{
+  if(real_time)
+  {
+    sleep_us(ms * 1000ULL);
+  }
+  host_advance_us(ms * 1000ULL);
+}
+
+void delayMicroseconds( unsigned int us )
+{
+  if(real_time)
+  {
+    sleep_us(us);
+  }
+  host_advance_us(us);
+}
+
+
+//Interrupts
+
+static void run_isr( byte pin )
+{
+  //As on the AVR -- no nesting
+  pin_isr_pending[pin] = false;
+  in_isr = true;
+  interrupts_enabled = false;
+  pin_isr[pin]();
+  interrupts_enabled = true;
+  in_isr = false;
+}
+
+static void run_pending_isrs()
+{
+  for(byte pin = 0; pin < HOST_PINS; pin++)
+  {
+    if(pin_isr_pending[pin] && pin_isr[pin] && interrupts_enabled && !in_isr)
+    {
+      run_isr(pin);
+    }
+  }
+}
+
+void attachInterrupt( uint8_t interrupt, void (*isr)(void), int mode )
+{
+  if(interrupt < HOST_PINS)
+  {
+    pin_isr[interrupt] = isr;
+    pin_isr_mode[interrupt] = mode;
+    pin_isr_pending[interrupt] = false;
+  }
+}
+
+void detachInterrupt( uint8_t interrupt )
+{
+  if(interrupt < HOST_PINS)
+  {
+    pin_isr[interrupt] = NULL;
+    pin_isr_pending[interrupt] = false;
+  }
+}
+
+void noInterrupts()
+{
+  interrupts_enabled = false;
+}
+
+boolean host_interrupts_enabled()
+{
+  return interrupts_enabled;
+}
+
+void interrupts()
+{
+  if(in_isr)
+  {
+    return;
+  }
+  interrupts_enabled = true;
+  run_pending_isrs();
+}
+
+
+//Pins
+
+void pinMode( uint8_t pin, uint8_t mode )
+{
+  if((pin < HOST_PINS) && (mode == INPUT_PULLUP))
+  {
+    pin_level[pin] = HIGH;
+  }
+}
+
+void digitalWrite( uint8_t pin, uint8_t level )
+{
+  if(pin < HOST_PINS)
+  {
+    pin_level[pin] = level ? HIGH : LOW;
+  }
+}
+
+int digitalRead( uint8_t pin )
+{
+  return (pin < HOST_PINS) ? pin_level[pin] : LOW;
+}
+
+void host_drive_pin( uint8_t pin, uint8_t level )
+{
+  if(pin >= HOST_PINS)
+  {
+    return;
+  }
+  level = level ? HIGH : LOW;
+  if(pin_level[pin] == level)
+  {
+    return;
+  }
+  pin_level[pin] = level;
+
+  if(pin_isr[pin] == NULL)
+  {
+    return;
+  }
+  int mode = pin_isr_mode[pin];
+  if((mode == CHANGE) || ((mode == RISING) && (level == HIGH)) || ((mode == FALLING) && (level == LOW)))
+  {
+    //A second edge before the handler runs is lost -- as with the AVR flag
+    pin_isr_pending[pin] = true;
+    if(interrupts_enabled && !in_isr)
+    {
+      run_isr(pin);
+    }
+  }
+}
@@ -0,0 +1,138 @@
+//Copyright 2013 Brody Kenrick.
+//Shared by the gateway benches (bench_gateway.cpp, bench_shm.cpp) -- simulated modules for ANTGateway
+
+//Each module is an ANTSimulator on its reader's board with eight channels: four HRMs, two power meters, a trainer
+// and a speed and cadence sensor. Its clock runs SIM_SPEEDUP times real time so a module sends SIM_SPEEDUP times
+// the data of a real one.
+
+#ifndef GatewayBench_h
+#define GatewayBench_h
+
+#include <Arduino.h>
+#include <time.h>
+
+#include "HostBench.h"
+#include "ANTGateway.h"
+
+#if ANT_DEVICE_NUMBER_CHANNELS < 8
+#error "Build with -DANT_DEVICE_NUMBER_CHANNELS=8"
+#endif
+
+#define CHANNELS           (8)
+#define SIM_SPEEDUP        (25)
+#define SIM_STEP_US        (1000)     //!< Module time per wait()
+
+static const byte channel_types[CHANNELS] = {DEVCE_TYPE_HRM, DEVCE_TYPE_HRM, DEVCE_TYPE_HRM, DEVCE_TYPE_HRM,
+                                             DEVCE_TYPE_POWER, DEVCE_TYPE_POWER, DEVCE_TYPE_FITNESS_EQUIPMENT, DEVCE_TYPE_SPEED_AND_CADENCE};
+
+static inline void sleep_us( unsigned long long us )
+{
+  struct timespec sleep_time;
+  sleep_time.tv_sec = us / 1000000ULL;
+  sleep_time.tv_nsec = (us % 1000000ULL) * 1000ULL;
+  nanosleep(&sleep_time, NULL);
+}
+
+
+//Simulated sensors
+
+static inline void power_payload( ANT_SimDevice * device, byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE] )
+{
+  unsigned int power = 150 + (device->tx_count % 50);
+  payload[0] = DATA_PAGE_POWER_POWER_ONLY;
+  payload[1] = device->tx_count & 0xFF;
+  payload[2] = 0xFF;
+  payload[3] = 85 + (device->tx_count % 10);
+  payload[4] = (power * device->tx_count) & 0xFF;
+  payload[5] = ((power * device->tx_count) >> 8) & 0xFF;
+  payload[6] = power & 0xFF;
+  payload[7] = power >> 8;
+}
+
+static inline void trainer_payload( ANT_SimDevice * device, byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE] )
+{
+  unsigned int power = 200 + (device->tx_count % 20);
+  memset(payload, 0xFF, ANT_STANDARD_DATA_PAYLOAD_SIZE);
+  if(device->tx_count & 1)
+  {
+    payload[0] = GENERAL_FE_DATA_PAGE;
+    payload[6] = 120 + (device->tx_count % 30);
+    return;
+  }
+  payload[0] = DATA_PAGE_SPECIFIC_TRAINER_DATA_PAGE;
+  payload[1] = device->tx_count & 0xFF;
+  payload[2] = 90;
+  payload[5] = power & 0xFF;
+  payload[6] = (power >> 8) & 0x0F;
+}
+
+static inline void cadence_payload( ANT_SimDevice * device, byte payload[ANT_STANDARD_DATA_PAYLOAD_SIZE] )
+{
+  //A revolution every 0.75 s (80 rpm) on a 4 Hz channel
+  unsigned long time_1024 = (device->tx_count * 1024UL) / 4;
+  unsigned int revolutions = (unsigned int)((time_1024 * 4) / (3 * 1024));
+  unsigned int event_time = (unsigned int)(((unsigned long)revolutions * 3 * 1024) / 4);
+  payload[0] = event_time & 0xFF;
+  payload[1] = (event_time >> 8) & 0xFF;
+  payload[2] = revolutions & 0xFF;
+  payload[3] = (revolutions >> 8) & 0xFF;
+  payload[4] = payload[0];
+  payload[5] = payload[1];
+  payload[6] = payload[2];
+  payload[7] = payload[3];
+}
+
+//! A module on the reader's board, paced to SIM_SPEEDUP times real time
+class SimPort : public ANTGatewayPort
+{
+  public:
+    SimPort() : sim(NULL), start_ns(0) {};
+
+    Stream * open()
+    {
+      sim = new ANTSimulator(ANT_GATEWAY_RTS_PIN, ANT_GATEWAY_SUSPEND_PIN, ANT_GATEWAY_SLEEP_PIN, ANT_GATEWAY_RESET_PIN, 57600);
+      for(byte c = 0; c < CHANNELS; c++)
+      {
+        ANT_SimDevice * device = sim->addDevice(1000 + c, channel_types[c], 1, DEVCE_GPS_RATE);
+        switch(channel_types[c])
+        {
+          case DEVCE_TYPE_POWER:              device->payload = power_payload;   break;
+          case DEVCE_TYPE_FITNESS_EQUIPMENT:  device->payload = trainer_payload; break;
+          case DEVCE_TYPE_SPEED_AND_CADENCE:  device->payload = cadence_payload; break;
+        }
+      }
+      start_ns = ANTGateway::now_ns();
+      return sim;
+    };
+
+    void wait()
+    {
+      host_advance_us(SIM_STEP_US);
+      unsigned long long real_us = (ANTGateway::now_ns() - start_ns) / 1000ULL;
+      unsigned long long due_us = host_now_us() / SIM_SPEEDUP;
+      if(due_us > real_us)
+      {
+        sleep_us(due_us - real_us);
+      }
+    };
+
+    void close() {delete sim; sim = NULL;};
+
+  private:
+    ANTSimulator * sim;
+    unsigned long long start_ns;
+};
+
+//! Channel list for one module as the simulated devices are numbered
+static inline void gateway_bench_channels( ANT_Channel channels[CHANNELS], ANT_Channel * channel_list[CHANNELS] )
+{
+  for(byte c = 0; c < CHANNELS; c++)
+  {
+    bench_channel(&channels[c], c, channel_types[c], DEVCE_GPS_RATE);
+    channels[c].device_number_LSB = (1000 + c) & 0xFF;
+    channels[c].device_number_MSB = (1000 + c) >> 8;
+    channel_list[c] = &channels[c];
+  }
+}
+
+#endif //GatewayBench_h
@@ -0,0 +1,117 @@
+//Copyright 2013 Brody Kenrick.
+//Shared by the benches (bench_*.cpp) -- an example-style loop over ANTPlus and ANTSimulator
+
+//Each trial runs in its own process (bench_fork()) so it starts from a clean host: clock at 0,
+// pins low and nothing left over from the last trial. Results come back through a pipe.
+
+#ifndef HostBench_h
+#define HostBench_h
+
+#include <Arduino.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ANTPlus.h"
+#include "ANTSimulator.h"
+
+//As wired in the examples
+#define BENCH_RTS_PIN      (2)
+#define BENCH_SUSPEND_PIN  (3)
+#define BENCH_SLEEP_PIN    (4)
+#define BENCH_RESET_PIN    (5)
+
+#define BENCH_LOOP_US      (200)  //!< Work in loop() besides reading packets
+#define BENCH_MAX_TRIALS   (64)
+
+//! Called for every packet readPacket() returns (EXPECTED or OTHER)
+typedef void (*BenchPacketHandler)( const ANT_Packet * packet, void * context );
+
+//! A slave channel as the examples set it up (wildcard device number). The simulator does not check the network key.
+static inline void bench_channel( ANT_Channel * channel, int channel_number, int device_type, int period )
+{
+  memset(channel, 0, sizeof(*channel));
+  channel->channel_number = channel_number;
+  channel->channel_type   = PUBLIC_NETWORK;
+  channel->network_number = 0;
+  channel->timeout        = DEVCE_TIMEOUT;
+  channel->device_type    = device_type;
+  channel->freq           = DEVCE_SENSOR_FREQ;
+  channel->period         = period;
+  channel->channel_establish = ANT_CHANNEL_ESTABLISH_PROGRESSING;
+}
+
+//! One pass of loop(): read until there is nothing left, then BENCH_LOOP_US of other work
+static inline void bench_loop( ANTPlus & antplus, BenchPacketHandler handler = NULL, void * context = NULL )
+{
+  byte packet_buffer[ANT_MAX_PACKET_LEN];
+  ANT_Packet * packet = (ANT_Packet *) packet_buffer;
+  MESSAGE_READ ret_val;
+  while((ret_val = antplus.readPacket(packet, ANT_MAX_PACKET_LEN, 0)) != MESSAGE_READ_NONE)
+  {
+    if(handler && ((ret_val == MESSAGE_READ_EXPECTED) || (ret_val == MESSAGE_READ_OTHER)))
+    {
+      handler(packet, context);
+    }
+  }
+  host_advance_us(BENCH_LOOP_US);
+}
+
+//! Run trial(index, result) in a child process. False if it did not finish.
+template<typename T> boolean bench_fork( void (*trial)( int index, T * result ), int index, T * result )
+{
+  int fds[2];
+  if(pipe(fds) != 0)
+  {
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0)
+  {
+    close(fds[0]);
+    host_reset();
+    Serial.setOutput(NULL);
+    memset(result, 0, sizeof(T));
+    trial(index, result);
+    boolean written = (::write(fds[1], result, sizeof(T)) == (ssize_t)sizeof(T));
+    close(fds[1]);
+    _exit(written ? 0 : 1);
+  }
+  close(fds[1]);
+  boolean read_ok = (pid > 0) && (::read(fds[0], result, sizeof(T)) == (ssize_t)sizeof(T));
+  close(fds[0]);
+  int status = 0;
+  if(pid > 0)
+  {
+    waitpid(pid, &status, 0);
+  }
+  return read_ok && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+//Summaries over trials
+
+static inline int bench_compare_ul( const void * a, const void * b )
+{
+  unsigned long x = *(const unsigned long *)a;
+  unsigned long y = *(const unsigned long *)b;
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+//! Sorts values. Prints mean, median and 90th percentile.
+static inline void bench_print_spread( const char * label, unsigned long * values, int count )
+{
+  if(count == 0)
+  {
+    printf("  %-28s      -\n", label);
+    return;
+  }
+  qsort(values, count, sizeof(values[0]), bench_compare_ul);
+  unsigned long long total = 0;
+  for(int i = 0; i < count; i++)
+  {
+    total += values[i];
+  }
+  printf("  %-28s mean %7llu  median %7lu  p90 %7lu\n", label, total / count, values[count / 2], values[(count * 9) / 10]);
+}
+
+#endif //HostBench_h
@@ -0,0 +1,104 @@
+//Copyright 2013 Brody Kenrick.
+//Host (Linux) stand-in for the Arduino Print and Stream classes
+
+#ifndef Stream_h
+#define Stream_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+class __FlashStringHelper;
+
+class Print
+{
+  public:
+    virtual ~Print() {};
+    virtual size_t write( uint8_t c ) = 0;
+    virtual size_t write( const uint8_t * buffer, size_t size )
+    {
+      size_t n = 0;
+      while(size--)
+      {
+        n += write(*buffer++);
+      }
+      return n;
+    };
+    size_t write( const char * str ) {return (str == NULL) ? 0 : write((const uint8_t *)str, strlen(str));};
+    virtual void flush() {};
+
+    size_t print( const __FlashStringHelper * str ) {return write((const char *)str);};
+    size_t print( const char * str ) {return write(str);};
+    size_t print( char c ) {return write((uint8_t)c);};
+    size_t print( unsigned char value, int base = DEC_BASE ) {return printNumber(value, base);};
+    size_t print( int value, int base = DEC_BASE ) {return printSigned(value, base);};
+    size_t print( unsigned int value, int base = DEC_BASE ) {return printNumber(value, base);};
+    size_t print( long value, int base = DEC_BASE ) {return printSigned(value, base);};
+    size_t print( unsigned long value, int base = DEC_BASE ) {return printNumber(value, base);};
+    size_t print( double value, int digits = 2 )
+    {
+      char text[32];
+      snprintf(text, sizeof(text), "%.*f", digits, value);
+      return write(text);
+    };
+
+    size_t println() {return write((uint8_t)'\n');};
+    template<typename T> size_t println( T value ) {size_t n = print(value); return n + println();};
+    template<typename T> size_t println( T value, int format ) {size_t n = print(value, format); return n + println();};
+
+  private:
+    enum {DEC_BASE = 10};
+
+    size_t printNumber( unsigned long value, int base )
+    {
+      char digits[8 * sizeof(unsigned long) + 1];
+      int  count = 0;
+      if(base < 2)
+      {
+        base = DEC_BASE;
+      }
+      do
+      {
+        int digit = value % base;
+        digits[count++] = (digit < 10) ? ('0' + digit) : ('A' + digit - 10);
+        value /= base;
+      } while(value);
+      size_t n = 0;
+      while(count)
+      {
+        n += write((uint8_t)digits[--count]);
+      }
+      return n;
+    };
+    size_t printSigned( long value, int base )
+    {
+      size_t n = 0;
+      if((value < 0) && (base == DEC_BASE))
+      {
+        n += write((uint8_t)'-');
+        return n + printNumber(0UL - (unsigned long)value, base);
+      }
+      return printNumber((unsigned long)value, base);
+    };
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes( uint8_t * buffer, size_t length )
+    {
+      size_t count = 0;
+      while((count < length) && (available() > 0))
+      {
+        buffer[count++] = read();
+      }
+      return count;
+    };
+};
+
+#endif //Stream_h
@@ -0,0 +1,124 @@
+//Copyright 2013 Brody Kenrick.
+//Fault bench -- setup and delivery with a noisy UART, missed RTS pulses and a slow module
+
+//One HRM channel for a minute at each fault level. The library is expected to get the channel up and
+// keep it up through resends and resets (see ANT_RECOVERY_STAGE) -- this shows how often and at what cost.
+
+#include <Arduino.h>
+
+#include "HostBench.h"
+
+#define TRIALS         (10)
+#define RUN_MS         (60000)
+
+typedef struct FaultLevel_struct
+{
+   const char * name;
+   ANT_SimFaults faults;
+} FaultLevel;
+
+static const FaultLevel levels[] =
+{
+  //                       rx_drop  rx_corrupt tx_drop  rts_missing slow   slow_us
+  {"none",               {0,       0,         0,       0,          0,     0}},
+  {"light",              {0.0005,  0.005,     0.0005,  0.01,       0.01,  20000}},
+  {"heavy",              {0.005,   0.05,      0.005,   0.05,       0.05,  50000}},
+  {"slow module",        {0,       0,         0,       0,          0.3,   60000}},
+};
+#define LEVELS (sizeof(levels) / sizeof(levels[0]))
+
+typedef struct FaultResult_struct
+{
+   unsigned long established_ms;  //!< begin() to the channel established (0 if never)
+   unsigned long data_to_host;
+   unsigned long received;
+   unsigned long recoveries[ANT_RECOVERY_STAGES];
+   unsigned long hw_resets;
+   unsigned long bad_checksum;
+   unsigned long rts_missed;
+} FaultResult;
+
+//Set before each fork
+static const FaultLevel * level;
+
+static void fault_trial( int index, FaultResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, ANT_BAUD_RATE_DEFAULT, index + 1);
+  sim.addDevice(1001, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+  sim.setFaults(&level->faults);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+
+  ANT_Channel channel;
+  bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_GPS_RATE);
+
+  antplus.begin(sim, ANT_BAUD_RATE_DEFAULT);
+  while(millis() < RUN_MS)
+  {
+    bench_loop(antplus);
+    if(channel.channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+    {
+      antplus.progress_setup_channel(&channel);
+    }
+    else if(result->established_ms == 0)
+    {
+      result->established_ms = millis();
+    }
+  }
+
+  ANT_Stats stats;
+  antplus.getStats(&stats);
+  result->data_to_host = sim.getStats()->data_to_host;
+  result->received     = stats.rx_channel_data[0];
+  memcpy(result->recoveries, stats.recovery_count, sizeof(result->recoveries));
+  result->hw_resets    = stats.hw_resets;
+  result->bad_checksum = stats.rx_bad_checksum;
+  result->rts_missed   = stats.rts_missed;
+}
+
+int main()
+{
+  printf("== Faults (one HRM, %d s, %d trials each) ==\n", RUN_MS / 1000, TRIALS);
+  for(unsigned int l = 0; l < LEVELS; l++)
+  {
+    level = &levels[l];
+    unsigned long established_ms[TRIALS];
+    unsigned long delivered_permille[TRIALS];
+    unsigned long recoveries[ANT_RECOVERY_STAGES] = {0};
+    unsigned long hw_resets = 0, bad_checksum = 0, rts_missed = 0;
+    int established = 0;
+    int finished = 0;
+    for(int i = 0; i < TRIALS; i++)
+    {
+      FaultResult result;
+      if(!bench_fork(fault_trial, i, &result))
+      {
+        continue;
+      }
+      if(result.established_ms)
+      {
+        established_ms[established] = result.established_ms;
+        delivered_permille[established] = result.data_to_host ? ((result.received * 1000UL) / result.data_to_host) : 0;
+        established++;
+      }
+      for(byte s = 0; s < ANT_RECOVERY_STAGES; s++)
+      {
+        recoveries[s] += result.recoveries[s];
+      }
+      hw_resets += result.hw_resets;
+      bad_checksum += result.bad_checksum;
+      rts_missed += result.rts_missed;
+      finished++;
+    }
+    printf("%s: established %d/%d\n", level->name, established, finished);
+    bench_print_spread("begin to established (ms)", established_ms, established);
+    bench_print_spread("data delivered (per mille)", delivered_permille, established);
+    printf("  per trial: resend %.1f  soft reset %.1f  hard reset %.1f  hw_resets %.1f  bad checksum %.1f  rts missed %.1f\n",
+           finished ? (double)recoveries[ANT_RECOVERY_RESEND] / finished : 0.0,
+           finished ? (double)recoveries[ANT_RECOVERY_SOFT_RESET] / finished : 0.0,
+           finished ? (double)recoveries[ANT_RECOVERY_HARD_RESET] / finished : 0.0,
+           finished ? (double)hw_resets / finished : 0.0,
+           finished ? (double)bad_checksum / finished : 0.0,
+           finished ? (double)rts_missed / finished : 0.0);
+  }
+  return 0;
+}
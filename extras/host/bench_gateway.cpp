@@ -0,0 +1,238 @@
+//Copyright 2013 Brody Kenrick.
+//Gateway bench -- ANTGateway over 1 to 16 simulated modules: frames a second, latency to the subscribers and drops
+
+//The simulated modules are in GatewayBench.h. Latency is from the reader having the frame to a subscriber popping
+// the metric, in real time.
+//Then backpressure: a subscriber that cannot keep up, dropping (ANT_GATEWAY_FULL_DROP) or holding the
+// decoders back (ANT_GATEWAY_FULL_WAIT).
+//Build with -DANT_DEVICE_NUMBER_CHANNELS=8 and -pthread.
+
+#include <Arduino.h>
+
+#include <sched.h>
+
+#include "GatewayBench.h"
+
+#define DECODERS           (2)
+#define RUN_MS             (3000)
+#define SETUP_LIMIT_MS     (20000)
+#define SLOW_SUBSCRIBER_US (2000)     //!< Work per metric for the subscriber that falls behind
+#define LATENCY_SAMPLES    (1 << 18)
+
+//Subscribers
+
+typedef struct SubscriberRun_struct
+{
+   ANTGateway * gateway;
+   int index;
+   unsigned long work_us;            //!< Per metric
+   volatile boolean measuring;
+   volatile boolean stop;
+   unsigned long popped;
+   unsigned long * latency_ns;       //!< While measuring
+   unsigned long samples;
+} SubscriberRun;
+
+static void * subscriber_thread( void * context )
+{
+  SubscriberRun * run = (SubscriberRun *)context;
+  ANT_GatewayMetric metric;
+  unsigned int idle = 0;
+  while(!run->stop)
+  {
+    if(!run->gateway->pop(run->index, &metric))
+    {
+      if(idle++ < 4)
+      {
+        sched_yield();
+      }
+      else
+      {
+        sleep_us(50);
+      }
+      continue;
+    }
+    idle = 0;
+    run->popped++;
+    if(run->measuring && (run->samples < LATENCY_SAMPLES))
+    {
+      run->latency_ns[run->samples++] = (unsigned long)(ANTGateway::now_ns() - metric.received_ns);
+    }
+    if(run->work_us)
+    {
+      sleep_us(run->work_us);
+    }
+  }
+  return NULL;
+}
+
+
+//Trials
+
+typedef struct GatewayResult_struct
+{
+   unsigned long setup_ms;
+   unsigned long frames;             //!< Read during the run
+   unsigned long reader_dropped;
+   unsigned long decoder_waits;
+   unsigned long undecoded;
+   unsigned long delivered[2];
+   unsigned long dropped[2];
+   unsigned long latency_p50_us;
+   unsigned long latency_p99_us;
+   unsigned long latency_max_us;
+} GatewayResult;
+
+typedef struct GatewayTrial_struct
+{
+   byte modules;
+   unsigned long slow_work_us;       //!< Second subscriber (0 -- as fast as the first)
+   ANT_GATEWAY_FULL slow_full;
+} GatewayTrial;
+
+static GatewayTrial trial_setup;
+
+static void totals( ANTGateway * gateway, GatewayResult * result )
+{
+  memset(result, 0, sizeof(*result));
+  for(byte m = 0; m < gateway->moduleCount(); m++)
+  {
+    ANT_GatewayReaderStats stats;
+    gateway->getReaderStats(m, &stats);
+    result->frames += stats.frames;
+    result->reader_dropped += stats.dropped;
+  }
+  for(byte d = 0; d < DECODERS; d++)
+  {
+    ANT_GatewayDecoderStats stats;
+    gateway->getDecoderStats(d, &stats);
+    result->decoder_waits += stats.waits;
+    result->undecoded += stats.undecoded;
+  }
+  for(int s = 0; s < 2; s++)
+  {
+    ANT_GatewaySubscriberStats stats;
+    gateway->getSubscriberStats(s, &stats);
+    result->delivered[s] = stats.delivered;
+    result->dropped[s] = stats.dropped;
+  }
+}
+
+static void gateway_trial( int index, GatewayResult * result )
+{
+  (void)index;
+  ANTGateway * gateway = new ANTGateway();
+  SimPort ports[ANT_GATEWAY_MAX_MODULES];
+  static ANT_Channel channels[ANT_GATEWAY_MAX_MODULES][CHANNELS];
+  static ANT_Channel * channel_lists[ANT_GATEWAY_MAX_MODULES][CHANNELS];
+  for(byte m = 0; m < trial_setup.modules; m++)
+  {
+    gateway_bench_channels(channels[m], channel_lists[m]);
+    gateway->addModule(&ports[m], channel_lists[m], CHANNELS);
+  }
+
+  SubscriberRun runs[2];
+  pthread_t threads[2];
+  for(int s = 0; s < 2; s++)
+  {
+    memset(&runs[s], 0, sizeof(runs[s]));
+    runs[s].gateway = gateway;
+    runs[s].index = gateway->subscribe((s == 1) ? trial_setup.slow_full : ANT_GATEWAY_FULL_DROP);
+    runs[s].work_us = (s == 1) ? trial_setup.slow_work_us : 0;
+    runs[s].latency_ns = new unsigned long[LATENCY_SAMPLES];
+    pthread_create(&threads[s], NULL, subscriber_thread, &runs[s]);
+  }
+
+  unsigned long long begin_ns = ANTGateway::now_ns();
+  gateway->start(DECODERS);
+  while(!gateway->established() && ((ANTGateway::now_ns() - begin_ns) < (SETUP_LIMIT_MS * 1000000ULL)))
+  {
+    sleep_us(10000);
+  }
+  if(gateway->established())
+  {
+    result->setup_ms = (unsigned long)((ANTGateway::now_ns() - begin_ns) / 1000000ULL);
+    GatewayResult before;
+    totals(gateway, &before);
+    runs[0].measuring = true;
+    sleep_us(RUN_MS * 1000ULL);
+    runs[0].measuring = false;
+    unsigned long setup_ms = result->setup_ms;
+    totals(gateway, result);
+    result->setup_ms = setup_ms;
+    result->frames -= before.frames;
+    result->reader_dropped -= before.reader_dropped;
+    result->decoder_waits -= before.decoder_waits;
+    result->undecoded -= before.undecoded;
+    for(int s = 0; s < 2; s++)
+    {
+      result->delivered[s] -= before.delivered[s];
+      result->dropped[s] -= before.dropped[s];
+    }
+
+    unsigned long samples = runs[0].samples;
+    if(samples)
+    {
+      qsort(runs[0].latency_ns, samples, sizeof(unsigned long), bench_compare_ul);
+      result->latency_p50_us = runs[0].latency_ns[samples / 2] / 1000;
+      result->latency_p99_us = runs[0].latency_ns[(samples * 99) / 100] / 1000;
+      result->latency_max_us = runs[0].latency_ns[samples - 1] / 1000;
+    }
+  }
+  //The process ends with the trial -- the gateway is only stopped, not cleaned up
+  gateway->stop();
+  for(int s = 0; s < 2; s++)
+  {
+    runs[s].stop = true;
+    pthread_join(threads[s], NULL);
+  }
+}
+
+static void print_result( const char * label, const GatewayResult * result )
+{
+  double seconds = RUN_MS / 1000.0;
+  printf("  %-22s setup %5lu ms  %7.0f frames/s  %7.0f metrics/s  latency p50 %6lu us  p99 %6lu us  max %6lu us\n",
+         label, result->setup_ms, result->frames / seconds, result->delivered[0] / seconds,
+         result->latency_p50_us, result->latency_p99_us, result->latency_max_us);
+  printf("  %-22s dropped: reader %lu, subscriber %lu / %lu; decoder waits %lu; undecoded %lu\n", "",
+         result->reader_dropped, result->dropped[0], result->dropped[1], result->decoder_waits, result->undecoded);
+}
+
+int main()
+{
+  static const byte module_counts[] = {1, 2, 4, 8, 16};
+  char label[32];
+  GatewayResult result;
+
+  printf("== Gateway: %d channels a module at %dx real time, %d decoders, 2 subscribers ==\n", CHANNELS, SIM_SPEEDUP, DECODERS);
+  for(byte i = 0; i < sizeof(module_counts); i++)
+  {
+    trial_setup.modules = module_counts[i];
+    trial_setup.slow_work_us = 0;
+    trial_setup.slow_full = ANT_GATEWAY_FULL_DROP;
+    snprintf(label, sizeof(label), "%d module%s", module_counts[i], (module_counts[i] == 1) ? "" : "s");
+    if(!bench_fork(gateway_trial, 0, &result) || !result.setup_ms)
+    {
+      printf("  %-22s failed\n", label);
+      continue;
+    }
+    print_result(label, &result);
+  }
+
+  printf("== Backpressure: 16 modules, second subscriber %d us a metric ==\n", SLOW_SUBSCRIBER_US);
+  static const ANT_GATEWAY_FULL fulls[] = {ANT_GATEWAY_FULL_DROP, ANT_GATEWAY_FULL_WAIT};
+  static const char * full_names[] = {"slow one drops", "slow one waits"};
+  for(byte i = 0; i < 2; i++)
+  {
+    trial_setup.modules = 16;
+    trial_setup.slow_work_us = SLOW_SUBSCRIBER_US;
+    trial_setup.slow_full = fulls[i];
+    if(!bench_fork(gateway_trial, 0, &result) || !result.setup_ms)
+    {
+      printf("  %-22s failed\n", full_names[i]);
+      continue;
+    }
+    print_result(full_names[i], &result);
+  }
+  return 0;
+}
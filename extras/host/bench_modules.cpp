@@ -0,0 +1,137 @@
+//Copyright 2013 Brody Kenrick.
+//Several modules bench -- ANTScheduler over 1, 2 and 4 simulated nRF24AP2s with eight HRM channels each
+
+//Each module has its own UART, pins and eight HRMs (paired by device number). Setup time and the data
+// delivered should scale with the module count. The byte budget is compared with reading each module dry.
+//Build with -DANTPLUS_MAX_INSTANCES=4 -DANT_DEVICE_NUMBER_CHANNELS=8.
+
+#include <Arduino.h>
+
+#include "HostBench.h"
+#include "ANTScheduler.h"
+
+#if (ANTPLUS_MAX_INSTANCES < 4) || (ANT_DEVICE_NUMBER_CHANNELS < 8)
+#error "Build with -DANTPLUS_MAX_INSTANCES=4 -DANT_DEVICE_NUMBER_CHANNELS=8"
+#endif
+
+#define MODULES_MAX    (4)
+#define CHANNELS       (8)
+#define RUN_MS         (30000)
+#define SETUP_LIMIT_MS (20000)
+
+static const byte module_counts[] = {1, 2, 4};
+static const unsigned int budgets[] = {ANT_SCHEDULER_BYTE_BUDGET, 0};
+
+typedef struct ModulesResult_struct
+{
+   unsigned long established_ms;   //!< begin() to every channel established (0 if not)
+   unsigned long packets;          //!< Data delivered in RUN_MS
+   unsigned long data_to_host;     //!< Sent by all the modules in RUN_MS
+   unsigned long host_overrun;
+   unsigned long max_round_us;     //!< Longest scheduler round
+} ModulesResult;
+
+//Set before each fork
+static byte module_count;
+static unsigned int byte_budget;
+
+static void count_data( byte module, ANTPlus * antplus, const ANT_Packet * packet, void * context )
+{
+  (void)module;
+  (void)antplus;
+  if(packet->msg_id == MESG_BROADCAST_DATA_ID)
+  {
+    (*(unsigned long *)context)++;
+  }
+}
+
+static void modules_trial( int index, ModulesResult * result )
+{
+  ANTSimulator * sims[MODULES_MAX];
+  ANTPlus * modules[MODULES_MAX];
+  ANT_Channel channels[MODULES_MAX][CHANNELS];
+  ANT_Channel * channel_lists[MODULES_MAX][CHANNELS];
+  ANTScheduler scheduler(byte_budget);
+
+  for(byte m = 0; m < module_count; m++)
+  {
+    //Four pins a module -- RTS, SUSPEND, SLEEP, RESET
+    byte pin = BENCH_RTS_PIN + (m * 4);
+    sims[m] = new ANTSimulator(pin, pin + 1, pin + 2, pin + 3, ANT_BAUD_RATE_DEFAULT, (index + 1) * (m + 1));
+    modules[m] = new ANTPlus(pin, pin + 1, pin + 2, pin + 3);
+    for(byte c = 0; c < CHANNELS; c++)
+    {
+      unsigned int device_number = 1000 + (m * 100) + c;
+      sims[m]->addDevice(device_number, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+      bench_channel(&channels[m][c], c, DEVCE_TYPE_HRM, DEVCE_GPS_RATE);
+      channels[m][c].device_number_LSB = device_number & 0xFF;
+      channels[m][c].device_number_MSB = device_number >> 8;
+      channel_lists[m][c] = &channels[m][c];
+    }
+    modules[m]->begin(*sims[m], ANT_BAUD_RATE_DEFAULT);
+    scheduler.add(modules[m], channel_lists[m], CHANNELS);
+  }
+
+  unsigned long packets = 0;
+  scheduler.setHandler(count_data, &packets);
+  while((scheduler.channelsEstablished() != ANT_CHANNEL_ESTABLISH_COMPLETE) && (millis() < SETUP_LIMIT_MS))
+  {
+    scheduler.poll();
+    host_advance_us(BENCH_LOOP_US);
+  }
+  if(scheduler.channelsEstablished() == ANT_CHANNEL_ESTABLISH_COMPLETE)
+  {
+    result->established_ms = millis();
+  }
+
+  for(byte m = 0; m < module_count; m++)
+  {
+    sims[m]->resetStats();
+  }
+  packets = 0;
+  unsigned long start_ms = millis();
+  while((millis() - start_ms) < RUN_MS)
+  {
+    unsigned long round_us = micros();
+    scheduler.poll();
+    round_us = micros() - round_us;
+    if(round_us > result->max_round_us)
+    {
+      result->max_round_us = round_us;
+    }
+    host_advance_us(BENCH_LOOP_US);
+  }
+  result->packets = packets;
+  for(byte m = 0; m < module_count; m++)
+  {
+    result->data_to_host += sims[m]->getStats()->data_to_host;
+    result->host_overrun += sims[m]->getStats()->host_overrun;
+  }
+  //The child exits -- nothing is freed
+}
+
+int main()
+{
+  printf("== Modules (8 HRM channels each, %d s at 9600 baud) ==\n", RUN_MS / 1000);
+  printf("%-8s %-8s %-10s %12s %12s %12s %10s %14s\n", "modules", "channels", "budget", "setup (ms)", "module/s", "host/s", "overrun", "max round (us)");
+  for(unsigned int b = 0; b < (sizeof(budgets) / sizeof(budgets[0])); b++)
+  {
+    for(unsigned int n = 0; n < sizeof(module_counts); n++)
+    {
+      module_count = module_counts[n];
+      byte_budget = budgets[b];
+      ModulesResult result;
+      char budget_name[16];
+      snprintf(budget_name, sizeof(budget_name), (byte_budget == 0) ? "none" : "%u", byte_budget);
+      if(!bench_fork(modules_trial, 0, &result) || !result.established_ms)
+      {
+        printf("%-8u %-8u %-10s failed\n", module_count, module_count * CHANNELS, budget_name);
+        continue;
+      }
+      unsigned long seconds = RUN_MS / 1000;
+      printf("%-8u %-8u %-10s %12lu %12lu %12lu %10lu %14lu\n", module_count, module_count * CHANNELS, budget_name,
+             result.established_ms, result.data_to_host / seconds, result.packets / seconds, result.host_overrun, result.max_round_us);
+    }
+  }
+  return 0;
+}
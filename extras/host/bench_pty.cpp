@@ -0,0 +1,282 @@
+//Copyright 2013 Brody Kenrick.
+//POSIX serial bench -- ANTPlus over ANTPosixSerial and a pseudo-terminal, with ANTSimulator on the far end
+
+//A child process bridges the pty master to an ANTSimulator running in real time (eight HRMs). The pty has no
+// modem lines so RTS is emulated and the reset is a MESG_SYSTEM_RESET_ID. Real time -- each run takes RUN_MS.
+//Compared: waiting in waitReadable() (poll()) against spinning on readPacket(), and the in-process
+// simulator (virtual clock) as the baseline for response latency.
+//Build with -DANT_DEVICE_NUMBER_CHANNELS=8.
+
+#include <Arduino.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include "HostBench.h"
+#include "ANTPosixSerial.h"
+
+#if ANT_DEVICE_NUMBER_CHANNELS < 8
+#error "Build with -DANT_DEVICE_NUMBER_CHANNELS=8"
+#endif
+
+#define CHANNELS       (8)
+#define RUN_MS         (10000)
+#define SETUP_LIMIT_MS (10000)
+#define BAUD           (57600)
+
+typedef enum
+{
+  PTY_WAIT_POLL,
+  PTY_SPIN,
+  IN_PROCESS,
+  PTY_MODES
+} PTY_MODE;
+
+static const char * mode_names[PTY_MODES] = {"pty, waitReadable()", "pty, spinning", "in-process simulator"};
+
+typedef struct PtyResult_struct
+{
+   unsigned long setup_ms;
+   unsigned long packets;
+   unsigned long response_count;
+   unsigned long response_us_mean;
+   unsigned long response_us_max;
+   unsigned long cpu_ms;
+   ANT_PosixStats port;
+} PtyResult;
+
+static PTY_MODE pty_mode;
+
+static ANTSimulator * add_devices( ANTSimulator * sim )
+{
+  for(byte c = 0; c < CHANNELS; c++)
+  {
+    sim->addDevice(1000 + c, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+  }
+  return sim;
+}
+
+//! The module end of the pty. Exits when the other end is closed.
+static void module_side( int master )
+{
+  host_reset();
+  Serial.setOutput(NULL);
+  //Its lines are not wired to anything -- out of reset and awake
+  digitalWrite(BENCH_RESET_PIN, HIGH);
+  digitalWrite(BENCH_SUSPEND_PIN, HIGH);
+  ANTSimulator * sim = add_devices(new ANTSimulator(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, BAUD));
+  sim->setBlockingWrites(false);
+  //Powered up long before the port is opened -- its startup message went nowhere
+  host_advance_us(ANT_SIM_STARTUP_US * 2);
+  while(sim->available() > 0)
+  {
+    sim->read();
+  }
+  host_set_real_time(true);
+
+  byte buffer[256];
+  while(true)
+  {
+    struct pollfd ready;
+    ready.fd = master;
+    ready.events = POLLIN;
+    ready.revents = 0;
+    ::poll(&ready, 1, 1);
+    ssize_t count = ::read(master, buffer, sizeof(buffer));
+    if((count < 0) && (errno != EAGAIN))
+    {
+      break;
+    }
+    for(ssize_t i = 0; i < count; i++)
+    {
+      sim->write(buffer[i]);
+    }
+    micros(); //Runs the simulator up to now
+    unsigned int out = 0;
+    while((sim->available() > 0) && (out < sizeof(buffer)))
+    {
+      buffer[out++] = sim->read();
+    }
+    if(out && (::write(master, buffer, out) < 0) && (errno != EAGAIN))
+    {
+      break;
+    }
+  }
+  _exit(0);
+}
+
+static void count_data( const ANT_Packet * packet, void * context )
+{
+  if(packet->msg_id == MESG_BROADCAST_DATA_ID)
+  {
+    (*(unsigned long *)context)++;
+  }
+}
+
+static unsigned long cpu_ms()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec * 1000) + (usage.ru_utime.tv_usec / 1000) + (usage.ru_stime.tv_sec * 1000) + (usage.ru_stime.tv_usec / 1000);
+}
+
+static void pty_trial( int index, PtyResult * result )
+{
+  (void)index;
+  Stream * serial;
+  ANTPosixSerial port;
+  ANTSimulator * sim = NULL;
+  pid_t module_pid = -1;
+
+  if(pty_mode == IN_PROCESS)
+  {
+    sim = add_devices(new ANTSimulator(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, BAUD));
+    serial = sim;
+  }
+  else
+  {
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+    {
+      return;
+    }
+    module_pid = fork();
+    if(module_pid == 0)
+    {
+      module_side(master);
+    }
+    host_set_real_time(true);
+    if(!port.open(ptsname(master), BAUD))
+    {
+      kill(module_pid, SIGKILL);
+      return;
+    }
+    ::close(master);
+    port.setRtsPin(BENCH_RTS_PIN, ANT_POSIX_RTS_EMULATED);
+    port.setResetPin(BENCH_RESET_PIN, ANT_POSIX_RESET_COMMAND);
+    serial = &port;
+  }
+
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+  ANT_Channel channels[CHANNELS];
+  ANT_Channel * channel_list[CHANNELS];
+  for(byte c = 0; c < CHANNELS; c++)
+  {
+    bench_channel(&channels[c], c, DEVCE_TYPE_HRM, DEVCE_GPS_RATE);
+    channels[c].device_number_LSB = (1000 + c) & 0xFF;
+    channels[c].device_number_MSB = (1000 + c) >> 8;
+    channel_list[c] = &channels[c];
+  }
+
+  unsigned long packets = 0;
+  unsigned long begin_ms = millis();
+  boolean established = false;
+  unsigned long run_start_ms = 0;
+  unsigned long run_start_cpu_ms = 0;
+  ANT_PosixStats run_start_port;
+  memset(&run_start_port, 0, sizeof(run_start_port));
+  antplus.begin(*serial, BAUD);
+  if(pty_mode == PTY_WAIT_POLL)
+  {
+    //Back with NONE on a half received frame rather than waiting in readPacket() for the rest
+    antplus.setReadBudget(ANT_POSIX_RX_BUFFER);
+  }
+  while(true)
+  {
+    byte packet_buffer[ANT_MAX_PACKET_LEN];
+    ANT_Packet * packet = (ANT_Packet *) packet_buffer;
+    MESSAGE_READ ret_val;
+    while((ret_val = antplus.readPacket(packet, ANT_MAX_PACKET_LEN, 0)) != MESSAGE_READ_NONE)
+    {
+      if((ret_val == MESSAGE_READ_EXPECTED) || (ret_val == MESSAGE_READ_OTHER))
+      {
+        count_data(packet, &packets);
+      }
+    }
+    if(!established)
+    {
+      established = (antplus.progress_setup_channels(channel_list, CHANNELS) == ANT_CHANNEL_ESTABLISH_COMPLETE);
+      if(established)
+      {
+        result->setup_ms = millis() - begin_ms;
+        run_start_ms = millis();
+        run_start_cpu_ms = cpu_ms();
+        run_start_port = *port.getStats();
+        packets = 0;
+      }
+      else if((millis() - begin_ms) > SETUP_LIMIT_MS)
+      {
+        break;
+      }
+    }
+    else if((millis() - run_start_ms) >= RUN_MS)
+    {
+      break;
+    }
+
+    if(pty_mode == PTY_WAIT_POLL)
+    {
+      port.waitReadable(10);
+    }
+    else if(pty_mode == IN_PROCESS)
+    {
+      host_advance_us(BENCH_LOOP_US);
+    }
+  }
+
+  ANT_Stats stats;
+  antplus.getStats(&stats);
+  result->packets = packets;
+  result->response_count = stats.response_count;
+  result->response_us_mean = stats.response_count ? (stats.response_us_total / stats.response_count) : 0;
+  result->response_us_max = stats.response_us_max;
+  result->cpu_ms = established ? (cpu_ms() - run_start_cpu_ms) : 0;
+  if(module_pid > 0)
+  {
+    //The run only
+    const ANT_PosixStats * port_stats = port.getStats();
+    result->port.read_calls  = port_stats->read_calls  - run_start_port.read_calls;
+    result->port.empty_reads = port_stats->empty_reads - run_start_port.empty_reads;
+    result->port.bytes_in    = port_stats->bytes_in    - run_start_port.bytes_in;
+    result->port.write_calls = run_start_port.write_calls; //All in the setup
+    result->port.bytes_out   = run_start_port.bytes_out;
+    result->port.poll_calls  = port_stats->poll_calls  - run_start_port.poll_calls;
+    result->port.errors      = port_stats->errors;
+    port.close();
+    kill(module_pid, SIGKILL);
+    waitpid(module_pid, NULL, 0);
+  }
+}
+
+int main()
+{
+  printf("== POSIX serial over a pty (8 HRM channels, %d baud, %d s) ==\n", BAUD, RUN_MS / 1000);
+  for(int mode = 0; mode < PTY_MODES; mode++)
+  {
+    pty_mode = (PTY_MODE)mode;
+    PtyResult result;
+    if(!bench_fork(pty_trial, 0, &result) || !result.setup_ms)
+    {
+      printf("%s: failed\n", mode_names[mode]);
+      continue;
+    }
+    printf("%s:\n", mode_names[mode]);
+    printf("  setup %lu ms, %lu packets/s, response mean %lu us max %lu us (%lu responses)\n", result.setup_ms,
+           result.packets / (RUN_MS / 1000), result.response_us_mean, result.response_us_max, result.response_count);
+    if(mode == IN_PROCESS)
+    {
+      continue;
+    }
+    printf("  cpu %lu ms in %d s, syscalls %lu/s\n", result.cpu_ms, RUN_MS / 1000,
+           (result.port.read_calls + result.port.empty_reads + result.port.poll_calls) / (RUN_MS / 1000));
+    printf("  read() %lu with data (%.1f bytes each), %lu empty, poll() %lu, errors %lu\n",
+           result.port.read_calls, result.port.read_calls ? (double)result.port.bytes_in / result.port.read_calls : 0.0,
+           result.port.empty_reads, result.port.poll_calls, result.port.errors);
+    printf("  setup write() %lu (%.1f bytes each -- one a message)\n", result.port.write_calls,
+           result.port.write_calls ? (double)result.port.bytes_out / result.port.write_calls : 0.0);
+  }
+  return 0;
+}
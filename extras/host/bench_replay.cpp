@@ -0,0 +1,196 @@
+//Copyright 2013 Brody Kenrick.
+//Capture and replay bench -- ANTCapture records a simulated session and ANTReplayStream plays it back
+
+//One HRM channel for a minute against the simulator (clean and with the fault levels of bench_faults), recorded
+// with ANTCapture. The capture is then played back to a fresh ANTPlus, as fast as possible and in real time.
+//Fast replay keeps the order of the traffic but not its timing. With heavy faults the library's reads depend on
+// the timing (a frame cut short by a lost byte is only given up after the mid-frame timeout), so that level is
+// only replayed in real time.
+//A replay is good when every byte the library sends matches the capture (no mismatched or extra bytes), the whole
+// capture is played and the packets readPacket() returns are the same ones in the same order. Exits non-zero if not.
+//Build with -DANTPLUS_CAPTURE.
+
+#include <Arduino.h>
+
+#include "HostBench.h"
+#include "ANTCapture.h"
+
+#if !defined(ANTPLUS_CAPTURE)
+#error "Build with -DANTPLUS_CAPTURE"
+#endif
+
+#define RUN_MS          (60000)
+#define CAPTURE_RING    (1 << 12)    //!< Drained every loop
+#define CAPTURE_MAX     (1 << 18)
+#define REPLAY_LIMIT_MS (10 * RUN_MS) //!< Virtual time -- a replay that has not finished by then is stuck
+
+typedef struct ReplayLevel_struct
+{
+   const char * name;
+   ANT_SimFaults faults;
+   boolean fast;           //!< Replayed as fast as possible as well as in real time
+} ReplayLevel;
+
+static const ReplayLevel levels[] =
+{
+  //                       rx_drop  rx_corrupt tx_drop  rts_missing slow   slow_us
+  {"none",               {0,       0,         0,       0,          0,     0},     true},
+  {"light",              {0.0005,  0.005,     0.0005,  0.01,       0.01,  20000}, true},
+  {"heavy",              {0.005,   0.05,      0.005,   0.05,       0.05,  50000}, false},
+};
+#define LEVELS (sizeof(levels) / sizeof(levels[0]))
+
+//! Packets readPacket() returned -- count and FNV-1a over msg id and data
+typedef struct PacketDigest_struct
+{
+   unsigned long packets;
+   unsigned long hash;
+} PacketDigest;
+
+typedef struct ReplayResult_struct
+{
+   unsigned long capture_bytes;
+   unsigned long capture_overflow;
+   PacketDigest  captured;
+   boolean       finished;
+   unsigned long replay_ms;          //!< Virtual time the replay took
+   unsigned long tx_mismatch;
+   unsigned long tx_extra;
+   PacketDigest  replayed;
+} ReplayResult;
+
+//! Print into a fixed buffer (the drained capture)
+class CaptureBuffer : public Print
+{
+  public:
+    CaptureBuffer() : length(0), overflow(0) {};
+    virtual size_t write( uint8_t value )
+    {
+      if(length >= CAPTURE_MAX)
+      {
+        overflow++;
+        return 0;
+      }
+      bytes[length++] = value;
+      return 1;
+    };
+    using Print::write;
+
+  public:
+    byte bytes[CAPTURE_MAX];
+    unsigned long length;
+    unsigned long overflow;
+};
+
+static void digest_packet( const ANT_Packet * packet, void * context )
+{
+  PacketDigest * digest = (PacketDigest *)context;
+  unsigned long hash = digest->packets ? digest->hash : 2166136261UL;
+  hash = (hash ^ packet->msg_id) * 16777619UL;
+  for(byte i = 0; i < packet->length; i++)
+  {
+    hash = (hash ^ packet->data[i]) * 16777619UL;
+  }
+  digest->hash = hash & 0xFFFFFFFFUL;
+  digest->packets++;
+}
+
+static void replay_rts( boolean rts_high )
+{
+  //Through the pin so the library interrupt and digitalRead() both see it
+  host_drive_pin(BENCH_RTS_PIN, rts_high ? HIGH : LOW);
+}
+
+//Set before each fork
+static const ReplayLevel * level;
+static boolean realtime;
+
+static void replay_trial( int index, ReplayResult * result )
+{
+  static CaptureBuffer capture;
+  static byte ring[CAPTURE_RING];
+
+  {
+    ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, ANT_BAUD_RATE_DEFAULT, index + 1);
+    sim.addDevice(1001, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+    sim.setFaults(&level->faults);
+    ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+    ANTCapture recorder(ring, sizeof(ring));
+    antplus.setCapture(&recorder);
+
+    ANT_Channel channel;
+    bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_GPS_RATE);
+
+    ANTCapture::writeHeader(capture, ANT_BAUD_RATE_DEFAULT);
+    antplus.begin(sim, ANT_BAUD_RATE_DEFAULT);
+    while(millis() < RUN_MS)
+    {
+      bench_loop(antplus, digest_packet, &result->captured);
+      if(channel.channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+      {
+        antplus.progress_setup_channel(&channel);
+      }
+      recorder.drain(capture);
+    }
+    recorder.drain(capture);
+    result->capture_bytes = capture.length;
+    result->capture_overflow = recorder.overflow_count + capture.overflow;
+  }
+
+  //A fresh board for the replay -- nothing drives the pins but the capture
+  host_reset();
+  ANTReplayStream replay(capture.bytes, capture.length, realtime);
+  replay.setRtsHandler(replay_rts);
+  replay.setResetPin(BENCH_RESET_PIN);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+  ANT_Channel channel;
+  bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_GPS_RATE);
+
+  antplus.begin(replay, replay.getBaudRate());
+  while(!replay.finished() && (millis() < REPLAY_LIMIT_MS))
+  {
+    bench_loop(antplus, digest_packet, &result->replayed);
+    if(channel.channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+    {
+      antplus.progress_setup_channel(&channel);
+    }
+  }
+  result->finished = replay.finished();
+  result->replay_ms = millis();
+  result->tx_mismatch = replay.tx_mismatch_count;
+  result->tx_extra = replay.tx_extra_count;
+}
+
+int main()
+{
+  int failed = 0;
+  printf("== Capture and replay (one HRM, %d s) ==\n", RUN_MS / 1000);
+  for(unsigned int l = 0; l < LEVELS; l++)
+  {
+    level = &levels[l];
+    for(byte mode = (level->fast ? 0 : 1); mode < 2; mode++)
+    {
+      realtime = (mode == 1);
+      char label[32];
+      snprintf(label, sizeof(label), "%s, %s", level->name, realtime ? "real time" : "fast");
+      ReplayResult result;
+      if(!bench_fork(replay_trial, 0, &result))
+      {
+        printf("  %-18s failed\n", label);
+        failed++;
+        continue;
+      }
+      boolean good = result.finished && !result.capture_overflow && !result.tx_mismatch && !result.tx_extra
+                     && (result.replayed.packets == result.captured.packets) && (result.replayed.hash == result.captured.hash);
+      printf("  %-18s capture %6lu bytes (%lu lost)  %5lu packets %08lx  replayed in %6lu ms: %5lu packets %08lx  tx mismatch %lu extra %lu  %s\n",
+             label, result.capture_bytes, result.capture_overflow, result.captured.packets, result.captured.hash,
+             result.replay_ms, result.replayed.packets, result.replayed.hash, result.tx_mismatch, result.tx_extra,
+             good ? "same" : (result.finished ? "DIFFERENT" : "STUCK"));
+      if(!good)
+      {
+        failed++;
+      }
+    }
+  }
+  return failed ? 1 : 0;
+}
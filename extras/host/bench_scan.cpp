@@ -0,0 +1,122 @@
+//Copyright 2013 Brody Kenrick.
+//Scan mode bench -- how many HRMs a continuous scan receiver keeps up with at each baud rate
+
+//Every HRM broadcasts at ~4 Hz and all of them arrive on channel 0 with extended data (16 bytes a message).
+//Build with -DANTPLUS_SCAN_MODE (and -DANT_DEVICE_TABLE_SIZE=128 so the table is not the limit).
+
+#include <Arduino.h>
+
+#include "HostBench.h"
+#include "ANTDeviceTable.h"
+
+#if !defined(ANTPLUS_SCAN_MODE)
+#error "Build with -DANTPLUS_SCAN_MODE"
+#endif
+
+#define SCAN_MS        (30000)
+#define SETUP_LIMIT_MS (10000)
+
+static const byte device_counts[] = {10, 30, 60};
+static const unsigned long scan_rates[] = {ANT_BAUD_RATE_DEFAULT, 19200, 57600};
+
+typedef struct ScanResult_struct
+{
+   boolean established;
+   unsigned long on_air;          //!< Broadcasts from all devices
+   unsigned long data_to_host;    //!< Produced by the module (overflowed ones included)
+   unsigned long received;        //!< Decoded by the host
+   unsigned long devices_seen;    //!< In the table at the end
+   unsigned long bad_checksum;
+   unsigned long host_overrun;
+   unsigned long module_overflow;
+} ScanResult;
+
+//Set before each fork
+static byte device_count;
+static unsigned long scan_rate;
+
+static void table_update( const ANT_Packet * packet, void * context )
+{
+  ANTDeviceTable * table = (ANTDeviceTable *) context;
+  ANT_DeviceId id;
+  if(ANTPlus::get_extended_device_id(packet, &id) && ((id.device_type & ~ANT_ID_DEVICE_TYPE_PAIRING_FLAG) == DEVCE_TYPE_HRM))
+  {
+    table->update(packet, millis());
+  }
+}
+
+static void scan_trial( int index, ScanResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, scan_rate, index + 1);
+  for(byte i = 0; i < device_count; i++)
+  {
+    sim.addDevice(3000 + i, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+  }
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+  ANTDeviceTable table;
+
+  ANT_Channel channel;
+  bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_HRM_LOWEST_RATE);
+  channel.scan_mode = true;
+
+  antplus.begin(sim, scan_rate);
+  while((channel.channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE) && (millis() < SETUP_LIMIT_MS))
+  {
+    bench_loop(antplus);
+    antplus.progress_setup_channel(&channel);
+  }
+  result->established = (channel.channel_establish == ANT_CHANNEL_ESTABLISH_COMPLETE);
+
+  ANT_Stats stats;
+  antplus.getStats(&stats, true);
+  sim.resetStats();
+  unsigned long tx_before = 0;
+  for(byte i = 0; i < device_count; i++)
+  {
+    tx_before += sim.device(i)->tx_count;
+  }
+  unsigned long start_ms = millis();
+  while((millis() - start_ms) < SCAN_MS)
+  {
+    bench_loop(antplus, table_update, &table);
+  }
+
+  antplus.getStats(&stats);
+  const ANT_SimStats * sim_stats = sim.getStats();
+  for(byte i = 0; i < device_count; i++)
+  {
+    result->on_air += sim.device(i)->tx_count;
+  }
+  result->on_air         -= tx_before;
+  result->data_to_host    = sim_stats->data_to_host;
+  result->received        = stats.rx_channel_data[0];
+  result->devices_seen    = table.count();
+  result->bad_checksum    = stats.rx_bad_checksum;
+  result->host_overrun    = sim_stats->host_overrun;
+  result->module_overflow = sim_stats->module_overflow;
+}
+
+int main()
+{
+  printf("== Scan mode (HRMs at ~4 Hz, %d s) ==\n", SCAN_MS / 1000);
+  printf("%-8s %-8s %10s %10s %10s %8s %8s %10s %10s\n", "baud", "devices", "on air/s", "module/s", "host/s", "seen", "bad", "overrun", "overflow");
+  for(unsigned int r = 0; r < (sizeof(scan_rates) / sizeof(scan_rates[0])); r++)
+  {
+    for(unsigned int d = 0; d < sizeof(device_counts); d++)
+    {
+      scan_rate = scan_rates[r];
+      device_count = device_counts[d];
+      ScanResult result;
+      if(!bench_fork(scan_trial, 0, &result) || !result.established)
+      {
+        printf("%-8lu %-8u failed\n", scan_rate, device_count);
+        continue;
+      }
+      unsigned long seconds = SCAN_MS / 1000;
+      printf("%-8lu %-8u %10lu %10lu %10lu %8lu %8lu %10lu %10lu\n", scan_rate, device_count,
+             result.on_air / seconds, result.data_to_host / seconds, result.received / seconds,
+             result.devices_seen, result.bad_checksum, result.host_overrun, result.module_overflow);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,333 @@
+//Copyright 2013 Brody Kenrick.
+//Search policy bench -- time to acquire, right-device rate and radio time for the search settings on ANT_Channel
+
+//Gym: the wanted HRM is the nearest (bin 1) with six others from bin 3 out. A wildcard search takes whichever it hears first.
+//Far: the wanted HRM is at bin 3 and nothing is nearer -- proximity pairing has to widen to find it.
+//Pairing: a wildcard search that stores the device (cold) then a start that opens with the stored ID (paired).
+//Multi: HRM, power and cadence channels opened together -- one at a time, by priority, and with search sharing.
+
+#include <Arduino.h>
+
+#include "HostBench.h"
+#include "ANTPairing.h"
+
+#define TRIALS         (20)
+#define GIVE_UP_MS     (60000)
+#define OWN_DEVICE     (1001)
+
+typedef struct SearchPolicy_struct
+{
+   const char * name;
+   byte lp_search_timeout;
+   boolean high_duty_search;
+   byte proximity_bin;
+   byte proximity_widen_to;
+   signed char rssi_threshold;
+   int timeout;                  //!< 0 == DEVCE_TIMEOUT
+} SearchPolicy;
+
+static const SearchPolicy policies[] =
+{
+  {"module default",           0,                 false, 0, 0,  0,   0},
+  {"high priority only",       ANT_LP_SEARCH_OFF, false, 0, 0,  0,   0},
+  {"high duty search",         0,                 true,  0, 0,  0,   0},
+  {"proximity 1 widen to 10",  0,                 false, 1, 10, 0,   0},
+  {"RSSI -55 dBm",             0,                 false, 0, 0,  -55, 0},
+};
+
+//Widening waits for a search timeout -- DEVCE_TIMEOUT (30 s) is too slow for a person waiting to pair
+static const SearchPolicy far_policy = {"proximity 1 widen to 10, 5 s timeout", 0, false, 1, 10, 0, 2};
+#define POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+typedef struct SearchResult_struct
+{
+   boolean acquired;
+   boolean correct;
+   unsigned long acquire_ms;
+   unsigned long radio_on_ms;
+   byte bin;
+} SearchResult;
+
+//Set before each fork -- the child inherits them
+static const SearchPolicy * policy;
+static byte own_bin;
+static boolean pairing_cold;
+static char pairing_path[64];
+
+static ANT_SimDevice * add_hrms( ANTSimulator & sim )
+{
+  ANT_SimDevice * own = sim.addDevice(OWN_DEVICE, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE /*~4 Hz*/);
+  own->proximity_bin = own_bin;
+  own->rssi = -40 - (own_bin * 5);
+  for(byte i = 0; i < 6; i++)
+  {
+    ANT_SimDevice * other = sim.addDevice(2000 + i, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+    other->proximity_bin = own_bin + 2 + i;
+    other->rssi = -60 - (i * 5);
+  }
+  return own;
+}
+
+//! Until the channel acquires (or GIVE_UP_MS) plus linger_ms. Returns the radio time up to the acquire.
+static unsigned long run_channel( ANTPlus & antplus, ANTSimulator & sim, ANT_Channel * channel, unsigned long linger_ms )
+{
+  unsigned long radio_on_ms = 0;
+  unsigned long acquired_at = 0;
+  while(millis() < GIVE_UP_MS)
+  {
+    bench_loop(antplus);
+    if(channel->channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+    {
+      antplus.progress_setup_channel(channel);
+    }
+    if((channel->acquire_ms != 0) && (acquired_at == 0))
+    {
+      acquired_at = millis();
+      radio_on_ms = sim.getStats()->radio_on_us / 1000;
+    }
+    if(acquired_at && ((millis() - acquired_at) >= linger_ms))
+    {
+      break;
+    }
+  }
+  return radio_on_ms;
+}
+
+static void search_trial( int index, SearchResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, ANT_BAUD_RATE_DEFAULT, index + 1);
+  ANT_SimDevice * own = add_hrms(sim);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+
+  ANT_Channel channel;
+  bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_HRM_LOWEST_RATE);
+  channel.lp_search_timeout  = policy->lp_search_timeout;
+  channel.high_duty_search   = policy->high_duty_search;
+  channel.proximity_bin      = policy->proximity_bin;
+  channel.proximity_widen_to = policy->proximity_widen_to;
+  channel.rssi_threshold     = policy->rssi_threshold;
+  if(policy->timeout)
+  {
+    channel.timeout = policy->timeout;
+  }
+
+  antplus.begin(sim, ANT_BAUD_RATE_DEFAULT);
+  result->radio_on_ms = run_channel(antplus, sim, &channel, 0);
+  result->acquired    = (channel.acquire_ms != 0);
+  result->acquire_ms  = channel.acquire_ms;
+  result->correct     = (sim.trackedDevice(0) == own);
+  result->bin         = channel.acquired_bin;
+}
+
+static void pairing_trial( int index, SearchResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, ANT_BAUD_RATE_DEFAULT, (index + 1) * (pairing_cold ? 1 : 7));
+  ANT_SimDevice * own = add_hrms(sim);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+  ANTPairingFile store(pairing_path);
+
+  ANT_Channel channel;
+  bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_HRM_LOWEST_RATE);
+  channel.pairing = &store;
+  if(pairing_cold)
+  {
+    //Start from nothing stored. The bench keeps whatever was found first as "the" HRM.
+    store.clear(0);
+  }
+
+  antplus.begin(sim, ANT_BAUD_RATE_DEFAULT);
+  //Long enough after the acquire for the channel ID request and the save
+  result->radio_on_ms = run_channel(antplus, sim, &channel, 2000);
+  result->acquired    = (channel.acquire_ms != 0);
+  result->acquire_ms  = channel.acquire_ms;
+  result->correct     = pairing_cold ? (sim.trackedDevice(0) == own) : (channel.pairing_state == ANT_PAIRING_LEARNT);
+}
+
+static void print_results( const char * name, SearchResult * results, int count )
+{
+  unsigned long acquire_ms[BENCH_MAX_TRIALS];
+  unsigned long radio_ms[BENCH_MAX_TRIALS];
+  unsigned long bins[BENCH_MAX_TRIALS];
+  int acquired = 0;
+  int correct = 0;
+  for(int i = 0; i < count; i++)
+  {
+    if(results[i].acquired)
+    {
+      acquire_ms[acquired] = results[i].acquire_ms;
+      radio_ms[acquired] = results[i].radio_on_ms;
+      bins[acquired] = results[i].bin;
+      acquired++;
+    }
+    correct += results[i].correct ? 1 : 0;
+  }
+  printf("%s: acquired %d/%d, wanted device %d/%d\n", name, acquired, count, correct, count);
+  bench_print_spread("open to acquire (ms)", acquire_ms, acquired);
+  bench_print_spread("radio on to acquire (ms)", radio_ms, acquired);
+  if(policy && policy->proximity_bin)
+  {
+    bench_print_spread("acquired in bin", bins, acquired);
+  }
+}
+
+
+#if ANT_DEVICE_NUMBER_CHANNELS >= 3
+typedef struct MultiResult_struct
+{
+   unsigned long all_acquired_ms;    //!< From begin()
+   unsigned long acquire_ms[3];
+   unsigned long radio_on_ms;
+} MultiResult;
+
+typedef enum
+{
+  MULTI_ONE_AT_A_TIME,
+  MULTI_PRIORITY,
+  MULTI_PRIORITY_SHARING,
+  MULTI_MODES
+} MULTI_MODE;
+
+static const char * multi_names[MULTI_MODES] = {"one at a time", "priority (HRM > power > cadence)", "priority + search sharing"};
+static MULTI_MODE multi_mode;
+
+static void multi_trial( int index, MultiResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, ANT_BAUD_RATE_DEFAULT, index + 1);
+  sim.addDevice(OWN_DEVICE, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+  sim.addDevice(1002, DEVCE_TYPE_POWER, 5, DEVCE_POWER_RATE);
+  sim.addDevice(1003, DEVCE_TYPE_SPEED_AND_CADENCE, 1, DEVCE_SPEED_AND_CADENCE_RATE);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+
+  ANT_Channel hrm, power, cadence;
+  bench_channel(&hrm, 0, DEVCE_TYPE_HRM, DEVCE_HRM_LOWEST_RATE);
+  bench_channel(&power, 1, DEVCE_TYPE_POWER, DEVCE_POWER_RATE);
+  bench_channel(&cadence, 2, DEVCE_TYPE_SPEED_AND_CADENCE, DEVCE_SPEED_AND_CADENCE_RATE);
+  ANT_Channel * channels[3] = {&cadence, &power, &hrm}; //Listed lowest priority first -- progress_setup_channels() sorts
+  for(byte i = 0; i < 3; i++)
+  {
+    //High priority searches contend for the radio
+    channels[i]->lp_search_timeout = ANT_LP_SEARCH_OFF;
+    if(multi_mode != MULTI_ONE_AT_A_TIME)
+    {
+      channels[i]->search_priority = i + 1;
+    }
+    if(multi_mode == MULTI_PRIORITY_SHARING)
+    {
+      channels[i]->search_sharing_cycles = 1;
+    }
+  }
+
+  antplus.begin(sim, ANT_BAUD_RATE_DEFAULT);
+  while(millis() < GIVE_UP_MS)
+  {
+    bench_loop(antplus);
+    if(multi_mode == MULTI_ONE_AT_A_TIME)
+    {
+      for(byte i = 0; i < 3; i++)
+      {
+        if(channels[i]->channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE)
+        {
+          antplus.progress_setup_channel(channels[i]);
+        }
+      }
+    }
+    else
+    {
+      antplus.progress_setup_channels(channels, 3);
+    }
+    if(hrm.acquire_ms && power.acquire_ms && cadence.acquire_ms)
+    {
+      result->all_acquired_ms = millis();
+      break;
+    }
+  }
+  result->acquire_ms[0] = hrm.acquire_ms;
+  result->acquire_ms[1] = power.acquire_ms;
+  result->acquire_ms[2] = cadence.acquire_ms;
+  result->radio_on_ms = sim.getStats()->radio_on_us / 1000;
+}
+
+static void multi_bench()
+{
+  printf("\n== Multi-channel (HRM, power, cadence -- high priority searches) ==\n");
+  for(int mode = 0; mode < MULTI_MODES; mode++)
+  {
+    multi_mode = (MULTI_MODE)mode;
+    unsigned long all_ms[TRIALS], hrm_ms[TRIALS], power_ms[TRIALS], cadence_ms[TRIALS], radio_ms[TRIALS];
+    int done = 0;
+    for(int i = 0; i < TRIALS; i++)
+    {
+      MultiResult result;
+      if(bench_fork(multi_trial, i, &result) && result.all_acquired_ms)
+      {
+        all_ms[done] = result.all_acquired_ms;
+        hrm_ms[done] = result.acquire_ms[0];
+        power_ms[done] = result.acquire_ms[1];
+        cadence_ms[done] = result.acquire_ms[2];
+        radio_ms[done] = result.radio_on_ms;
+        done++;
+      }
+    }
+    printf("%s: all acquired %d/%d\n", multi_names[mode], done, TRIALS);
+    bench_print_spread("begin to all acquired (ms)", all_ms, done);
+    bench_print_spread("HRM open to acquire (ms)", hrm_ms, done);
+    bench_print_spread("power open to acquire (ms)", power_ms, done);
+    bench_print_spread("cadence open to acquire (ms)", cadence_ms, done);
+    bench_print_spread("radio on (ms)", radio_ms, done);
+  }
+}
+#endif //ANT_DEVICE_NUMBER_CHANNELS >= 3
+
+
+int main()
+{
+  SearchResult results[TRIALS];
+
+  printf("== Gym (wanted HRM in bin 1, six others further out) -- %d trials ==\n", TRIALS);
+  own_bin = 1;
+  for(unsigned int p = 0; p < POLICIES; p++)
+  {
+    policy = &policies[p];
+    int count = 0;
+    for(int i = 0; i < TRIALS; i++)
+    {
+      count += bench_fork(search_trial, i, &results[count]) ? 1 : 0;
+    }
+    print_results(policy->name, results, count);
+  }
+
+  printf("\n== Far (wanted HRM in bin 3, nothing nearer) ==\n");
+  own_bin = 3;
+  policy = &far_policy;
+  int count = 0;
+  for(int i = 0; i < TRIALS; i++)
+  {
+    count += bench_fork(search_trial, i, &results[count]) ? 1 : 0;
+  }
+  print_results(policy->name, results, count);
+
+  printf("\n== Pairing (gym, wildcard search then the stored ID) ==\n");
+  own_bin = 1;
+  policy = NULL;
+  SearchResult paired[TRIALS];
+  int cold_count = 0;
+  int paired_count = 0;
+  for(int i = 0; i < TRIALS; i++)
+  {
+    snprintf(pairing_path, sizeof(pairing_path), "/tmp/antplus_bench_pairing_%d.bin", (int)getpid());
+    pairing_cold = true;
+    cold_count += bench_fork(pairing_trial, i, &results[cold_count]) ? 1 : 0;
+    pairing_cold = false;
+    paired_count += bench_fork(pairing_trial, i, &paired[paired_count]) ? 1 : 0;
+    remove(pairing_path);
+  }
+  print_results("cold (wildcard, learns the ID)", results, cold_count);
+  print_results("paired (opens with the stored ID)", paired, paired_count);
+
+#if ANT_DEVICE_NUMBER_CHANNELS >= 3
+  multi_bench();
+#else
+  printf("\nMulti-channel skipped -- build with -DANT_DEVICE_NUMBER_CHANNELS=3\n");
+#endif
+  return 0;
+}
@@ -0,0 +1,354 @@
+//Copyright 2013 Brody Kenrick.
+//Shared memory metrics bench -- ANTMetricsShm seqlock readers in other processes, alone and behind ANTGateway
+
+//Seqlock: a writer thread publishes as fast as it can into 16 modules x 8 channels while 1 and 4 reader processes
+// read random channels. The writer stores a counter as both the value and its time, so a reader that ever saw
+// half an update would find them different (torn). Voluntary context switches show whether a reader ever blocked.
+//Gateway: four simulated modules (GatewayBench.h) publishing through ANTGateway::setPublisher() while a reader
+// process polls every channel: how soon after the reader thread had a frame its value is visible, and the values.
+//Build with -DANT_DEVICE_NUMBER_CHANNELS=8, -pthread and -lrt.
+
+#include <Arduino.h>
+
+#include <sys/resource.h>
+
+#include "GatewayBench.h"
+#include "ANTMetricsShm.h"
+
+#define SHM_NAME        "/antplus_bench_metrics"
+#define SEQLOCK_MODULES (16)
+#define RUN_MS          (2000)
+#define MAX_READERS     (4)
+#define GATEWAY_MODULES (4)
+#define SETUP_LIMIT_MS  (20000)
+#define VISIBLE_SAMPLES (1 << 16)
+
+typedef struct SeqlockReaderResult_struct
+{
+   unsigned long reads;
+   unsigned long retries;
+   unsigned long torn;
+   unsigned long voluntary_switches;
+} SeqlockReaderResult;
+
+static unsigned long random_next( unsigned long * state )
+{
+  *state = (*state * 1103515245UL) + 12345UL;
+  return (*state >> 16) & 0x7FFF;
+}
+
+static pid_t start_child( int * read_fd )
+{
+  int fds[2];
+  if(pipe(fds) != 0)
+  {
+    return -1;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0)
+  {
+    close(fds[0]);
+    *read_fd = fds[1];
+    return 0;
+  }
+  close(fds[1]);
+  *read_fd = fds[0];
+  return pid;
+}
+
+template<typename T> static boolean finish_child( pid_t pid, int read_fd, T * result )
+{
+  boolean read_ok = (::read(read_fd, result, sizeof(T)) == (ssize_t)sizeof(T));
+  close(read_fd);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return read_ok && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+template<typename T> static void child_exit( int write_fd, const T * result )
+{
+  boolean written = (::write(write_fd, result, sizeof(T)) == (ssize_t)sizeof(T));
+  close(write_fd);
+  _exit(written ? 0 : 1);
+}
+
+
+//Seqlock
+
+static void seqlock_reader( int index, int write_fd )
+{
+  SeqlockReaderResult result;
+  memset(&result, 0, sizeof(result));
+  ANTMetricsShm shm;
+  if(!shm.open(SHM_NAME))
+  {
+    _exit(1);
+  }
+  struct rusage usage_before;
+  getrusage(RUSAGE_SELF, &usage_before);
+  unsigned long random_state = index + 1;
+  unsigned long long end_ns = ANTGateway::now_ns() + (RUN_MS * 1000000ULL);
+  ANT_MetricsSnapshot snapshot;
+  while(true)
+  {
+    //The clock only every so often -- the reads are the point
+    for(int i = 0; i < 256; i++)
+    {
+      unsigned long r = random_next(&random_state);
+      result.reads++;
+      if(!shm.read((r >> 3) % SEQLOCK_MODULES, r % CHANNELS, &snapshot))
+      {
+        continue;
+      }
+      for(byte m = 0; m < ANT_METRICS; m++)
+      {
+        if(snapshot.value[m] != (long)(int32_t)snapshot.updated_ns[m])
+        {
+          result.torn++;
+        }
+      }
+    }
+    if(ANTGateway::now_ns() >= end_ns)
+    {
+      break;
+    }
+  }
+  struct rusage usage_after;
+  getrusage(RUSAGE_SELF, &usage_after);
+  result.retries = shm.getRetries();
+  result.voluntary_switches = usage_after.ru_nvcsw - usage_before.ru_nvcsw;
+  child_exit(write_fd, &result);
+}
+
+static void seqlock_trial( int readers )
+{
+  ANTMetricsShm writer;
+  if(!writer.create(SHM_NAME, SEQLOCK_MODULES, CHANNELS))
+  {
+    printf("  %d reader%s: no shared memory\n", readers, (readers == 1) ? "" : "s");
+    return;
+  }
+  pid_t pids[MAX_READERS];
+  int fds[MAX_READERS];
+  for(int r = 0; r < readers; r++)
+  {
+    pids[r] = start_child(&fds[r]);
+    if(pids[r] == 0)
+    {
+      seqlock_reader(r, fds[r]);
+    }
+  }
+
+  unsigned long long start_ns = ANTGateway::now_ns();
+  unsigned long long end_ns = start_ns + (RUN_MS * 1000000ULL);
+  unsigned long updates = 0;
+  unsigned long counter = 1;
+  while(true)
+  {
+    for(int i = 0; i < 256; i++, counter++)
+    {
+      unsigned long slot = counter % (SEQLOCK_MODULES * CHANNELS);
+      writer.publish(slot / CHANNELS, slot % CHANNELS, counter % ANT_METRICS, (long)(int32_t)counter, counter);
+    }
+    updates += 256;
+    if(ANTGateway::now_ns() >= end_ns)
+    {
+      break;
+    }
+  }
+  unsigned long long writer_ns = ANTGateway::now_ns() - start_ns;
+
+  unsigned long reads = 0;
+  unsigned long retries = 0;  //!< Tries that met an update
+  unsigned long torn = 0;
+  unsigned long switches = 0;
+  int finished = 0;
+  for(int r = 0; r < readers; r++)
+  {
+    SeqlockReaderResult result;
+    if(finish_child(pids[r], fds[r], &result))
+    {
+      reads += result.reads;
+      retries += result.retries;
+      torn += result.torn;
+      switches += result.voluntary_switches;
+      finished++;
+    }
+  }
+  ANTMetricsShm::unlink(SHM_NAME);
+  double seconds = RUN_MS / 1000.0;
+  printf("  %d reader%s  writer %6.1f M updates/s (%5.1f ns each)  reads %6.1f M/s  retries/read %.3f  torn %lu  blocked %lu  (%d finished)\n",
+         readers, (readers == 1) ? " " : "s", updates / seconds / 1e6, (double)writer_ns / updates, reads / seconds / 1e6,
+         reads ? ((double)retries / reads) : 0.0, torn, switches, finished);
+}
+
+
+//Behind the gateway
+
+typedef struct GatewayReaderResult_struct
+{
+   unsigned long polls;
+   unsigned long updates_seen;
+   unsigned long visible_p50_us;
+   unsigned long visible_p99_us;
+   unsigned long visible_max_us;
+   ANT_MetricsSnapshot module_0[CHANNELS];
+} GatewayReaderResult;
+
+static void gateway_reader( int write_fd )
+{
+  static unsigned long visible_ns[VISIBLE_SAMPLES];
+  GatewayReaderResult result;
+  memset(&result, 0, sizeof(result));
+  ANTMetricsShm shm;
+  if(!shm.open(SHM_NAME))
+  {
+    _exit(1);
+  }
+  unsigned long last_sequence[GATEWAY_MODULES][CHANNELS];
+  memset(last_sequence, 0, sizeof(last_sequence));
+  unsigned long long seen_ns[GATEWAY_MODULES][CHANNELS][ANT_METRICS];
+  memset(seen_ns, 0, sizeof(seen_ns));
+  unsigned long samples = 0;
+
+  //From the first value in
+  ANT_MetricsSnapshot snapshot;
+  unsigned long long limit_ns = ANTGateway::now_ns() + (SETUP_LIMIT_MS * 1000000ULL);
+  while(shm.read(0, 0, &snapshot) && (snapshot.sequence == 0) && (ANTGateway::now_ns() < limit_ns))
+  {
+    sleep_us(1000);
+  }
+  unsigned long long end_ns = ANTGateway::now_ns() + (RUN_MS * 1000000ULL);
+  while(true)
+  {
+    if(ANTGateway::now_ns() >= end_ns)
+    {
+      break;
+    }
+    for(byte module = 0; module < GATEWAY_MODULES; module++)
+    {
+      for(byte channel = 0; channel < CHANNELS; channel++)
+      {
+        result.polls++;
+        if(!shm.read(module, channel, &snapshot) || (snapshot.sequence == last_sequence[module][channel]))
+        {
+          continue;
+        }
+        last_sequence[module][channel] = snapshot.sequence;
+        unsigned long long now_ns = ANTGateway::now_ns();
+        for(byte m = 0; m < ANT_METRICS; m++)
+        {
+          if(snapshot.updated_ns[m] && (snapshot.updated_ns[m] != seen_ns[module][channel][m]))
+          {
+            //Only metrics that changed since the last look
+            seen_ns[module][channel][m] = snapshot.updated_ns[m];
+            result.updates_seen++;
+            if(samples < VISIBLE_SAMPLES)
+            {
+              visible_ns[samples++] = (unsigned long)(now_ns - snapshot.updated_ns[m]);
+            }
+          }
+        }
+      }
+    }
+  }
+  for(byte channel = 0; channel < CHANNELS; channel++)
+  {
+    shm.read(0, channel, &result.module_0[channel]);
+  }
+  if(samples)
+  {
+    qsort(visible_ns, samples, sizeof(unsigned long), bench_compare_ul);
+    result.visible_p50_us = visible_ns[samples / 2] / 1000;
+    result.visible_p99_us = visible_ns[(samples * 99) / 100] / 1000;
+    result.visible_max_us = visible_ns[samples - 1] / 1000;
+  }
+  child_exit(write_fd, &result);
+}
+
+typedef struct GatewayTrialResult_struct
+{
+   boolean established;
+   boolean reader_finished;
+   unsigned long metrics;
+   GatewayReaderResult reader;
+} GatewayTrialResult;
+
+static void gateway_trial( int index, GatewayTrialResult * result )
+{
+  (void)index;
+  ANTMetricsShm * publisher = new ANTMetricsShm();
+  if(!publisher->create(SHM_NAME, GATEWAY_MODULES, CHANNELS))
+  {
+    return;
+  }
+  //Before any threads
+  int fd;
+  pid_t pid = start_child(&fd);
+  if(pid == 0)
+  {
+    gateway_reader(fd);
+  }
+
+  ANTGateway * gateway = new ANTGateway();
+  SimPort ports[GATEWAY_MODULES];
+  static ANT_Channel channels[GATEWAY_MODULES][CHANNELS];
+  static ANT_Channel * channel_lists[GATEWAY_MODULES][CHANNELS];
+  for(byte m = 0; m < GATEWAY_MODULES; m++)
+  {
+    gateway_bench_channels(channels[m], channel_lists[m]);
+    gateway->addModule(&ports[m], channel_lists[m], CHANNELS);
+  }
+  gateway->setPublisher(publisher);
+  gateway->start(2);
+  result->reader_finished = finish_child(pid, fd, &result->reader);
+  result->established = gateway->established();
+  gateway->stop();
+  for(byte d = 0; d < 2; d++)
+  {
+    ANT_GatewayDecoderStats stats;
+    gateway->getDecoderStats(d, &stats);
+    result->metrics += stats.metrics;
+  }
+  ANTMetricsShm::unlink(SHM_NAME);
+}
+
+static void print_value( const ANT_MetricsSnapshot * snapshot, byte metric, const char * label, double scale )
+{
+  if(snapshot->updated_ns[metric])
+  {
+    printf(" %s %.0f", label, snapshot->value[metric] * scale);
+  }
+}
+
+int main()
+{
+  printf("== Seqlock: 16 modules x %d channels, writer thread and reader processes, %d s ==\n", CHANNELS, RUN_MS / 1000);
+  seqlock_trial(1);
+  seqlock_trial(MAX_READERS);
+
+  printf("== Behind the gateway: %d simulated modules at %dx real time, one reader process polling ==\n", GATEWAY_MODULES, SIM_SPEEDUP);
+  GatewayTrialResult result;
+  if(!bench_fork(gateway_trial, 0, &result) || !result.reader_finished || !result.established)
+  {
+    printf("  failed\n");
+    return 0;
+  }
+  GatewayReaderResult * reader = &result.reader;
+  printf("  %.0f polls/s, %lu updates seen of %lu published; visible after p50 %lu us  p99 %lu us  max %lu us\n",
+         reader->polls / (RUN_MS / 1000.0), reader->updates_seen, result.metrics,
+         reader->visible_p50_us, reader->visible_p99_us, reader->visible_max_us);
+  printf("  module 0:");
+  for(byte channel = 0; channel < CHANNELS; channel++)
+  {
+    const ANT_MetricsSnapshot * snapshot = &reader->module_0[channel];
+    printf(" [%d", channel);
+    print_value(snapshot, ANT_METRIC_HEART_RATE, "hr", 1.0);
+    print_value(snapshot, ANT_METRIC_POWER, "W", 1.0);
+    print_value(snapshot, ANT_METRIC_CADENCE, "rpm", 1.0);
+    printf("]");
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,209 @@
+//Copyright 2013 Brody Kenrick.
+//UART bench -- host wakeups for the module side traffic options, and the cost of each baud rate
+
+//Traffic: one HRM tracked for a minute. It drops out for a second in every five (EVENT_RX_FAIL on the module).
+// Compared with nothing, event buffering, SDU on the beat count and filtering EVENT_RX_FAIL.
+//Baud: begin() to an established channel and command response time at each rate the nRF24AP2 runs at.
+//Auto baud: beginAutoBaud() against a module strapped to each rate.
+
+#include <Arduino.h>
+
+#include "HostBench.h"
+
+#define TRAFFIC_MS     (60000)
+#define SETUP_LIMIT_MS (10000)
+
+static const unsigned long module_rates[] = {4800, ANT_BAUD_RATE_DEFAULT, 19200, 38400, 50000, 57600};
+#define MODULE_RATES (sizeof(module_rates) / sizeof(module_rates[0]))
+
+typedef enum
+{
+  TRAFFIC_PLAIN,
+  TRAFFIC_BUFFERING,
+  TRAFFIC_SDU,
+  TRAFFIC_FILTER,
+  TRAFFIC_MODES
+} TRAFFIC_MODE;
+
+static const char * traffic_names[TRAFFIC_MODES] = {"no module options", "event buffering (1 s)", "SDU on beat count", "filter EVENT_RX_FAIL"};
+
+typedef struct TrafficResult_struct
+{
+   boolean established;
+   unsigned long uart_bursts;
+   unsigned long rx_wakeups;
+   unsigned long rx_packets;
+   unsigned long data_to_host;
+   unsigned long events_to_host;
+   unsigned long beats;           //!< Heart beat count changes the host saw
+} TrafficResult;
+
+//Set before each fork
+static TRAFFIC_MODE traffic_mode;
+static unsigned long module_rate;
+
+static void count_beats( const ANT_Packet * packet, void * context )
+{
+  static byte last_count = 0;
+  if((packet->msg_id == MESG_BROADCAST_DATA_ID) && (packet->data[7] != last_count))
+  {
+    last_count = packet->data[7];
+    (*(unsigned long *)context)++;
+  }
+}
+
+//! Retry a module option until send() takes it (it refuses while a response is outstanding)
+#define BENCH_SEND(antplus, call) while(!(call)) {bench_loop(antplus);}
+
+static void traffic_trial( int index, TrafficResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, ANT_BAUD_RATE_DEFAULT, index + 1);
+  ANT_SimDevice * hrm = sim.addDevice(1001, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+
+  ANT_Channel channel;
+  bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_GPS_RATE);
+
+  antplus.begin(sim, ANT_BAUD_RATE_DEFAULT);
+  while((channel.channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE) && (millis() < SETUP_LIMIT_MS))
+  {
+    bench_loop(antplus);
+    antplus.progress_setup_channel(&channel);
+  }
+  result->established = (channel.channel_establish == ANT_CHANNEL_ESTABLISH_COMPLETE);
+
+  if(traffic_mode == TRAFFIC_BUFFERING)
+  {
+    BENCH_SEND(antplus, antplus.setEventBuffering(ANT_EVENT_BUFFER_LOW_PRIORITY, 128, 100));
+  }
+  else if(traffic_mode == TRAFFIC_SDU)
+  {
+    const byte mask[ANT_STANDARD_DATA_PAYLOAD_SIZE] = {0, 0, 0, 0, 0, 0, 0xFF, 0};
+    BENCH_SEND(antplus, antplus.setSduMask(0, mask));
+    BENCH_SEND(antplus, antplus.configSdu(channel.channel_number, 4, 0));
+  }
+  else if(traffic_mode == TRAFFIC_FILTER)
+  {
+    BENCH_SEND(antplus, antplus.setEventFilter(ANT_EVENT_FILTER_RX_FAIL));
+  }
+
+  //Count the minute from here
+  ANT_Stats stats;
+  antplus.getStats(&stats, true);
+  sim.resetStats();
+  unsigned long start_ms = millis();
+  while((millis() - start_ms) < TRAFFIC_MS)
+  {
+    hrm->present = (((millis() - start_ms) % 5000) >= 1000);
+    bench_loop(antplus, count_beats, &result->beats);
+  }
+
+  antplus.getStats(&stats);
+  const ANT_SimStats * sim_stats = sim.getStats();
+  result->uart_bursts    = sim_stats->uart_bursts;
+  result->data_to_host   = sim_stats->data_to_host;
+  result->events_to_host = sim_stats->events_to_host;
+  result->rx_wakeups     = stats.rx_wakeups;
+  result->rx_packets     = stats.rx_packets;
+}
+
+typedef struct BaudResult_struct
+{
+   unsigned long setup_ms;        //!< begin() to an established channel (0 if it was not)
+   unsigned long response_us;     //!< Mean command to response
+   unsigned long host_overrun;
+   unsigned long auto_baud;       //!< Rate beginAutoBaud() found
+   unsigned long auto_baud_ms;
+} BaudResult;
+
+static ANTSimulator * auto_baud_sim;
+
+static void set_host_baud( unsigned long baud_rate )
+{
+  auto_baud_sim->setHostBaud(baud_rate);
+}
+
+static void baud_trial( int index, BaudResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, module_rate, index + 1);
+  sim.addDevice(1001, DEVCE_TYPE_HRM, 1, DEVCE_GPS_RATE);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+
+  ANT_Channel channel;
+  bench_channel(&channel, 0, DEVCE_TYPE_HRM, DEVCE_GPS_RATE);
+
+  antplus.begin(sim, module_rate);
+  while((channel.channel_establish != ANT_CHANNEL_ESTABLISH_COMPLETE) && (millis() < SETUP_LIMIT_MS))
+  {
+    bench_loop(antplus);
+    antplus.progress_setup_channel(&channel);
+  }
+  if(channel.channel_establish == ANT_CHANNEL_ESTABLISH_COMPLETE)
+  {
+    result->setup_ms = millis();
+  }
+
+  ANT_Stats stats;
+  antplus.getStats(&stats);
+  result->response_us  = stats.response_count ? (stats.response_us_total / stats.response_count) : 0;
+  result->host_overrun = sim.getStats()->host_overrun;
+}
+
+static void auto_baud_trial( int index, BaudResult * result )
+{
+  ANTSimulator sim(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN, module_rate, index + 1);
+  ANTPlus antplus(BENCH_RTS_PIN, BENCH_SUSPEND_PIN, BENCH_SLEEP_PIN, BENCH_RESET_PIN);
+  auto_baud_sim = &sim;
+
+  unsigned long start_ms = millis();
+  result->auto_baud = antplus.beginAutoBaud(sim, set_host_baud);
+  result->auto_baud_ms = millis() - start_ms;
+}
+
+
+int main()
+{
+  printf("== Traffic (one HRM, 60 s, out of range 1 s in every 5) ==\n");
+  printf("%-24s %8s %10s %10s %8s %8s %6s\n", "", "bursts", "wakeups", "packets", "data", "events", "beats");
+  for(int mode = 0; mode < TRAFFIC_MODES; mode++)
+  {
+    traffic_mode = (TRAFFIC_MODE)mode;
+    TrafficResult result;
+    if(!bench_fork(traffic_trial, 0, &result) || !result.established)
+    {
+      printf("%-24s failed\n", traffic_names[mode]);
+      continue;
+    }
+    printf("%-24s %8lu %10lu %10lu %8lu %8lu %6lu\n", traffic_names[mode], result.uart_bursts, result.rx_wakeups,
+           result.rx_packets, result.data_to_host, result.events_to_host, result.beats);
+  }
+
+  printf("\n== Baud rate (module and host at the same rate) ==\n");
+  printf("%-8s %16s %14s %10s\n", "baud", "setup (ms)", "response (us)", "overrun");
+  for(unsigned int r = 0; r < MODULE_RATES; r++)
+  {
+    module_rate = module_rates[r];
+    BaudResult result;
+    if(!bench_fork(baud_trial, 0, &result))
+    {
+      printf("%-8lu failed\n", module_rate);
+      continue;
+    }
+    printf("%-8lu %16lu %14lu %10lu\n", module_rate, result.setup_ms, result.response_us, result.host_overrun);
+  }
+
+  printf("\n== beginAutoBaud() ==\n");
+  printf("%-8s %10s %10s\n", "module", "found", "took (ms)");
+  for(unsigned int r = 0; r < MODULE_RATES; r++)
+  {
+    module_rate = module_rates[r];
+    BaudResult result;
+    if(!bench_fork(auto_baud_trial, 0, &result))
+    {
+      printf("%-8lu failed\n", module_rate);
+      continue;
+    }
+    printf("%-8lu %10lu %10lu\n", module_rate, result.auto_baud, result.auto_baud_ms);
+  }
+  return 0;
+}